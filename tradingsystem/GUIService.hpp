@@ -14,6 +14,7 @@
 #include <vector>
 #include "soa.hpp"
 #include "utils/utils.hpp"
+#include "utils/probes.hpp"
 #include "pricingservice.hpp"
 #include <chrono>
 #include <sstream>
@@ -58,8 +59,12 @@ public:
     long GetMillisec() const;
     void SetMillisec(long _millisec);
 
+    // Memory held by the service
+    ServiceMemoryStats MemoryStats() const;
+
 private:
-    unordered_map<string, Price<T>> guis;         ///< GUI data storage
+    CountingResource memory;                           ///< Tagged allocator of the store
+    pmr::unordered_map<string, Price<T>> guis;         ///< GUI data storage
     vector<ServiceListener<Price<T>>*> listeners; ///< Listeners for GUI data updates
     GUIConnector<T>* connector;                   ///< Connector for GUI data
     ServiceListener<Price<T>>* pricingListener;   ///< Listener for pricing data events
@@ -70,9 +75,9 @@ private:
 //                  Implementation of GUIService...
 // **********************************************************************************
 template<typename T>
-GUIService<T>::GUIService()
+GUIService<T>::GUIService() :
+        guis(&memory)
 {
-    guis = unordered_map<string, Price<T>>();
     listeners = vector<ServiceListener<Price<T>>*>();
     connector = new GUIConnector<T>(this);
     pricingListener = new PricingGUIListener<T>(this);
@@ -83,6 +88,12 @@ GUIService<T>::GUIService()
 template<typename T>
 GUIService<T>::~GUIService() {}
 
+template<typename T>
+ServiceMemoryStats GUIService<T>::MemoryStats() const
+{
+    return CollectMemoryStats("GUIService", memory, guis);
+}
+
 
 template<typename T>
 void GUIService<T>::AddListener(ServiceListener<Price<T>>* listener)
@@ -121,6 +132,8 @@ Price<T>& GUIService<T>::GetData(string key)
 
 template<typename T>
 void GUIService<T>::OnMessage(Price<T> &data) {
+    TraceSpan _span("GUIService::OnMessage");
+    ServiceProbe _probe(PROBE_PRICE, data.GetProduct());
     std::string productId = data.GetProduct().GetProductId();
 
     auto it = guis.find(productId);
@@ -224,7 +237,7 @@ void GUIConnector<T>::Publish(Price<T>& data) {
             file << output.str();
             file.close();
         } else {
-            std::cerr << "Error: Unable to open GUI output file." << std::endl;
+            LOG(LEVEL_ERROR, "Unable to open GUI output file.");
         }
     }
 }
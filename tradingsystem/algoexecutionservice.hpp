@@ -13,7 +13,9 @@
 #include <vector>
 #include "soa.hpp"
 #include "utils/utils.hpp"
+#include "utils/probes.hpp"
 #include "executionservice.hpp"
+#include "marketanalyticsservice.hpp"
 
 
 using namespace std;
@@ -38,12 +40,12 @@ public:
                   string _orderId, OrderType _orderType,
                   double _price, long _visibleQuantity,
                   long _hiddenQuantity, string _parentOrderId,
-                  bool _isChildOrder);
+                  bool _isChildOrder, uint32_t _strategyId = 0);
 
     ~AlgoExecution();
 
     // Getter
-    ExecutionOrder<T>* GetExecutionOrder();
+    ExecutionOrder<T>* GetExecutionOrder() const;
 };
 // **********************************************************************************
 //                  Implementation of AlgoExecution...
@@ -53,19 +55,27 @@ AlgoExecution<T>::AlgoExecution(const T& _product, PricingSide _side,
                                 string _orderId, OrderType _orderType,
                                 double _price, long _visibleQuantity,
                                 long _hiddenQuantity, string _parentOrderId,
-                                bool _isChildOrder)
+                                bool _isChildOrder, uint32_t _strategyId)
 {
-    executionOrder = new ExecutionOrder<T>(_product, _side, _orderId, _orderType, _price, _visibleQuantity, _hiddenQuantity, _parentOrderId, _isChildOrder);
+    executionOrder = new ExecutionOrder<T>(_product, _side, _orderId, _orderType, _price, _visibleQuantity, _hiddenQuantity, _parentOrderId, _isChildOrder, _strategyId);
 }
 template<typename T>
 AlgoExecution<T>::~AlgoExecution() {}
 
 template<typename T>
-ExecutionOrder<T>* AlgoExecution<T>::GetExecutionOrder()
+ExecutionOrder<T>* AlgoExecution<T>::GetExecutionOrder() const
 {
     return executionOrder;
 }
 
+// Heap owned by an algo execution: the execution order it points to
+template<typename T>
+size_t HeapBytes(const AlgoExecution<T>& _algo)
+{
+    const ExecutionOrder<T>* _order = _algo.GetExecutionOrder();
+    return _order ? sizeof(*_order) + HeapBytes(*_order) : 0;
+}
+
 
 // Forward Declaration
 template<typename T>
@@ -85,11 +95,14 @@ template<typename T>
 class AlgoExecutionService: public Service<string, AlgoExecution<T>>
 {
 private:
-    unordered_map<string, AlgoExecution<T>> algoExe; ///< Storage for AlgoExecutions
+    CountingResource memory;                              ///< Tagged allocator of the store
+    pmr::unordered_map<string, AlgoExecution<T>> algoExe; ///< Storage for AlgoExecutions
     vector<ServiceListener<AlgoExecution<T>>*> listeners;///< Listeners for algo execution updates
     MDAlgoListener<T>* MDlistener; ///< Listener for market data
     double spread;///< Spread threshold for executions
     long side;///< Counter for managing execution orders
+    MarketAnalyticsService<T>* analytics; ///< Order book signals, optional
+    uint32_t strategyId; ///< Strategy id stamped on the orders
 
 
     AlgoExecution<T> CreateExecutionOrder(const OrderBook<T>& orderBook, PricingSide side, double price, long quantity);
@@ -108,23 +121,40 @@ public:
 
     // Method to execute algorithmic orders
     void AlgoExecuteOrder(OrderBook<T>& orderBook);
+
+    // Read order book signals from the analytics service, whose listener must run first
+    void SetMarketAnalytics(MarketAnalyticsService<T>* _analytics);
+
+    // Strategy id stamped on the orders, used to allocate their fills to books
+    void SetStrategyId(uint32_t _strategyId);
+
+    // Memory held by the service
+    ServiceMemoryStats MemoryStats() const;
 };
 // **********************************************************************************
 //                  Implementation of AlgoExecutionService...
 // **********************************************************************************
 template<typename T>
-AlgoExecutionService<T>::AlgoExecutionService()
+AlgoExecutionService<T>::AlgoExecutionService() :
+        algoExe(&memory)
 {
-    algoExe = unordered_map<string, AlgoExecution<T>>();
     listeners = vector<ServiceListener<AlgoExecution<T>>*>();
     MDlistener = new MDAlgoListener<T>(this);
     spread = 1.0 / 128.0; // i need to cross the spread
     side = 0; //
+    analytics = nullptr;
+    strategyId = 0;
 }
 
 template<typename T>
 AlgoExecutionService<T>::~AlgoExecutionService() {}
 
+template<typename T>
+ServiceMemoryStats AlgoExecutionService<T>::MemoryStats() const
+{
+    return CollectMemoryStats("AlgoExecutionService", memory, algoExe);
+}
+
 template<typename T>
 void AlgoExecutionService<T>::AddListener(ServiceListener<AlgoExecution<T>>* listener)
 {
@@ -156,6 +186,8 @@ AlgoExecution<T>& AlgoExecutionService<T>::GetData(std::string key){
 
 template<typename T>
 void AlgoExecutionService<T>::OnMessage(AlgoExecution<T> &data) {
+    TraceSpan _span("AlgoExecutionService::OnMessage");
+    ServiceProbe _probe(PROBE_ALGO_EXECUTION, data.GetExecutionOrder()->GetProduct());
     std::string productId = data.GetExecutionOrder()->GetProduct().GetProductId();
 
     auto it = algoExe.find(productId);
@@ -175,7 +207,28 @@ template<typename T>
 AlgoExecution<T> AlgoExecutionService<T>::CreateExecutionOrder(const OrderBook<T>& orderBook, PricingSide side, double price, long quantity) {
     T product = orderBook.GetProduct();
     string orderId = GenerateRandomID(); // this function generates randoms ID for orders
-    return AlgoExecution<T>(product, side, orderId, MARKET, price, quantity, 0, "", false);
+    AlgoExecution<T> algoExecution(product, side, orderId, MARKET, price, quantity, 0, "", false, strategyId);
+
+    // snapshot the arrival market now: a throttled order may be sent against a later book
+    BidOffer touch = orderBook.GetBidAsk();
+    const Order& takenOrder = (side == BID) ? touch.GetBidOrder() : touch.GetOfferOrder();
+    double bidPrice = touch.GetBidOrder().GetPrice();
+    double offerPrice = touch.GetOfferOrder().GetPrice();
+    algoExecution.GetExecutionOrder()->SetArrival(0.5 * (bidPrice + offerPrice), offerPrice - bidPrice,
+                                                  takenOrder.GetQuantity());
+    return algoExecution;
+}
+
+template<typename T>
+void AlgoExecutionService<T>::SetMarketAnalytics(MarketAnalyticsService<T>* _analytics)
+{
+    analytics = _analytics;
+}
+
+template<typename T>
+void AlgoExecutionService<T>::SetStrategyId(uint32_t _strategyId)
+{
+    strategyId = _strategyId;
 }
 
 template<typename T>
@@ -199,6 +252,13 @@ void AlgoExecutionService<T>::AlgoExecuteOrder(OrderBook<T>& orderBook) {
     double offerPrice = offerOrder.GetPrice();
 
     if (offerPrice - bidPrice <= spread) {
+        if (analytics) {
+            const MarketAnalytics<T>* _signals = analytics->GetSignals(GetProductHandle(productId));
+            if (_signals) {
+                LOG(LEVEL_DEBUG, "{} microprice {} imbalance {} vwap {}", productId, _signals->GetMicroprice(),
+                    _signals->GetImbalance(), _signals->GetVwap());
+            }
+        }
         PricingSide _side = DetermineOrderSide();
         double price = (_side == BID) ? bidPrice : offerPrice;
         long quantity = (_side == BID) ? bidOrder.GetQuantity() : offerOrder.GetQuantity();
@@ -255,7 +315,7 @@ MDAlgoListener<T>::~MDAlgoListener() {}
 template<typename T>
 void MDAlgoListener<T>::ProcessAdd(OrderBook<T>& data)
 {
-    //printInYellow("Algo - MarketData listener triggered"); // DEBUG printing
+    LOG(LEVEL_DEBUG, "Algo - MarketData listener triggered for {}", data.GetProduct().GetProductId());
     algo->AlgoExecuteOrder(data);
 }
 
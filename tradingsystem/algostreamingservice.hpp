@@ -15,8 +15,10 @@
 #include <vector>
 #include "soa.hpp"
 #include "utils/utils.hpp"
+#include "utils/probes.hpp"
 #include "streamingservice.hpp"
 #include "pricingservice.hpp"
+#include "curveservice.hpp"
 
 using namespace std;
 
@@ -58,6 +60,14 @@ PriceStream<T>* AlgoStream<T>::GetPriceStream() const
     return priceStream;
 }
 
+// Heap owned by an algo stream: the price stream it points to
+template<typename T>
+size_t HeapBytes(const AlgoStream<T>& _algo)
+{
+    const PriceStream<T>* _stream = _algo.GetPriceStream();
+    return _stream ? sizeof(*_stream) + HeapBytes(*_stream) : 0;
+}
+
 
 // Forward declaration
 template<typename T>
@@ -90,28 +100,43 @@ public:
     // Additional methods
     void PublishPrice(Price<T>& price);
 
+    // Read the yield curve, whose pricing listener must run first; the fair value is only logged
+    void SetCurveService(CurveService<T>* _curveService);
+
+    // Memory held by the service
+    ServiceMemoryStats MemoryStats() const;
+
 private:
-    unordered_map<string, AlgoStream<T>> as; ///< Storage for AlgoStreams
+    CountingResource memory;                      ///< Tagged allocator of the store
+    pmr::unordered_map<string, AlgoStream<T>> as; ///< Storage for AlgoStreams
     vector<ServiceListener<AlgoStream<T>>*> listeners; ///< Listeners for AlgoStream updates
     ServiceListener<Price<T>>* priceListener; ///< Listener for Price updates
     long count; ///< Counter for managing algo stream updates
+    CurveService<T>* curveService; ///< Yield curve, optional
 
 };
 // **********************************************************************************
 //                  Implementation of AlgoStreamingService...
 // **********************************************************************************
 template<typename T>
-AlgoStreamingService<T>::AlgoStreamingService()
+AlgoStreamingService<T>::AlgoStreamingService() :
+        as(&memory)
 {
-    as = unordered_map<string, AlgoStream<T>>();
     listeners = vector<ServiceListener<AlgoStream<T>>*>();
     priceListener = new PricingASListener<T>(this);
     count = 0;
+    curveService = nullptr;
 }
 
 template<typename T>
 AlgoStreamingService<T>::~AlgoStreamingService() {}
 
+template<typename T>
+ServiceMemoryStats AlgoStreamingService<T>::MemoryStats() const
+{
+    return CollectMemoryStats("AlgoStreamingService", memory, as);
+}
+
 template<typename T>
 void AlgoStreamingService<T>::AddListener(ServiceListener<AlgoStream<T>>* listener)
 {
@@ -143,6 +168,8 @@ AlgoStream<T>& AlgoStreamingService<T>::GetData(std::string key){
 
 template<typename T>
 void AlgoStreamingService<T>::OnMessage(AlgoStream<T> &data) {
+    TraceSpan _span("AlgoStreamingService::OnMessage");
+    ServiceProbe _probe(PROBE_ALGO_STREAM, data.GetPriceStream()->GetProduct());
     std::string productId = data.GetPriceStream()->GetProduct().GetProductId();
 
     auto it = as.find(productId);
@@ -158,6 +185,12 @@ void AlgoStreamingService<T>::OnMessage(AlgoStream<T> &data) {
     }
 }
 
+template<typename T>
+void AlgoStreamingService<T>::SetCurveService(CurveService<T>* _curveService)
+{
+    curveService = _curveService;
+}
+
 template<typename T>
 void AlgoStreamingService<T>::PublishPrice(Price<T> & price) {
     T product = price.GetProduct();
@@ -170,6 +203,13 @@ void AlgoStreamingService<T>::PublishPrice(Price<T> & price) {
     long visibleQuantity = (count % 2 + 1) * 10000000; // alternating
     long hiddenQuantity = visibleQuantity * 2; // double the visible
 
+    // the curve snapshot costs an atomic load and a reference count, only pay for it when logged
+    if (curveService && GetLogger().Enabled(LEVEL_DEBUG)) {
+        shared_ptr<const YieldCurve> _curve = curveService->GetCurve();
+        LOG(LEVEL_DEBUG, "{} mid {} curve v{} fair value {}", product.GetProductId(), mid, _curve->GetVersion(),
+            _curve->FairPrice(product));
+    }
+
     count++;
     PriceStreamOrder bidOrder(bidPrice, visibleQuantity, hiddenQuantity, BID);
     PriceStreamOrder offerOrder(offerPrice, visibleQuantity, hiddenQuantity, OFFER);
@@ -219,7 +259,8 @@ PricingASListener<T>::~PricingASListener() {}
 template<typename T>
 void PricingASListener<T>::ProcessAdd(Price<T>& _data)
 {
-    //printInYellow("AlgoStream - Pricer listener triggered");
+    TraceSpan _span("PricingASListener::ProcessAdd");
+    LOG(LEVEL_DEBUG, "AlgoStream - Pricer listener triggered for {}", _data.GetProduct().GetProductId());
     algostrm->PublishPrice(_data);
 }
 
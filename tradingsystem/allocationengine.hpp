@@ -0,0 +1,226 @@
+/**
+ * @file allocationengine.hpp
+ * @brief Defines the rules allocating execution fills to trading books.
+ *
+ * This file includes the definition of AllocationEngine, which compiles allocation rules by
+ * product, by strategy and by pro-rata targets into a flat table read on the booking path.
+ *
+ * @author Niccolo Fabbri
+ */
+#ifndef ALLOCATION_ENGINE_HPP
+#define ALLOCATION_ENGINE_HPP
+
+#include <array>
+#include <deque>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "utils/utils.hpp"
+
+using namespace std;
+
+/**
+ * @class AllocationEngine
+ * @brief Assigns each fill to a book from rules compiled into a [product][strategy] table.
+ *
+ * A rule targets one book or several books with integer pro-rata weights, and applies to a
+ * product, a strategy, both, or everything. The most specific rule wins: product and strategy,
+ * then strategy, then product, then the default. Compile resolves every (product handle,
+ * strategy) cell to its rule once, and expands each rule to a cycle of book ids spreading the
+ * books by weight (smooth weighted round robin), so Allocate is a table lookup and a cursor
+ * step. Cells resolved to the same rule share its cursor, so a rule spreads all its fills.
+ */
+class AllocationEngine
+{
+public:
+    static constexpr uint32_t STRATEGY_COUNT = 16;       ///< Strategy ids are 0 .. STRATEGY_COUNT - 1
+    static constexpr uint32_t ANY_STRATEGY = STRATEGY_COUNT;
+
+    AllocationEngine();
+
+    // Id of a book, added if new; its name is stored once and viewed for the life of the engine
+    uint32_t AddBook(string_view _book);
+    string_view GetBookName(uint32_t _book) const;
+    size_t GetBookCount() const;
+
+    // Rules; an empty product id or ANY_STRATEGY matches everything
+    void AddRule(const string& _productId, uint32_t _strategyId, const string& _book);
+    void AddProRataRule(const string& _productId, uint32_t _strategyId,
+                        const vector<pair<string, unsigned>>& _targets);
+
+    // Build the decision table; every cell needs a rule
+    void Compile();
+    bool IsCompiled() const;
+
+    // Book of the next fill of a product by a strategy; unknown strategies use ANY_STRATEGY rules
+    uint32_t Allocate(uint32_t _handle, uint32_t _strategyId);
+
+private:
+    struct Rule
+    {
+        uint32_t handle;    ///< INVALID_PRODUCT_HANDLE for any product
+        uint32_t strategy;  ///< ANY_STRATEGY for any strategy
+        vector<pair<uint32_t, unsigned>> targets;
+    };
+
+    struct Cycle
+    {
+        uint32_t offset;  ///< First book id of the cycle in cycleBooks
+        uint32_t length;
+        uint32_t cursor;
+    };
+
+    deque<string> books;                                              ///< Stable storage behind the book name views
+    vector<Rule> rules;
+    vector<Cycle> cycles;                                             ///< One per rule
+    vector<uint32_t> cycleBooks;                                      ///< Book ids of all cycles
+    array<array<uint32_t, STRATEGY_COUNT + 1>, PRODUCT_COUNT> table;  ///< Cycle of each cell, last column for unknown strategies
+    bool compiled;
+
+    static constexpr uint32_t NO_CYCLE = ~0u;
+
+    // Specificity of a rule for a cell, -1 if it does not apply
+    static int Match(const Rule& _rule, uint32_t _handle, uint32_t _strategyId);
+};
+// **********************************************************************************
+//                  Implementation of AllocationEngine...
+// **********************************************************************************
+AllocationEngine::AllocationEngine()
+{
+    compiled = false;
+}
+
+uint32_t AllocationEngine::AddBook(string_view _book)
+{
+    for (uint32_t i = 0; i < books.size(); ++i) {
+        if (books[i] == _book) return i;
+    }
+    books.emplace_back(_book);
+    return static_cast<uint32_t>(books.size() - 1);
+}
+
+string_view AllocationEngine::GetBookName(uint32_t _book) const
+{
+    if (_book >= books.size()) {
+        throw std::runtime_error("Unknown book id " + to_string(_book));
+    }
+    return books[_book];
+}
+
+size_t AllocationEngine::GetBookCount() const
+{
+    return books.size();
+}
+
+void AllocationEngine::AddRule(const string& _productId, uint32_t _strategyId, const string& _book)
+{
+    AddProRataRule(_productId, _strategyId, {{_book, 1}});
+}
+
+void AllocationEngine::AddProRataRule(const string& _productId, uint32_t _strategyId,
+                                      const vector<pair<string, unsigned>>& _targets)
+{
+    Rule _rule;
+    _rule.handle = INVALID_PRODUCT_HANDLE;
+    if (!_productId.empty()) {
+        _rule.handle = GetProductHandle(_productId);
+        if (_rule.handle == INVALID_PRODUCT_HANDLE) {
+            throw std::runtime_error("Unknown product in allocation rule: " + _productId);
+        }
+    }
+    if (_strategyId > ANY_STRATEGY) {
+        throw std::runtime_error("Strategy id out of range in allocation rule: " + to_string(_strategyId));
+    }
+    _rule.strategy = _strategyId;
+    for (const auto& _target : _targets) {
+        if (_target.second == 0) continue;
+        _rule.targets.emplace_back(AddBook(_target.first), _target.second);
+    }
+    if (_rule.targets.empty()) {
+        throw std::runtime_error("Allocation rule without a book");
+    }
+    rules.push_back(_rule);
+    compiled = false;
+}
+
+int AllocationEngine::Match(const Rule& _rule, uint32_t _handle, uint32_t _strategyId)
+{
+    bool _anyProduct = _rule.handle == INVALID_PRODUCT_HANDLE;
+    bool _anyStrategy = _rule.strategy == ANY_STRATEGY;
+    if ((!_anyProduct && _rule.handle != _handle) || (!_anyStrategy && _rule.strategy != _strategyId)) return -1;
+    return (_anyStrategy ? 0 : 2) + (_anyProduct ? 0 : 1);
+}
+
+void AllocationEngine::Compile()
+{
+    cycles.clear();
+    cycleBooks.clear();
+    for (const auto& _rule : rules) {
+        // reduce the weights and spread each book evenly over the cycle
+        unsigned _gcd = 0;
+        for (const auto& _target : _rule.targets) _gcd = gcd(_gcd, _target.second);
+        vector<long> _weights, _credit(_rule.targets.size(), 0);
+        long _total = 0;
+        for (const auto& _target : _rule.targets) {
+            _weights.push_back(_target.second / _gcd);
+            _total += _weights.back();
+        }
+        Cycle _cycle{static_cast<uint32_t>(cycleBooks.size()), static_cast<uint32_t>(_total), 0};
+        for (long n = 0; n < _total; ++n) {
+            size_t _best = 0;
+            for (size_t i = 0; i < _weights.size(); ++i) {
+                _credit[i] += _weights[i];
+                if (_credit[i] > _credit[_best]) _best = i;
+            }
+            _credit[_best] -= _total;
+            cycleBooks.push_back(_rule.targets[_best].first);
+        }
+        cycles.push_back(_cycle);
+    }
+
+    for (uint32_t h = 0; h < PRODUCT_COUNT; ++h) {
+        for (uint32_t s = 0; s <= ANY_STRATEGY; ++s) {
+            int _best = -1;
+            for (size_t r = 0; r < rules.size(); ++r) {
+                // later rules override earlier ones of the same specificity
+                int _score = Match(rules[r], h, s);
+                if (_score >= 0 && (_best < 0 || _score >= Match(rules[_best], h, s))) _best = static_cast<int>(r);
+            }
+            if (_best < 0 && s != ANY_STRATEGY) {
+                throw std::runtime_error("No allocation rule for product " + string(PRODUCT_CUSIPS[h])
+                                         + " and strategy " + to_string(s));
+            }
+            // unknown strategies without a rule for any strategy are rejected by Allocate
+            table[h][s] = _best < 0 ? NO_CYCLE : static_cast<uint32_t>(_best);
+        }
+    }
+    compiled = true;
+}
+
+bool AllocationEngine::IsCompiled() const
+{
+    return compiled;
+}
+
+uint32_t AllocationEngine::Allocate(uint32_t _handle, uint32_t _strategyId)
+{
+    if (!compiled) {
+        throw std::runtime_error("Allocation rules used before Compile");
+    }
+    if (_handle >= PRODUCT_COUNT) {
+        throw std::runtime_error("No allocation for product handle " + to_string(_handle));
+    }
+    uint32_t _rule = table[_handle][_strategyId < STRATEGY_COUNT ? _strategyId : ANY_STRATEGY];
+    if (_rule == NO_CYCLE) {
+        throw std::runtime_error("No allocation rule for strategy " + to_string(_strategyId));
+    }
+    Cycle& _cycle = cycles[_rule];
+    uint32_t _book = cycleBooks[_cycle.offset + _cycle.cursor];
+    if (++_cycle.cursor == _cycle.length) _cycle.cursor = 0;
+    return _book;
+}
+
+#endif //ALLOCATION_ENGINE_HPP
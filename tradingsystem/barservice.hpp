@@ -0,0 +1,474 @@
+/**
+ * @file barservice.hpp
+ * @brief Defines the data types and Service for building OHLCV bars.
+ *
+ * This file includes the definition of Bar, an open/high/low/close bar with traded volume,
+ * and the BarService, which listens to the PricingService and the ExecutionService and
+ * builds 1 second, 1 minute and 5 minute bars per product as ticks arrive.
+ *
+ * @author Niccolo Fabbri
+ */
+
+#ifndef BAR_SERVICE_HPP
+#define BAR_SERVICE_HPP
+
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <vector>
+#include "soa.hpp"
+#include "pricingservice.hpp"
+#include "executionservice.hpp"
+#include "utils/utils.hpp"
+
+using namespace std;
+
+// Bar lengths built by the BarService
+enum BarInterval { BAR_1S, BAR_1M, BAR_5M, BAR_INTERVAL_COUNT };
+
+// Length of each BarInterval in milliseconds and its label
+constexpr long BAR_MILLIS[BAR_INTERVAL_COUNT] = {1000, 60 * 1000, 5 * 60 * 1000};
+constexpr const char* BAR_LABELS[BAR_INTERVAL_COUNT] = {"1s", "1m", "5m"};
+
+/**
+ * @class Bar
+ * @brief Open, high, low and close of the mid price over an interval, with the executed volume.
+ *
+ * @tparam T The product type.
+ */
+template<typename T>
+class Bar
+{
+public:
+    // ctor for a bar opening at _price
+    Bar(const T& _product, BarInterval _interval, long _startMillis, double _price);
+
+    // Getters
+    const T& GetProduct() const;
+    BarInterval GetInterval() const;
+    long GetStartMillis() const;
+    double GetOpen() const;
+    double GetHigh() const;
+    double GetLow() const;
+    double GetClose() const;
+    long GetVolume() const;
+    long GetTicks() const;
+
+    // Start a new interval in place, opening at _price
+    void Reset(long _startMillis, double _price);
+
+    // Apply a price tick
+    void AddPrice(double _price);
+
+    // Apply an execution
+    void AddVolume(long _quantity);
+
+    /**
+     * @brief Formats the bar for the historical data files.
+     * @return vector<string> The formatted data as a vector of strings.
+     */
+    vector<string> HDFormat() const;
+
+private:
+    T product;
+    BarInterval interval;
+    long startMillis;
+    double open;
+    double high;
+    double low;
+    double close;
+    long volume;
+    long ticks;
+};
+// **********************************************************************************
+//                  Implementation of Bar...
+// **********************************************************************************
+template<typename T>
+Bar<T>::Bar(const T& _product, BarInterval _interval, long _startMillis, double _price) :
+        product(_product)
+{
+    interval = _interval;
+    Reset(_startMillis, _price);
+}
+
+template<typename T>
+const T& Bar<T>::GetProduct() const
+{
+    return product;
+}
+
+template<typename T>
+BarInterval Bar<T>::GetInterval() const
+{
+    return interval;
+}
+
+template<typename T>
+long Bar<T>::GetStartMillis() const
+{
+    return startMillis;
+}
+
+template<typename T>
+double Bar<T>::GetOpen() const
+{
+    return open;
+}
+
+template<typename T>
+double Bar<T>::GetHigh() const
+{
+    return high;
+}
+
+template<typename T>
+double Bar<T>::GetLow() const
+{
+    return low;
+}
+
+template<typename T>
+double Bar<T>::GetClose() const
+{
+    return close;
+}
+
+template<typename T>
+long Bar<T>::GetVolume() const
+{
+    return volume;
+}
+
+template<typename T>
+long Bar<T>::GetTicks() const
+{
+    return ticks;
+}
+
+template<typename T>
+void Bar<T>::Reset(long _startMillis, double _price)
+{
+    startMillis = _startMillis;
+    open = high = low = close = _price;
+    volume = 0;
+    ticks = 0;
+}
+
+template<typename T>
+void Bar<T>::AddPrice(double _price)
+{
+    high = max(high, _price);
+    low = min(low, _price);
+    close = _price;
+    ticks++;
+}
+
+template<typename T>
+void Bar<T>::AddVolume(long _quantity)
+{
+    volume += _quantity;
+}
+
+template<typename T>
+vector<string> Bar<T>::HDFormat() const
+{
+    vector<string> formattedOutput;
+    formattedOutput.push_back(product.GetProductId());
+    formattedOutput.push_back(BAR_LABELS[interval]);
+    formattedOutput.push_back(FormatDateTimeWithMillis(startMillis));
+    formattedOutput.push_back(FormatPrice(open));
+    formattedOutput.push_back(FormatPrice(high));
+    formattedOutput.push_back(FormatPrice(low));
+    formattedOutput.push_back(FormatPrice(close));
+    formattedOutput.push_back(std::to_string(volume));
+    formattedOutput.push_back(std::to_string(ticks));
+    return formattedOutput;
+}
+
+
+// Forward declarations
+template<typename T>
+class PricingBarListener;
+template<typename T>
+class ExecutionBarListener;
+
+/**
+ * @class BarService
+ * @brief Service building OHLCV bars per product and interval.
+ *
+ * Bars live in one preallocated slot per product handle and interval, so a tick costs one
+ * bucket comparison and a few updates per interval. A bar is completed by the first tick of a
+ * later interval, or by Flush at the end of the day, and is then sent to the listeners
+ * (e.g. the historical data service) before its slot is reused.
+ *
+ * @tparam T The product type.
+ */
+template<typename T>
+class BarService : public Service<string, Bar<T>>
+{
+public:
+    // Constructor and destructor
+    BarService();
+    ~BarService();
+
+    // Service interface methods, keyed by "<product id>:<interval label>" e.g. "91282CJL6:1m"
+    Bar<T>& GetData(string key);
+    void OnMessage(Bar<T>& data);
+    void AddListener(ServiceListener<Bar<T>>* listener);
+    const vector<ServiceListener<Bar<T>>*>& GetListeners() const;
+    PricingBarListener<T>* GetListener();
+    ExecutionBarListener<T>* GetExecutionListener();
+
+    // In-progress bar of a product by handle, nullptr if no tick was seen yet
+    const Bar<T>* GetBar(uint32_t _handle, BarInterval _interval) const;
+
+    // Apply a mid price tick / an execution to every interval of the product
+    void AddPrice(const T& _product, double _mid);
+    void AddExecution(const T& _product, double _price, long _quantity);
+
+    // Complete every in-progress bar, e.g. at the end of the day
+    void Flush();
+
+    // Memory held by the service
+    ServiceMemoryStats MemoryStats() const;
+
+private:
+    vector<optional<Bar<T>>> bars;                 ///< In-progress bars, [handle][interval]
+    vector<ServiceListener<Bar<T>>*> listeners;    ///< Listeners for completed bars
+    PricingBarListener<T>* pricingListener;        ///< Listener for prices
+    ExecutionBarListener<T>* executionListener;    ///< Listener for executions
+
+    // Slot of the bar of _product covering _nowMillis, completing the previous bar if needed
+    Bar<T>* Roll(const T& _product, BarInterval _interval, long _nowMillis, double _price);
+};
+// **********************************************************************************
+//                  Implementation of BarService...
+// **********************************************************************************
+template<typename T>
+BarService<T>::BarService() :
+        bars(PRODUCT_COUNT * BAR_INTERVAL_COUNT)
+{
+    listeners = vector<ServiceListener<Bar<T>>*>();
+    pricingListener = new PricingBarListener<T>(this);
+    executionListener = new ExecutionBarListener<T>(this);
+}
+
+template<typename T>
+BarService<T>::~BarService() {}
+
+template<typename T>
+Bar<T>& BarService<T>::GetData(string key)
+{
+    size_t _colon = key.find(':');
+    uint32_t _handle = GetProductHandle(string_view(key).substr(0, _colon));
+    if (_handle != INVALID_PRODUCT_HANDLE && _colon != string::npos) {
+        for (int i = 0; i < BAR_INTERVAL_COUNT; ++i) {
+            optional<Bar<T>>& _bar = bars[_handle * BAR_INTERVAL_COUNT + i];
+            if (key.compare(_colon + 1, string::npos, BAR_LABELS[i]) == 0 && _bar) return *_bar;
+        }
+    }
+    throw std::runtime_error("Bar not found for key: " + key);
+}
+
+template<typename T>
+void BarService<T>::OnMessage(Bar<T>& data)
+{
+    TraceSpan _span("BarService::OnMessage");
+    for (auto& lstn : listeners) {
+        lstn->ProcessAdd(data);
+    }
+}
+
+template<typename T>
+void BarService<T>::AddListener(ServiceListener<Bar<T>>* listener)
+{
+    listeners.push_back(listener);
+}
+
+template<typename T>
+const vector<ServiceListener<Bar<T>>*>& BarService<T>::GetListeners() const
+{
+    return listeners;
+}
+
+template<typename T>
+PricingBarListener<T>* BarService<T>::GetListener()
+{
+    return pricingListener;
+}
+
+template<typename T>
+ExecutionBarListener<T>* BarService<T>::GetExecutionListener()
+{
+    return executionListener;
+}
+
+template<typename T>
+const Bar<T>* BarService<T>::GetBar(uint32_t _handle, BarInterval _interval) const
+{
+    if (_handle >= PRODUCT_COUNT) return nullptr;
+    const optional<Bar<T>>& _bar = bars[_handle * BAR_INTERVAL_COUNT + _interval];
+    return _bar ? &*_bar : nullptr;
+}
+
+template<typename T>
+Bar<T>* BarService<T>::Roll(const T& _product, BarInterval _interval, long _nowMillis, double _price)
+{
+    uint32_t _handle = GetProductHandle(_product.GetProductId());
+    if (_handle == INVALID_PRODUCT_HANDLE) return nullptr;
+
+    long _start = _nowMillis - _nowMillis % BAR_MILLIS[_interval];
+    optional<Bar<T>>& _bar = bars[_handle * BAR_INTERVAL_COUNT + _interval];
+    if (!_bar) {
+        _bar.emplace(_product, _interval, _start, _price);
+    } else if (_bar->GetStartMillis() != _start) {
+        // the first tick of a new interval completes the bar, then the slot is reused
+        OnMessage(*_bar);
+        _bar->Reset(_start, _price);
+    }
+    return &*_bar;
+}
+
+template<typename T>
+void BarService<T>::AddPrice(const T& _product, double _mid)
+{
+    long _now = GetCurrentTimeMillis();
+    for (int i = 0; i < BAR_INTERVAL_COUNT; ++i) {
+        Bar<T>* _bar = Roll(_product, static_cast<BarInterval>(i), _now, _mid);
+        if (_bar) _bar->AddPrice(_mid);
+    }
+}
+
+template<typename T>
+void BarService<T>::AddExecution(const T& _product, double _price, long _quantity)
+{
+    long _now = GetCurrentTimeMillis();
+    for (int i = 0; i < BAR_INTERVAL_COUNT; ++i) {
+        // an execution opening a bar seeds its prices, later price ticks move them
+        Bar<T>* _bar = Roll(_product, static_cast<BarInterval>(i), _now, _price);
+        if (_bar) _bar->AddVolume(_quantity);
+    }
+}
+
+template<typename T>
+void BarService<T>::Flush()
+{
+    for (auto& _bar : bars) {
+        if (!_bar) continue;
+        OnMessage(*_bar);
+        _bar.reset();
+    }
+}
+
+template<typename T>
+ServiceMemoryStats BarService<T>::MemoryStats() const
+{
+    ServiceMemoryStats _stats;
+    _stats.service = "BarService";
+    _stats.containerBytes = _stats.peakContainerBytes = bars.capacity() * sizeof(optional<Bar<T>>);
+    for (size_t i = 0; i < bars.size(); ++i) {
+        if (!bars[i]) continue;
+        size_t _payload = HeapBytes(bars[i]->GetProduct());
+        _stats.entries++;
+        _stats.payloadBytes += _payload;
+        _stats.bytesPerProduct[string(PRODUCT_CUSIPS[i / BAR_INTERVAL_COUNT])] += sizeof(optional<Bar<T>>) + _payload;
+    }
+    return _stats;
+}
+
+
+/**
+ * @class PricingBarListener
+ * @brief Listener forwarding mid prices from the PricingService to the BarService.
+ *
+ * @tparam T The product type.
+ */
+template<typename T>
+class PricingBarListener : public ServiceListener<Price<T>>
+{
+public:
+    // Constructor and Destructor
+    PricingBarListener(BarService<T>* service);
+    ~PricingBarListener();
+
+    // Listener interface methods
+    void ProcessAdd(Price<T>& data);
+    void ProcessRemove(Price<T>& data);
+    void ProcessUpdate(Price<T>& data);
+
+private:
+    BarService<T>* barService; ///< Reference to the BarService
+};
+// **********************************************************************************
+//                  Implementation of PricingBarListener...
+// **********************************************************************************
+template<typename T>
+PricingBarListener<T>::PricingBarListener(BarService<T>* service)
+{
+    barService = service;
+}
+
+template<typename T>
+PricingBarListener<T>::~PricingBarListener() {}
+
+template<typename T>
+void PricingBarListener<T>::ProcessAdd(Price<T>& data)
+{
+    barService->AddPrice(data.GetProduct(), data.GetMid());
+}
+
+template<typename T>
+void PricingBarListener<T>::ProcessRemove(Price<T>& data) {}
+
+template<typename T>
+void PricingBarListener<T>::ProcessUpdate(Price<T>& data) {}
+
+
+/**
+ * @class ExecutionBarListener
+ * @brief Listener forwarding executions from the ExecutionService to the BarService.
+ *
+ * @tparam T The product type.
+ */
+template<typename T>
+class ExecutionBarListener : public ServiceListener<ExecutionOrder<T>>
+{
+public:
+    // Constructor and Destructor
+    ExecutionBarListener(BarService<T>* service);
+    ~ExecutionBarListener();
+
+    // Listener interface methods
+    void ProcessAdd(ExecutionOrder<T>& data);
+    void ProcessRemove(ExecutionOrder<T>& data);
+    void ProcessUpdate(ExecutionOrder<T>& data);
+
+private:
+    BarService<T>* barService; ///< Reference to the BarService
+};
+// **********************************************************************************
+//                  Implementation of ExecutionBarListener...
+// **********************************************************************************
+template<typename T>
+ExecutionBarListener<T>::ExecutionBarListener(BarService<T>* service)
+{
+    barService = service;
+}
+
+template<typename T>
+ExecutionBarListener<T>::~ExecutionBarListener() {}
+
+template<typename T>
+void ExecutionBarListener<T>::ProcessAdd(ExecutionOrder<T>& data)
+{
+    barService->AddExecution(data.GetProduct(), data.GetPrice(),
+                             data.GetVisibleQuantity() + data.GetHiddenQuantity());
+}
+
+template<typename T>
+void ExecutionBarListener<T>::ProcessRemove(ExecutionOrder<T>& data) {}
+
+template<typename T>
+void ExecutionBarListener<T>::ProcessUpdate(ExecutionOrder<T>& data) {}
+
+#endif //BAR_SERVICE_HPP
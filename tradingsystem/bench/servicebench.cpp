@@ -0,0 +1,138 @@
+/**
+ * @file servicebench.cpp
+ * @brief Micro-benchmarks of the hot service entry points with hardware counters.
+ *
+ * Each benchmark feeds a pre-built batch of messages to a bare service (no listeners,
+ * no connectors) and reports throughput, ns per message and, when perf_event_open is
+ * permitted, cycles, instructions, L1d/LLC misses and branch misses per message.
+ *
+ * Usage: bond_bench [messages per benchmark] [repetitions]
+ *
+ * @author Niccolo Fabbri
+ */
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+#include <vector>
+#include "../marketdataservice.hpp"
+#include "../positionservice.hpp"
+#include "../tradebookingservice.hpp"
+#include "../utils/perfcounters.hpp"
+#include "../utils/yieldengine.hpp"
+
+using namespace std;
+
+const vector<string> BENCH_CUSIPS = {"91282CJL6", "91282CJK8", "91282CJN2", "91282CJM4",
+                                     "91282CJJ1", "912810TW8", "912810TV0"};
+
+// Run _body(i) for every message, keep the best of _repetitions and print one result row
+template<typename Body>
+void RunBenchmark(const char* _name, size_t _messages, int _repetitions, PerfCounters& _counters, Body _body)
+{
+    // warm-up pass so first-touch allocations and page faults are not measured
+    for (size_t i = 0; i < _messages; ++i) _body(i);
+
+    double _bestNanos = 0;
+    PerfSample _bestSample;
+    for (int r = 0; r < _repetitions; ++r) {
+        auto _begin = chrono::steady_clock::now();
+        _counters.Start();
+        for (size_t i = 0; i < _messages; ++i) _body(i);
+        PerfSample _sample = _counters.Stop();
+        double _nanos = chrono::duration<double, nano>(chrono::steady_clock::now() - _begin).count();
+        if (r == 0 || _nanos < _bestNanos) {
+            _bestNanos = _nanos;
+            _bestSample = _sample;
+        }
+    }
+
+    printf("%-32s %12.0f msg/s %10.1f ns/msg", _name, _messages / (_bestNanos * 1e-9), _bestNanos / _messages);
+    for (int c = 0; c < PERF_COUNTER_COUNT; ++c) {
+        if (_bestSample.available[c]) {
+            printf(" %10.2f %s", static_cast<double>(_bestSample.values[c]) / _messages,
+                   PerfCounters::Name(static_cast<PerfCounter>(c)));
+        }
+    }
+    printf("\n");
+}
+
+// Order books with five levels per side, cycling through the products
+vector<OrderBook<Bond>> MakeOrderBooks(size_t _count)
+{
+    vector<OrderBook<Bond>> _books;
+    _books.reserve(_count);
+    for (size_t i = 0; i < _count; ++i) {
+        Bond _bond = GetBond(BENCH_CUSIPS[i % BENCH_CUSIPS.size()]);
+        double _mid = 99.0 + (i % 256) / 256.0;
+        vector<Order> _bids, _offers;
+        for (int level = 1; level <= 5; ++level) {
+            _bids.emplace_back(_mid - level / 128.0, level * 1000000L, BID);
+            _offers.emplace_back(_mid + level / 128.0, level * 1000000L, OFFER);
+        }
+        _books.emplace_back(_bond, _bids, _offers);
+    }
+    return _books;
+}
+
+// Trades alternating side and cycling through the products and books
+vector<Trade<Bond>> MakeTrades(size_t _count)
+{
+    // literals, so the books outlive the trades viewing them
+    constexpr array<string_view, 3> _books = {"TRSY1", "TRSY2", "TRSY3"};
+    vector<Trade<Bond>> _trades;
+    _trades.reserve(_count);
+    for (size_t i = 0; i < _count; ++i) {
+        Bond _bond = GetBond(BENCH_CUSIPS[i % BENCH_CUSIPS.size()]);
+        _trades.emplace_back(_bond, "T" + to_string(i), 99.5, _books[i % _books.size()],
+                             static_cast<long>((i % 5 + 1) * 1000000), i % 2 == 0 ? BUY : SELL);
+    }
+    return _trades;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t _messages = argc > 1 ? strtoull(argv[1], nullptr, 10) : 100000;
+    int _repetitions = argc > 2 ? atoi(argv[2]) : 5;
+    if (_messages == 0 || _repetitions <= 0) {
+        fprintf(stderr, "usage: %s [messages] [repetitions]\n", argv[0]);
+        return 1;
+    }
+
+    PerfCounters _counters;
+    if (!_counters.AnyAvailable()) {
+        printf("hardware counters unavailable (check perf_event_paranoid), reporting wall-clock only\n");
+    }
+
+    vector<OrderBook<Bond>> _orderBooks = MakeOrderBooks(_messages);
+    MarketDataService<Bond> _marketDataService;
+    RunBenchmark("MarketDataService::OnMessage", _messages, _repetitions, _counters, [&](size_t i) {
+        _marketDataService.OnMessage(_orderBooks[i]);
+    });
+
+    vector<Trade<Bond>> _trades = MakeTrades(_messages);
+    PositionService<Bond> _positionService;
+    RunBenchmark("PositionService::AddTrade", _messages, _repetitions, _counters, [&](size_t i) {
+        _positionService.AddTrade(_trades[i]);
+    });
+
+    // clean prices random-walking by 1/256 per tick, as on the price feed
+    vector<double> _prices(_messages);
+    double _price = 99.0;
+    for (size_t i = 0; i < _messages; ++i) {
+        if (i % PRODUCT_COUNT == 0) _price += ((i / PRODUCT_COUNT) % 3 == 0 ? -1.0 : 1.0) / 256.0;
+        _prices[i] = _price;
+    }
+    YieldEngine _yieldEngine;
+    double _yields[PRODUCT_COUNT];
+    RunBenchmark("YieldEngine::PriceToYield", _messages, _repetitions, _counters, [&](size_t i) {
+        _yields[i % PRODUCT_COUNT] = _yieldEngine.PriceToYield(i % PRODUCT_COUNT, _prices[i]);
+    });
+    // one message is a whole curve of PRODUCT_COUNT bonds
+    RunBenchmark("YieldEngine::PriceToYield batch", _messages / PRODUCT_COUNT, _repetitions, _counters, [&](size_t i) {
+        _yieldEngine.PriceToYield(&_prices[i * PRODUCT_COUNT], _yields);
+    });
+
+    return 0;
+}
@@ -0,0 +1,388 @@
+/**
+ * @file curveservice.hpp
+ * @brief Defines the data types and Service for the on-the-run Treasury yield curve.
+ *
+ * This file includes the definition of YieldCurve, an immutable snapshot of a natural cubic
+ * spline through the yields of the on-the-run bonds, and the CurveService, which listens to
+ * the PricingService and refits the spline on every tick.
+ *
+ * @author Niccolo Fabbri
+ */
+
+#ifndef CURVE_SERVICE_HPP
+#define CURVE_SERVICE_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include "soa.hpp"
+#include "pricingservice.hpp"
+#include "utils/utils.hpp"
+#include "utils/yieldengine.hpp"
+
+using namespace std;
+
+/**
+ * @class YieldCurve
+ * @brief Snapshot of the yield curve, as a natural cubic spline in years to maturity.
+ *
+ * A snapshot never changes once published; the CurveService publishes a new one with a
+ * higher version on every tick. Yields are flat beyond the first and last knots.
+ */
+class YieldCurve
+{
+public:
+    static constexpr size_t KNOTS = PRODUCT_COUNT;
+
+    YieldCurve(long _version, const date& _settlement, const array<double, KNOTS>& _times,
+               const array<double, KNOTS>& _yields, const array<double, KNOTS>& _curvatures);
+
+    // Natural spline through the yields at the knot times, solved from scratch
+    static YieldCurve Fit(long _version, const date& _settlement, const array<double, KNOTS>& _times,
+                          const array<double, KNOTS>& _yields);
+
+    // Version of the snapshot, increasing with every refit
+    long GetVersion() const;
+
+    // Settlement date of the yields
+    const date& GetSettlementDate() const;
+
+    // Yield interpolated at a time to maturity in years / at a maturity date
+    double GetYield(double _years) const;
+    double GetYield(const date& _maturity) const;
+
+    // Clean price of any bond, e.g. off the run, discounted at the curve yield for its maturity
+    double FairPrice(const Bond& _bond) const;
+
+    // Time in years from the settlement date to a date
+    double YearsTo(const date& _date) const;
+
+private:
+    long version;
+    date settlement;
+    array<double, KNOTS> times;       ///< Knot times in years, increasing
+    array<double, KNOTS> yields;      ///< Yields at the knots
+    array<double, KNOTS> curvatures;  ///< Second derivatives of the spline at the knots
+};
+// **********************************************************************************
+//                  Implementation of YieldCurve...
+// **********************************************************************************
+YieldCurve::YieldCurve(long _version, const date& _settlement, const array<double, KNOTS>& _times,
+                       const array<double, KNOTS>& _yields, const array<double, KNOTS>& _curvatures) :
+        settlement(_settlement), times(_times), yields(_yields), curvatures(_curvatures)
+{
+    version = _version;
+}
+
+YieldCurve YieldCurve::Fit(long _version, const date& _settlement, const array<double, KNOTS>& _times,
+                           const array<double, KNOTS>& _yields)
+{
+    // Thomas algorithm on the curvature system, with zero curvature at both ends
+    array<double, KNOTS> _upper{}, _sweep{}, _curvatures{};
+    for (size_t i = 1; i + 1 < KNOTS; ++i) {
+        double _hLeft = _times[i] - _times[i - 1];
+        double _hRight = _times[i + 1] - _times[i];
+        double _rhs = 6.0 * ((_yields[i + 1] - _yields[i]) / _hRight - (_yields[i] - _yields[i - 1]) / _hLeft);
+        double _pivot = 2.0 * (_hLeft + _hRight) - _hLeft * _upper[i - 1];
+        _upper[i] = _hRight / _pivot;
+        _sweep[i] = (_rhs - _hLeft * _sweep[i - 1]) / _pivot;
+    }
+    for (size_t i = KNOTS - 2; i >= 1; --i) {
+        _curvatures[i] = _sweep[i] - _upper[i] * _curvatures[i + 1];
+    }
+    return YieldCurve(_version, _settlement, _times, _yields, _curvatures);
+}
+
+long YieldCurve::GetVersion() const
+{
+    return version;
+}
+
+const date& YieldCurve::GetSettlementDate() const
+{
+    return settlement;
+}
+
+double YieldCurve::YearsTo(const date& _date) const
+{
+    return static_cast<double>((_date - settlement).days()) / 365.25;
+}
+
+double YieldCurve::GetYield(double _years) const
+{
+    if (_years <= times.front()) return yields.front();
+    if (_years >= times.back()) return yields.back();
+
+    size_t i = upper_bound(times.begin(), times.end(), _years) - times.begin() - 1;
+    double _h = times[i + 1] - times[i];
+    double _left = times[i + 1] - _years;
+    double _right = _years - times[i];
+    return (curvatures[i] * _left * _left * _left + curvatures[i + 1] * _right * _right * _right) / (6.0 * _h)
+           + (yields[i] / _h - curvatures[i] * _h / 6.0) * _left
+           + (yields[i + 1] / _h - curvatures[i + 1] * _h / 6.0) * _right;
+}
+
+double YieldCurve::GetYield(const date& _maturity) const
+{
+    return GetYield(YearsTo(_maturity));
+}
+
+double YieldCurve::FairPrice(const Bond& _bond) const
+{
+    return BondSchedule::Of(_bond, settlement).CleanPrice(GetYield(_bond.GetMaturityDate()));
+}
+
+
+// Forward declaration
+template<typename T>
+class PricingCurveListener;
+
+/**
+ * @class CurveService
+ * @brief Service fitting the on-the-run yield curve from the prices of the benchmark bonds.
+ *
+ * The knots are the maturities of the bonds, which only change with the settlement date, so the
+ * tridiagonal system of the spline curvatures is factored once (Thomas algorithm). A tick of one
+ * bond changes at most three right-hand sides; the forward sweep restarts at the first of them
+ * and a back substitution gives the new curvatures. Readers take the current snapshot with
+ * GetCurve(), which stays valid while they hold it.
+ *
+ * Register its listener on the PricingService before the services that read the curve.
+ *
+ * @tparam T The product type.
+ */
+template<typename T>
+class CurveService : public Service<string, YieldCurve>
+{
+public:
+    static constexpr size_t KNOTS = YieldCurve::KNOTS;
+
+    // Constructor and destructor
+    CurveService();
+    ~CurveService();
+
+    // Service interface methods, keyed by any string: there is one curve. GetData returns a
+    // copy of the current snapshot owned by the calling thread, valid until its next GetData
+    YieldCurve& GetData(string key);
+    void OnMessage(YieldCurve& data);
+    void AddListener(ServiceListener<YieldCurve>* listener);
+    const vector<ServiceListener<YieldCurve>*>& GetListeners() const;
+    PricingCurveListener<T>* GetListener();
+
+    // Current snapshot of the curve
+    shared_ptr<const YieldCurve> GetCurve() const;
+
+    // Refit the curve for a new clean price of a benchmark bond
+    void OnPrice(const T& _product, double _cleanPrice);
+
+    // Memory held by the service
+    ServiceMemoryStats MemoryStats() const;
+
+private:
+    array<uint32_t, KNOTS> knotOf;       ///< Knot index of each product handle
+    array<double, KNOTS> times;          ///< Knot times in years
+    array<double, KNOTS> yields;         ///< Latest yield of each knot
+    array<double, KNOTS> lower;          ///< Sub-diagonal of the curvature system
+    array<double, KNOTS> upperFactor;    ///< Super-diagonal divided by the pivot, from the factorization
+    array<double, KNOTS> pivotInverse;   ///< Inverse pivots, from the factorization
+    array<double, KNOTS> sweep;          ///< Forward sweep of the right-hand side
+    long version;
+    atomic<shared_ptr<YieldCurve>> curve;
+    vector<ServiceListener<YieldCurve>*> listeners; ///< Listeners for new curves
+    PricingCurveListener<T>* pricingListener;      ///< Listener for prices
+
+    // Right-hand side of row i of the curvature system
+    double RightHandSide(size_t i) const;
+
+    // Solve for the curvatures, restarting the forward sweep at row _from, and publish a snapshot
+    void Refit(size_t _from);
+};
+// **********************************************************************************
+//                  Implementation of CurveService...
+// **********************************************************************************
+template<typename T>
+CurveService<T>::CurveService()
+{
+    listeners = vector<ServiceListener<YieldCurve>*>();
+    pricingListener = new PricingCurveListener<T>(this);
+    version = 0;
+
+    // knots ordered by maturity, starting at the coupon yields until the first prices arrive
+    const date& _settlement = GetYieldEngine().GetSettlementDate();
+    vector<Bond> _bonds;
+    array<uint32_t, KNOTS> _order;
+    for (uint32_t i = 0; i < KNOTS; ++i) {
+        _bonds.push_back(GetBond(string(PRODUCT_CUSIPS[i])));
+        _order[i] = i;
+    }
+    sort(_order.begin(), _order.end(), [&_bonds](uint32_t a, uint32_t b) {
+        return _bonds[a].GetMaturityDate() < _bonds[b].GetMaturityDate();
+    });
+    for (uint32_t k = 0; k < KNOTS; ++k) {
+        const Bond& _bond = _bonds[_order[k]];
+        knotOf[_order[k]] = k;
+        times[k] = static_cast<double>((_bond.GetMaturityDate() - _settlement).days()) / 365.25;
+        yields[k] = _bond.GetCoupon();
+    }
+
+    // factor the system h[i-1] M[i-1] + 2 (h[i-1] + h[i]) M[i] + h[i] M[i+1] = r[i], with M = 0 at both ends
+    lower.fill(0);
+    upperFactor.fill(0);
+    pivotInverse.fill(1);
+    for (size_t i = 1; i + 1 < KNOTS; ++i) {
+        double _hLeft = times[i] - times[i - 1];
+        double _hRight = times[i + 1] - times[i];
+        lower[i] = _hLeft;
+        double _pivot = 2.0 * (_hLeft + _hRight) - _hLeft * upperFactor[i - 1];
+        pivotInverse[i] = 1.0 / _pivot;
+        upperFactor[i] = _hRight * pivotInverse[i];
+    }
+    sweep.fill(0);
+    Refit(1);
+}
+
+template<typename T>
+CurveService<T>::~CurveService() {}
+
+template<typename T>
+YieldCurve& CurveService<T>::GetData(string key)
+{
+    // the snapshot itself may be freed by the next refit, so hand out a copy
+    thread_local optional<YieldCurve> _copy;
+    _copy.emplace(*curve.load(memory_order_acquire));
+    return *_copy;
+}
+
+template<typename T>
+void CurveService<T>::OnMessage(YieldCurve& data)
+{
+    TraceSpan _span("CurveService::OnMessage");
+    for (auto& lstn : listeners) {
+        lstn->ProcessAdd(data);
+    }
+}
+
+template<typename T>
+void CurveService<T>::AddListener(ServiceListener<YieldCurve>* listener)
+{
+    listeners.push_back(listener);
+}
+
+template<typename T>
+const vector<ServiceListener<YieldCurve>*>& CurveService<T>::GetListeners() const
+{
+    return listeners;
+}
+
+template<typename T>
+PricingCurveListener<T>* CurveService<T>::GetListener()
+{
+    return pricingListener;
+}
+
+template<typename T>
+shared_ptr<const YieldCurve> CurveService<T>::GetCurve() const
+{
+    return curve.load(memory_order_acquire);
+}
+
+template<typename T>
+double CurveService<T>::RightHandSide(size_t i) const
+{
+    return 6.0 * ((yields[i + 1] - yields[i]) / (times[i + 1] - times[i])
+                  - (yields[i] - yields[i - 1]) / (times[i] - times[i - 1]));
+}
+
+template<typename T>
+void CurveService<T>::Refit(size_t _from)
+{
+    // rows before _from kept their right-hand sides, so their forward sweep is unchanged
+    for (size_t i = max<size_t>(_from, 1); i + 1 < KNOTS; ++i) {
+        sweep[i] = (RightHandSide(i) - lower[i] * sweep[i - 1]) * pivotInverse[i];
+    }
+    array<double, KNOTS> _curvatures{};
+    for (size_t i = KNOTS - 2; i >= 1; --i) {
+        _curvatures[i] = sweep[i] - upperFactor[i] * _curvatures[i + 1];
+    }
+
+    auto _snapshot = make_shared<YieldCurve>(++version, GetYieldEngine().GetSettlementDate(), times, yields,
+                                             _curvatures);
+    curve.store(_snapshot, memory_order_release);
+    OnMessage(*_snapshot);
+}
+
+template<typename T>
+void CurveService<T>::OnPrice(const T& _product, double _cleanPrice)
+{
+    uint32_t _handle = GetProductHandle(_product.GetProductId());
+    if (_handle == INVALID_PRODUCT_HANDLE) return;
+
+    size_t _knot = knotOf[_handle];
+    yields[_knot] = GetYieldEngine().PriceToYield(_handle, _cleanPrice);
+    // the yield of knot k enters the right-hand sides of rows k-1, k and k+1
+    Refit(_knot == 0 ? 1 : _knot - 1);
+}
+
+template<typename T>
+ServiceMemoryStats CurveService<T>::MemoryStats() const
+{
+    ServiceMemoryStats _stats;
+    _stats.service = "CurveService";
+    _stats.entries = 1;
+    _stats.containerBytes = _stats.peakContainerBytes = sizeof(YieldCurve);
+    return _stats;
+}
+
+
+/**
+ * @class PricingCurveListener
+ * @brief Listener forwarding prices from the PricingService to the CurveService.
+ *
+ * @tparam T The product type.
+ */
+template<typename T>
+class PricingCurveListener : public ServiceListener<Price<T>>
+{
+public:
+    // Constructor and Destructor
+    PricingCurveListener(CurveService<T>* service);
+    ~PricingCurveListener();
+
+    // Listener interface methods
+    void ProcessAdd(Price<T>& data);
+    void ProcessRemove(Price<T>& data);
+    void ProcessUpdate(Price<T>& data);
+
+private:
+    CurveService<T>* curveService; ///< Reference to the CurveService
+};
+// **********************************************************************************
+//                  Implementation of PricingCurveListener...
+// **********************************************************************************
+template<typename T>
+PricingCurveListener<T>::PricingCurveListener(CurveService<T>* service)
+{
+    curveService = service;
+}
+
+template<typename T>
+PricingCurveListener<T>::~PricingCurveListener() {}
+
+template<typename T>
+void PricingCurveListener<T>::ProcessAdd(Price<T>& data)
+{
+    TraceSpan _span("PricingCurveListener::ProcessAdd");
+    curveService->OnPrice(data.GetProduct(), data.GetMid());
+}
+
+template<typename T>
+void PricingCurveListener<T>::ProcessRemove(Price<T>& data) {}
+
+template<typename T>
+void PricingCurveListener<T>::ProcessUpdate(Price<T>& data) {}
+
+#endif //CURVE_SERVICE_HPP
@@ -10,14 +10,36 @@
 #ifndef EXECUTION_SERVICE_HPP
 #define EXECUTION_SERVICE_HPP
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
 #include "soa.hpp"
 #include "marketdataservice.hpp"
+#include "utils/probes.hpp"
+#include "utils/ratelimiter.hpp"
 
 
 enum OrderType { FOK, IOC, MARKET, LIMIT, STOP };
 
 enum Market { BROKERTEC, ESPEED, CME };
+constexpr size_t MARKET_COUNT = 3;
+constexpr string_view MARKET_NAMES[MARKET_COUNT] = {"BROKERTEC", "ESPEED", "CME"};
+
+// What ExecuteOrder does with an order over a venue rate limit
+enum ThrottlePolicy { THROTTLE_REJECT, THROTTLE_QUEUE };
+
+// Counters of the rate limiting of a venue
+struct ThrottleStats
+{
+    long sent = 0;            ///< Orders sent, immediately or after queueing
+    long queued = 0;          ///< Orders held back until a token was available
+    long rejected = 0;        ///< Orders dropped by the limits
+    int64_t maxDelayNanos = 0; ///< Longest wait of a queued order
+};
 
 /**
  * @class ExecutionOrder
@@ -33,7 +55,7 @@ class ExecutionOrder
 {
 public:
     // Constructor for an execution order
-    ExecutionOrder(const T &_product, PricingSide _side, string _orderId, OrderType _orderType, double _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId, bool _isChildOrder);
+    ExecutionOrder(const T &_product, PricingSide _side, string _orderId, OrderType _orderType, double _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId, bool _isChildOrder, uint32_t _strategyId = 0);
 
     // Getters
     const T& GetProduct() const;
@@ -45,6 +67,19 @@ public:
     PricingSide GetPricingSide() const;
     const string& GetParentOrderId() const;
     bool IsChildOrder() const;
+    uint32_t GetStrategyId() const;
+    Market GetVenue() const;
+
+    // Venue the order is sent to, set by the ExecutionService
+    void SetVenue(Market _venue);
+
+    // Market when the order was created (mid, spread and quantity at the touch it takes),
+    // against which its cost is measured however late it is sent
+    void SetArrival(double _mid, double _spread, long _touchQuantity);
+    bool HasArrival() const;
+    double GetArrivalMid() const;
+    double GetArrivalSpread() const;
+    long GetTouchQuantity() const;
 
     // Formatted output for historical data
     vector<string> HDFormat() const;
@@ -59,6 +94,12 @@ private:
     double hiddenQuantity;
     string parentOrderId;
     bool isChildOrder;
+    uint32_t strategyId; ///< Strategy that sent the order, used to allocate its fills
+    Market venue;
+    bool hasArrival;
+    double arrivalMid;
+    double arrivalSpread;
+    long touchQuantity;
 };
 // **********************************************************************************
 //                  Implementation of ExecutionOrder...
@@ -90,7 +131,7 @@ vector<string> ExecutionOrder<T>::HDFormat() const {
 }
 
 template<typename T>
-ExecutionOrder<T>::ExecutionOrder(const T &_product, PricingSide _side, string _orderId, OrderType _orderType, double _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId, bool _isChildOrder) :
+ExecutionOrder<T>::ExecutionOrder(const T &_product, PricingSide _side, string _orderId, OrderType _orderType, double _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId, bool _isChildOrder, uint32_t _strategyId) :
         product(_product)
 {
     side = _side;
@@ -101,6 +142,12 @@ ExecutionOrder<T>::ExecutionOrder(const T &_product, PricingSide _side, string _
     hiddenQuantity = _hiddenQuantity;
     parentOrderId = _parentOrderId;
     isChildOrder = _isChildOrder;
+    strategyId = _strategyId;
+    venue = CME;
+    hasArrival = false;
+    arrivalMid = 0;
+    arrivalSpread = 0;
+    touchQuantity = 0;
 }
 
 template<typename T>
@@ -154,12 +201,72 @@ bool ExecutionOrder<T>::IsChildOrder() const
     return isChildOrder;
 }
 
+template<typename T>
+uint32_t ExecutionOrder<T>::GetStrategyId() const
+{
+    return strategyId;
+}
+
+template<typename T>
+Market ExecutionOrder<T>::GetVenue() const
+{
+    return venue;
+}
+
+template<typename T>
+void ExecutionOrder<T>::SetVenue(Market _venue)
+{
+    venue = _venue;
+}
+
+template<typename T>
+void ExecutionOrder<T>::SetArrival(double _mid, double _spread, long _touchQuantity)
+{
+    hasArrival = true;
+    arrivalMid = _mid;
+    arrivalSpread = _spread;
+    touchQuantity = _touchQuantity;
+}
+
+template<typename T>
+bool ExecutionOrder<T>::HasArrival() const
+{
+    return hasArrival;
+}
+
+template<typename T>
+double ExecutionOrder<T>::GetArrivalMid() const
+{
+    return arrivalMid;
+}
+
+template<typename T>
+double ExecutionOrder<T>::GetArrivalSpread() const
+{
+    return arrivalSpread;
+}
+
+template<typename T>
+long ExecutionOrder<T>::GetTouchQuantity() const
+{
+    return touchQuantity;
+}
+
+// Heap owned by an execution order: its product and order IDs
+template<typename T>
+size_t HeapBytes(const ExecutionOrder<T>& _order)
+{
+    return HeapBytes(_order.GetProduct()) + HeapBytes(_order.GetOrderId()) + HeapBytes(_order.GetParentOrderId());
+}
+
 
 // Forward declarations
 template<typename T>
 class AlgoExecution;
 template<typename T>
 class AlgoExeExecutionListener;
+template<typename T>
+class MarketDataReleaseListener;
 /**
  * @class ExecutionService
  * @brief Service for executing orders on an exchange.
@@ -167,6 +274,11 @@ class AlgoExeExecutionListener;
  * This service manages execution orders for financial products. It processes orders, sends them to the market,
  * and notifies listeners of any updates.
  *
+ * ExecuteOrder, ReleaseQueued and FlushQueued may be called from several strategy threads.
+ * Admission only touches the lock-free rate limiters and atomic counters; the queue of held
+ * orders has its own lock, and sending takes the store lock, so the order store and the
+ * listeners see one order at a time.
+ *
  * @tparam T The type of the financial product.
  */
 template<typename T>
@@ -183,29 +295,76 @@ public:
     void AddListener(ServiceListener<ExecutionOrder<T>>* listener);
     const vector<ServiceListener<ExecutionOrder<T>>*>& GetListeners() const;
     AlgoExeExecutionListener<T>* GetListener();
+    // Listener releasing the queued orders that are due on every order book
+    MarketDataReleaseListener<T>* GetReleaseListener();
 
-    // Execution method
+    // Execution method; the order goes through the rate limits of the venue first
     void ExecuteOrder(ExecutionOrder<T>& order, Market market);
 
+    // Rate limits of a venue, overall and for each product, in messages per second; 0 for none
+    void SetRateLimit(Market market, double perSecond, double burst);
+    void SetProductRateLimit(Market market, double perSecond, double burst);
+
+    // Queue orders over the limits for at most maxQueueNanos, or reject them
+    void SetThrottlePolicy(Market market, ThrottlePolicy policy, int64_t maxQueueNanos = 1000000000);
+    ThrottleStats GetThrottleStats(Market market) const;
+
+    // Send the queued orders whose time has come, or wait for each queued order's time and send it
+    void ReleaseQueued();
+    void FlushQueued();
+
+    // Memory held by the service
+    ServiceMemoryStats MemoryStats() const;
+
 private:
-    unordered_map<string, ExecutionOrder<T>> exeOrd;  ///< Execution orders storage
+    CountingResource memory;                               ///< Tagged allocator of the store
+    pmr::unordered_map<string, ExecutionOrder<T>> exeOrd;  ///< Execution orders storage
     vector<ServiceListener<ExecutionOrder<T>>*> listeners; ///< Listeners for order updates
     AlgoExeExecutionListener<T>* algoExeListener;     ///< Listener for algorithmic execution events
+    MarketDataReleaseListener<T>* releaseListener;    ///< Listener releasing due orders on market data
+
+    /// Limits and counters of a venue; the limiters are lock-free, the queue is the slow path
+    struct VenueThrottle
+    {
+        RateLimiter venue;
+        array<RateLimiter, PRODUCT_COUNT> products;
+        ThrottlePolicy policy = THROTTLE_QUEUE;
+        int64_t maxQueueNanos = 1000000000;
+        atomic<long> sent{0};
+        atomic<long> queued{0};
+        atomic<long> rejected{0};
+        atomic<int64_t> maxDelayNanos{0};
+    };
+    array<VenueThrottle, MARKET_COUNT> throttles;
+    mutex queueMutex;                                           ///< Guards pending
+    mutex storeMutex;                                           ///< Serializes the order store and the listeners
+    multimap<int64_t, pair<ExecutionOrder<T>, Market>> pending; ///< Queued orders by release time
+
+    // Admit an order under the limits: the delay before it may go, or -1 to drop it
+    int64_t Admit(const ExecutionOrder<T>& order, Market market, int64_t now);
+    void Send(ExecutionOrder<T>& order, Market market);
 };
 // **********************************************************************************
 //                  Implementation of ExecutionService...
 // **********************************************************************************
 template<typename T>
-ExecutionService<T>::ExecutionService()
+ExecutionService<T>::ExecutionService() :
+        exeOrd(&memory)
 {
-    exeOrd = unordered_map<string, ExecutionOrder<T>>();
     listeners = vector<ServiceListener<ExecutionOrder<T>>*>();
     algoExeListener = new AlgoExeExecutionListener<T>(this);
+    releaseListener = new MarketDataReleaseListener<T>(this);
 }
 
 template<typename T>
 ExecutionService<T>::~ExecutionService() {}
 
+template<typename T>
+ServiceMemoryStats ExecutionService<T>::MemoryStats() const
+{
+    return CollectMemoryStats("ExecutionService", memory, exeOrd);
+}
+
 template<typename T>
 void ExecutionService<T>::AddListener(ServiceListener<ExecutionOrder<T>>* listener)
 {
@@ -224,9 +383,16 @@ AlgoExeExecutionListener<T>* ExecutionService<T>::GetListener()
     return algoExeListener;
 }
 
+template<typename T>
+MarketDataReleaseListener<T>* ExecutionService<T>::GetReleaseListener()
+{
+    return releaseListener;
+}
+
 template<typename T>
 ExecutionOrder<T>& ExecutionService<T>::GetData(string key)
 {
+    lock_guard<mutex> _lock(storeMutex);
     auto it = exeOrd.find(key);
     if (it != exeOrd.end()) {
         return it->second;
@@ -239,7 +405,10 @@ ExecutionOrder<T>& ExecutionService<T>::GetData(string key)
 template<typename T>
 void ExecutionService<T>::OnMessage(ExecutionOrder<T>& data)
 {
+    TraceSpan _span("ExecutionService::OnMessage");
+    ServiceProbe _probe(PROBE_EXECUTION_ORDER, data.GetProduct());
     std::string productId = data.GetProduct().GetProductId();
+    lock_guard<mutex> _lock(storeMutex);
 
     auto it = exeOrd.find(productId);
     if (it != exeOrd.end()) {
@@ -255,9 +424,123 @@ void ExecutionService<T>::OnMessage(ExecutionOrder<T>& data)
 }
 
 
+template<typename T>
+void ExecutionService<T>::SetRateLimit(Market market, double perSecond, double burst)
+{
+    throttles[market].venue.SetLimit(perSecond, burst);
+}
+
+template<typename T>
+void ExecutionService<T>::SetProductRateLimit(Market market, double perSecond, double burst)
+{
+    for (auto& _limiter : throttles[market].products) _limiter.SetLimit(perSecond, burst);
+}
+
+template<typename T>
+void ExecutionService<T>::SetThrottlePolicy(Market market, ThrottlePolicy policy, int64_t maxQueueNanos)
+{
+    throttles[market].policy = policy;
+    throttles[market].maxQueueNanos = maxQueueNanos;
+}
+
+template<typename T>
+ThrottleStats ExecutionService<T>::GetThrottleStats(Market market) const
+{
+    const VenueThrottle& _throttle = throttles[market];
+    ThrottleStats _stats;
+    _stats.sent = _throttle.sent.load(memory_order_relaxed);
+    _stats.queued = _throttle.queued.load(memory_order_relaxed);
+    _stats.rejected = _throttle.rejected.load(memory_order_relaxed);
+    _stats.maxDelayNanos = _throttle.maxDelayNanos.load(memory_order_relaxed);
+    return _stats;
+}
+
+template<typename T>
+int64_t ExecutionService<T>::Admit(const ExecutionOrder<T>& order, Market market, int64_t now)
+{
+    VenueThrottle& _throttle = throttles[market];
+    uint32_t _handle = GetProductHandle(order.GetProduct().GetProductId());
+    RateLimiter* _product = _handle < PRODUCT_COUNT ? &_throttle.products[_handle] : nullptr;
+
+    // the product token first, given back if the venue refuses
+    if (_throttle.policy == THROTTLE_REJECT) {
+        if (_product && _product->TryAcquire(now) != 0) return -1;
+        if (_throttle.venue.TryAcquire(now) != 0) {
+            if (_product) _product->Release();
+            return -1;
+        }
+        return 0;
+    }
+    int64_t _productDelay = _product ? _product->Reserve(now, _throttle.maxQueueNanos) : 0;
+    if (_productDelay < 0) return -1;
+    int64_t _venueDelay = _throttle.venue.Reserve(now, _throttle.maxQueueNanos);
+    if (_venueDelay < 0) {
+        if (_product) _product->Release();
+        return -1;
+    }
+    return max(_productDelay, _venueDelay);
+}
+
 template<typename T>
 void ExecutionService<T>::ExecuteOrder(ExecutionOrder<T>& order, Market market)
 {
+    int64_t _now = Tracer::Now();
+    ReleaseQueued();
+
+    VenueThrottle& _throttle = throttles[market];
+    int64_t _delay = Admit(order, market, _now);
+    if (_delay < 0) {
+        _throttle.rejected.fetch_add(1, memory_order_relaxed);
+        LOG(LEVEL_WARNING, "Order {} on {} rejected by the rate limit of {}", order.GetOrderId(),
+            order.GetProduct().GetProductId(), MARKET_NAMES[market]);
+        return;
+    }
+    if (_delay > 0) {
+        _throttle.queued.fetch_add(1, memory_order_relaxed);
+        int64_t _longest = _throttle.maxDelayNanos.load(memory_order_relaxed);
+        while (_delay > _longest && !_throttle.maxDelayNanos.compare_exchange_weak(_longest, _delay, memory_order_relaxed)) {}
+        lock_guard<mutex> _lock(queueMutex);
+        pending.emplace(_now + _delay, make_pair(order, market));
+        return;
+    }
+    Send(order, market);
+}
+
+template<typename T>
+void ExecutionService<T>::ReleaseQueued()
+{
+    int64_t _now = Tracer::Now();
+    while (true) {
+        unique_lock<mutex> _lock(queueMutex);
+        if (pending.empty() || pending.begin()->first > _now) return;
+        auto _node = pending.extract(pending.begin());
+        _lock.unlock();
+        Send(_node.mapped().first, _node.mapped().second);
+    }
+}
+
+template<typename T>
+void ExecutionService<T>::FlushQueued()
+{
+    // the release times were reserved from the limiters, so waiting for each keeps the rate
+    while (true) {
+        unique_lock<mutex> _lock(queueMutex);
+        if (pending.empty()) return;
+        auto _node = pending.extract(pending.begin());
+        _lock.unlock();
+        int64_t _wait = _node.key() - Tracer::Now();
+        if (_wait > 0) this_thread::sleep_for(chrono::nanoseconds(_wait));
+        Send(_node.mapped().first, _node.mapped().second);
+    }
+}
+
+template<typename T>
+void ExecutionService<T>::Send(ExecutionOrder<T>& order, Market market)
+{
+    throttles[market].sent.fetch_add(1, memory_order_relaxed);
+    order.SetVenue(market);
+    LOG(LEVEL_DEBUG, "Executing order {} on {}: {} {} @ {}", order.GetOrderId(), order.GetProduct().GetProductId(),
+        order.GetPricingSide() == BID ? "BID" : "OFFER", order.GetVisibleQuantity() + order.GetHiddenQuantity(), order.GetPrice());
     OnMessage(order);
 }
 
@@ -306,7 +589,7 @@ AlgoExeExecutionListener<T>::~AlgoExeExecutionListener() {}
 template<typename T>
 void AlgoExeExecutionListener<T>::ProcessAdd(AlgoExecution<T>& data)
 {
-    //printInYellow("Execution order - algo listener triggered");
+    LOG(LEVEL_DEBUG, "Execution order - algo listener triggered");
     ExecutionOrder<T>* ord = data.GetExecutionOrder();
     //eOrder->OnMessage(*ord);
     eOrder->ExecuteOrder(*ord, CME);
@@ -319,6 +602,53 @@ template<typename T>
 void AlgoExeExecutionListener<T>::ProcessUpdate(AlgoExecution<T>& data) {}
 
 
+/**
+ * @class MarketDataReleaseListener
+ * @brief Listener sending the due queued orders of the ExecutionService on every order book.
+ *
+ * The market data feed is the clock of the trading thread: without it, an order held by the
+ * rate limits would wait for the next ExecuteOrder, which may never come.
+ *
+ * @tparam T The type of the financial product.
+ */
+template<typename T>
+class MarketDataReleaseListener : public ServiceListener<OrderBook<T>>
+{
+public:
+    // Constructor and Destructor
+    MarketDataReleaseListener(ExecutionService<T>* service);
+    ~MarketDataReleaseListener();
+
+    // Listener interface methods
+    void ProcessAdd(OrderBook<T>& data);
+    void ProcessRemove(OrderBook<T>& data);
+    void ProcessUpdate(OrderBook<T>& data);
+
+private:
+    ExecutionService<T>* eOrder; ///< Service holding the queued orders
+};
+// **********************************************************************************
+//                  Implementation of MarketDataReleaseListener...
+// **********************************************************************************
+template<typename T>
+MarketDataReleaseListener<T>::MarketDataReleaseListener(ExecutionService<T>* service)
+{
+    eOrder = service;
+}
+
+template<typename T>
+MarketDataReleaseListener<T>::~MarketDataReleaseListener() {}
+
+template<typename T>
+void MarketDataReleaseListener<T>::ProcessAdd(OrderBook<T>& data)
+{
+    eOrder->ReleaseQueued();
+}
 
+template<typename T>
+void MarketDataReleaseListener<T>::ProcessRemove(OrderBook<T>& data) {}
+
+template<typename T>
+void MarketDataReleaseListener<T>::ProcessUpdate(OrderBook<T>& data) {}
 
 #endif
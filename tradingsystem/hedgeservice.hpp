@@ -0,0 +1,427 @@
+/**
+ * @file hedgeservice.hpp
+ * @brief Defines the data types and Service for hedge recommendations on bucketed risk.
+ *
+ * This file includes the definition of HedgeRecommendation, the notionals of the benchmark
+ * on-the-run bonds that flatten the hedge buckets of the firm, and the HedgeService, which
+ * listens to the RiskService and updates the recommendation on every risk change.
+ *
+ * @author Niccolo Fabbri
+ */
+
+#ifndef HEDGE_SERVICE_HPP
+#define HEDGE_SERVICE_HPP
+
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "soa.hpp"
+#include "riskservice.hpp"
+#include "utils/utils.hpp"
+
+using namespace std;
+
+// Hedge buckets and their hedge bonds: the 2Y, 5Y, 10Y and 30Y on-the-runs. Product handles are in
+// maturity order, so the on-the-run of key-rate pillar k is handle k.
+constexpr size_t HEDGE_BUCKETS = 4;
+constexpr array<uint32_t, HEDGE_BUCKETS> HEDGE_HANDLES = {0, 2, 4, 6};
+
+// Hedge bucket of each key-rate pillar: 2Y and 3Y, 5Y and 7Y, 10Y, 20Y and 30Y
+constexpr array<size_t, KEY_RATE_PILLARS> HEDGE_BUCKET_OF = {0, 0, 1, 1, 2, 3, 3};
+static_assert(KEY_RATE_PILLARS == PRODUCT_COUNT, "the on-the-run of each pillar is a product");
+
+/**
+ * @class HedgeRecommendation
+ * @brief Key-rate PV01s of the firm and the benchmark notionals that flatten its hedge buckets.
+ */
+class HedgeRecommendation
+{
+public:
+    HedgeRecommendation();
+
+    // Version of the recommendation, increasing with every risk change
+    long GetVersion() const;
+
+    // PV01 of a key-rate bucket before hedging
+    double GetBucketPV01(size_t _pillar) const;
+
+    // Face amount of a bond to trade, by product handle: positive buys, negative sells, zero
+    // for bonds that are not hedge bonds
+    double GetNotional(uint32_t _handle) const;
+
+    // Formats the recommendation for the GUI file
+    vector<string> GuiOut() const;
+
+private:
+    long version;
+    array<double, KEY_RATE_PILLARS> bucketPV01;
+    array<double, PRODUCT_COUNT> notionals;
+
+    template<typename T>
+    friend class HedgeService;
+};
+// **********************************************************************************
+//                  Implementation of HedgeRecommendation...
+// **********************************************************************************
+HedgeRecommendation::HedgeRecommendation()
+{
+    version = 0;
+    bucketPV01.fill(0);
+    notionals.fill(0);
+}
+
+long HedgeRecommendation::GetVersion() const
+{
+    return version;
+}
+
+double HedgeRecommendation::GetBucketPV01(size_t _pillar) const
+{
+    return bucketPV01.at(_pillar);
+}
+
+double HedgeRecommendation::GetNotional(uint32_t _handle) const
+{
+    return notionals.at(_handle);
+}
+
+vector<string> HedgeRecommendation::GuiOut() const
+{
+    vector<string> _output;
+    for (uint32_t i = 0; i < PRODUCT_COUNT; ++i) {
+        _output.push_back(string(PRODUCT_CUSIPS[i]));
+        _output.push_back(to_string(llround(notionals[i])));
+    }
+    return _output;
+}
+
+
+// Forward declarations
+template<typename T>
+class HedgeGUIConnector;
+template<typename T>
+class RiskHedgeListener;
+
+/**
+ * @class HedgeService
+ * @brief Service recommending on-the-run hedges for the key-rate buckets of the firm.
+ *
+ * The firm's key-rate PV01s come from the RiskService and are summed into HEDGE_BUCKETS hedge
+ * buckets. Hedge bond i carries B[b][i] per unit of face in bucket b, the sum of its key-rate
+ * PV01s over the pillars of b, and the notionals x solve B x = -risk. The hedge bonds are fewer
+ * than the positions' bonds, so a position in e.g. the 20Y is hedged with the 10Y and the 30Y.
+ *
+ * B only changes when the RiskService reprices a hedge bond, so its inverse is kept and only
+ * refreshed when one of the hedge bonds was repriced; a risk change then costs one matrix-vector
+ * product, whatever the other bonds do.
+ * Set the RiskService with SetRiskService before the first risk update.
+ *
+ * @tparam T The product type.
+ */
+template<typename T>
+class HedgeService : public Service<string, HedgeRecommendation>
+{
+public:
+    // Constructor and destructor
+    HedgeService();
+    ~HedgeService();
+
+    // Service interface methods, keyed by any string: there is one firm-wide recommendation
+    HedgeRecommendation& GetData(string key);
+    void OnMessage(HedgeRecommendation& data);
+    void AddListener(ServiceListener<HedgeRecommendation>* listener);
+    const vector<ServiceListener<HedgeRecommendation>*>& GetListeners() const;
+    RiskHedgeListener<T>* GetListener();
+    HedgeGUIConnector<T>* GetConnector();
+
+    // Source of the key-rate risk of the firm and of the hedge bonds
+    void SetRiskService(RiskService<T>* _riskService);
+
+    // Update the recommendation for the current firm risk
+    void OnRisk();
+
+    // Throttle of the GUI file in milliseconds
+    int GetThrottle() const;
+
+    // Memory held by the recommendation and the hedge system
+    ServiceMemoryStats MemoryStats() const;
+
+private:
+    array<array<double, HEDGE_BUCKETS>, HEDGE_BUCKETS> hedgeInverse;  ///< B^-1, [hedge bond][bucket]
+    long factoredVersion;                                            ///< Hedge bond repricings B^-1 was computed at
+    RiskService<T>* riskService;                                     ///< Source of the key-rate risk
+    HedgeRecommendation recommendation;
+    vector<ServiceListener<HedgeRecommendation>*> listeners;  ///< Listeners for new recommendations
+    RiskHedgeListener<T>* riskListener;                        ///< Listener for risk updates
+    HedgeGUIConnector<T>* connector;                           ///< Connector to the GUI file
+    int throttle;                                              ///< Minimum time between GUI lines
+
+    // Build B from the current key-rate PV01s of the hedge bonds and invert it
+    void Factor();
+
+    // Repricings of the hedge bonds so far: B only changes when this does
+    long HedgeVersion() const;
+};
+// **********************************************************************************
+//                  Implementation of HedgeService...
+// **********************************************************************************
+template<typename T>
+HedgeService<T>::HedgeService()
+{
+    listeners = vector<ServiceListener<HedgeRecommendation>*>();
+    riskListener = new RiskHedgeListener<T>(this);
+    connector = new HedgeGUIConnector<T>(this);
+    throttle = 300;
+    riskService = nullptr;
+    factoredVersion = -1;
+}
+
+template<typename T>
+void HedgeService<T>::SetRiskService(RiskService<T>* _riskService)
+{
+    riskService = _riskService;
+    factoredVersion = -1;
+}
+
+template<typename T>
+void HedgeService<T>::Factor()
+{
+    constexpr size_t N = HEDGE_BUCKETS;
+    double _system[N][2 * N] = {};
+    for (size_t i = 0; i < N; ++i) {
+        for (size_t k = 0; k < KEY_RATE_PILLARS; ++k) {
+            _system[HEDGE_BUCKET_OF[k]][i] += riskService->GetKeyRatePV01(HEDGE_HANDLES[i], k);
+        }
+        _system[i][N + i] = 1;
+    }
+
+    // Gauss-Jordan elimination with partial pivoting on [B | I]
+    for (size_t c = 0; c < N; ++c) {
+        size_t _pivot = c;
+        for (size_t r = c + 1; r < N; ++r) {
+            if (fabs(_system[r][c]) > fabs(_system[_pivot][c])) _pivot = r;
+        }
+        if (fabs(_system[_pivot][c]) < 1e-12) {
+            throw std::runtime_error("Hedge bonds do not span the hedge buckets");
+        }
+        swap(_system[c], _system[_pivot]);
+        double _scale = 1.0 / _system[c][c];
+        for (size_t j = 0; j < 2 * N; ++j) _system[c][j] *= _scale;
+        for (size_t r = 0; r < N; ++r) {
+            if (r == c || _system[r][c] == 0) continue;
+            double _factor = _system[r][c];
+            for (size_t j = 0; j < 2 * N; ++j) _system[r][j] -= _factor * _system[c][j];
+        }
+    }
+    for (size_t i = 0; i < N; ++i) {
+        for (size_t b = 0; b < N; ++b) hedgeInverse[i][b] = _system[i][N + b];
+    }
+    factoredVersion = HedgeVersion();
+}
+
+template<typename T>
+long HedgeService<T>::HedgeVersion() const
+{
+    long _version = 0;
+    for (uint32_t _handle : HEDGE_HANDLES) _version += riskService->GetRiskVersion(_handle);
+    return _version;
+}
+
+template<typename T>
+HedgeService<T>::~HedgeService() {}
+
+template<typename T>
+HedgeRecommendation& HedgeService<T>::GetData(string key)
+{
+    return recommendation;
+}
+
+template<typename T>
+void HedgeService<T>::OnMessage(HedgeRecommendation& data)
+{
+    TraceSpan _span("HedgeService::OnMessage");
+    connector->Publish(data);
+    for (auto& lstn : listeners) {
+        lstn->ProcessAdd(data);
+    }
+}
+
+template<typename T>
+void HedgeService<T>::AddListener(ServiceListener<HedgeRecommendation>* listener)
+{
+    listeners.push_back(listener);
+}
+
+template<typename T>
+const vector<ServiceListener<HedgeRecommendation>*>& HedgeService<T>::GetListeners() const
+{
+    return listeners;
+}
+
+template<typename T>
+RiskHedgeListener<T>* HedgeService<T>::GetListener()
+{
+    return riskListener;
+}
+
+template<typename T>
+HedgeGUIConnector<T>* HedgeService<T>::GetConnector()
+{
+    return connector;
+}
+
+template<typename T>
+int HedgeService<T>::GetThrottle() const
+{
+    return throttle;
+}
+
+template<typename T>
+ServiceMemoryStats HedgeService<T>::MemoryStats() const
+{
+    ServiceMemoryStats _stats;
+    _stats.service = "HedgeService";
+    _stats.entries = 1;
+    _stats.containerBytes = _stats.peakContainerBytes =
+        sizeof(hedgeInverse);
+    _stats.payloadBytes = sizeof(HedgeRecommendation);
+    return _stats;
+}
+
+template<typename T>
+void HedgeService<T>::OnRisk()
+{
+    if (!riskService) throw std::runtime_error("HedgeService has no RiskService");
+    if (HedgeVersion() != factoredVersion) Factor();
+
+    array<double, HEDGE_BUCKETS> _exposure{};
+    for (size_t k = 0; k < KEY_RATE_PILLARS; ++k) {
+        recommendation.bucketPV01[k] = riskService->GetPortfolioKeyRatePV01(k);
+        _exposure[HEDGE_BUCKET_OF[k]] += recommendation.bucketPV01[k];
+    }
+
+    recommendation.notionals.fill(0);
+    for (size_t i = 0; i < HEDGE_BUCKETS; ++i) {
+        double _notional = 0;
+        for (size_t b = 0; b < HEDGE_BUCKETS; ++b) _notional -= hedgeInverse[i][b] * _exposure[b];
+        recommendation.notionals[HEDGE_HANDLES[i]] = _notional;
+    }
+    recommendation.version++;
+    OnMessage(recommendation);
+}
+
+
+/**
+ * @class HedgeGUIConnector
+ * @brief Connector writing the hedge recommendations to a GUI file, throttled like the price GUI.
+ *
+ * @tparam T The product type.
+ */
+template<typename T>
+class HedgeGUIConnector : public Connector<HedgeRecommendation>
+{
+public:
+    // Constructor and Destructor
+    HedgeGUIConnector(HedgeService<T>* service);
+    ~HedgeGUIConnector();
+
+    // Publish data to the Connector
+    void Publish(HedgeRecommendation& data);
+
+    // Subscribe data from the Connector (not implemented)
+    void Subscribe(ifstream& data);
+
+private:
+    HedgeService<T>* hedge; ///< Reference to the associated HedgeService
+    long lastPublishTimeMillisec;
+};
+// **********************************************************************************
+//                  Implementation of HedgeGUIConnector...
+// **********************************************************************************
+template<typename T>
+HedgeGUIConnector<T>::HedgeGUIConnector(HedgeService<T>* service)
+{
+    hedge = service;
+    lastPublishTimeMillisec = 0;
+}
+
+template<typename T>
+HedgeGUIConnector<T>::~HedgeGUIConnector() {}
+
+template<typename T>
+void HedgeGUIConnector<T>::Subscribe(ifstream& _data) {}
+
+template<typename T>
+void HedgeGUIConnector<T>::Publish(HedgeRecommendation& data)
+{
+    long currentTime = GetCurrentTimeMillis();
+    if (currentTime - lastPublishTimeMillisec < hedge->GetThrottle()) return;
+    lastPublishTimeMillisec = currentTime;
+
+    std::stringstream output;
+    output << CurrentDateTimeWithMillis() << ",";
+    for (const auto& s : data.GuiOut()) {
+        output << s << ",";
+    }
+    output << "\n";
+
+    std::ofstream file("../data/hedges.txt", std::ios::app);
+    if (file.is_open()) {
+        file << output.str();
+    } else {
+        LOG(LEVEL_ERROR, "Unable to open hedge GUI output file.");
+    }
+}
+
+
+/**
+ * @class RiskHedgeListener
+ * @brief Listener forwarding PV01 updates from the RiskService to the HedgeService.
+ *
+ * @tparam T The product type.
+ */
+template<typename T>
+class RiskHedgeListener : public ServiceListener<PV01<T>>
+{
+public:
+    // Constructor and Destructor
+    RiskHedgeListener(HedgeService<T>* service);
+    ~RiskHedgeListener();
+
+    // Listener interface methods
+    void ProcessAdd(PV01<T>& data);
+    void ProcessRemove(PV01<T>& data);
+    void ProcessUpdate(PV01<T>& data);
+
+private:
+    HedgeService<T>* hedge; ///< Reference to the HedgeService
+};
+// **********************************************************************************
+//                  Implementation of RiskHedgeListener...
+// **********************************************************************************
+template<typename T>
+RiskHedgeListener<T>::RiskHedgeListener(HedgeService<T>* service)
+{
+    hedge = service;
+}
+
+template<typename T>
+RiskHedgeListener<T>::~RiskHedgeListener() {}
+
+template<typename T>
+void RiskHedgeListener<T>::ProcessAdd(PV01<T>& data)
+{
+    hedge->OnRisk();
+}
+
+template<typename T>
+void RiskHedgeListener<T>::ProcessRemove(PV01<T>& data) {}
+
+template<typename T>
+void RiskHedgeListener<T>::ProcessUpdate(PV01<T>& data) {}
+
+#endif //HEDGE_SERVICE_HPP
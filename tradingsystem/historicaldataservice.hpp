@@ -16,11 +16,29 @@
 #include <vector>
 #include "soa.hpp"
 #include "utils/utils.hpp"
+#include "utils/probes.hpp"
+#include "utils/retention.hpp"
 
 using namespace std;
 
 // Enum for various service types
-enum ServiceType { POSITION, RISK, EXECUTION, STREAMING, INQUIRY, DEFAULT };
+enum ServiceType { POSITION, RISK, EXECUTION, STREAMING, INQUIRY, BAR, TCA, TRADE, DEFAULT };
+
+// Message type reported by the USDT probes for the records of a service type
+ProbeMessageType GetProbeMessageType(ServiceType _type)
+{
+    switch (_type) {
+        case POSITION: return PROBE_POSITION;
+        case RISK: return PROBE_PV01;
+        case EXECUTION: return PROBE_EXECUTION_ORDER;
+        case STREAMING: return PROBE_PRICE_STREAM;
+        case INQUIRY: return PROBE_INQUIRY;
+        case BAR: return PROBE_BAR;
+        case TCA: return PROBE_EXECUTION_COST;
+        case TRADE: return PROBE_TRADE;
+        default: return static_cast<ProbeMessageType>(0);
+    }
+}
 
 
 template<typename T>
@@ -35,6 +53,11 @@ class HistoricalDataListener;
  * This service manages historical data for various financial services, including position, risk,
  * execution, streaming, and inquiry data. It supports data persistence and notification to listeners.
  *
+ * Types with an HDDeltaFormat(previous) method (positions, PV01s) can be persisted as deltas:
+ * the first row of a product and every checkpointEvery-th row written after it are in full, marked
+ * C, and the others hold only the fields changed since the previous record, marked D. A record
+ * without changes is not written and does not count towards the next checkpoint. A product is rebuilt from its last C row and the D rows after it.
+ *
  * @tparam T The data type to persist, representing different types of financial data.
  */
 template<typename T>
@@ -58,38 +81,80 @@ public:
     // Method to persist data
     void PersistData(string persistKey, T& data);
 
+    // Write only the changes of each record, with a full checkpoint every _checkpointEvery rows
+    // written for a product; 0 writes every record in full
+    void SetDeltaPersistence(size_t _checkpointEvery);
+
+    // Fields of the next record to persist, empty when a delta has nothing to write
+    vector<string> FormatRecord(const T& data);
+
+    // Memory held by the service
+    ServiceMemoryStats MemoryStats() const;
+
+    // Bound the records kept in memory once they are written to the persistent store
+    void SetRetentionPolicy(RetentionPolicy _policy);
+
+    // Start the persistent store of a new trading day, dropping the records of earlier runs
+    void StartOfDay();
+
 private:
-    unordered_map<string, T> hd;           ///< Historical data storage
+    CountingResource memory;               ///< Tagged allocator of the store
+    pmr::unordered_map<string, Retained<string, T>> hd;  ///< Historical data storage
+    RetentionIndex<string> retention;      ///< Recency of the records for the retention policy
     vector<ServiceListener<T>*> listeners; ///< Listeners for historical data updates
     HistoricalDataConnector<T>* connector; ///< Connector for historical data
     ServiceListener<T>* hdListener;        ///< Listener for historical data events
     ServiceType type;                      ///< Type of service handled
+    size_t checkpointEvery;                ///< Rows between full checkpoints, 0 without deltas
+    CountingResource persistedMemory;      ///< Tagged allocator of the delta bases
+    pmr::unordered_map<string, pair<T, size_t>> persisted;  ///< Last record written and rows since its checkpoint
 };
 // **********************************************************************************
 //                  Implementation of HistoricalDataService...
 // **********************************************************************************
 template<typename T>
-HistoricalDataService<T>::HistoricalDataService()
+HistoricalDataService<T>::HistoricalDataService() :
+        hd(&memory), persisted(&persistedMemory)
 {
-    hd = unordered_map<string, T>();
     listeners = vector<ServiceListener<T>*>();
     connector = new HistoricalDataConnector<T>(this);
     hdListener = new HistoricalDataListener<T>(this);
     type = DEFAULT;
+    checkpointEvery = 0;
 }
 
 template<typename T>
-HistoricalDataService<T>::HistoricalDataService(ServiceType _type)
+HistoricalDataService<T>::HistoricalDataService(ServiceType _type) :
+        hd(&memory), persisted(&persistedMemory)
 {
-    hd = unordered_map<string, T>();
     listeners = vector<ServiceListener<T>*>();
     connector = new HistoricalDataConnector<T>(this);
     hdListener = new HistoricalDataListener<T>(this);
     type = _type;
+    checkpointEvery = 0;
 }
 template<typename T>
 HistoricalDataService<T>::~HistoricalDataService() {}
 
+template<typename T>
+ServiceMemoryStats HistoricalDataService<T>::MemoryStats() const
+{
+    static const char* NAMES[] = {"HistoricalDataService(positions)", "HistoricalDataService(risk)",
+                                  "HistoricalDataService(executions)", "HistoricalDataService(streaming)",
+                                  "HistoricalDataService(inquiries)", "HistoricalDataService(bars)",
+                                  "HistoricalDataService(tca)", "HistoricalDataService(trades)",
+                                  "HistoricalDataService"};
+    ServiceMemoryStats _stats = CollectMemoryStats(NAMES[type], memory, hd);
+
+    // the delta bases are held on top of the records, whatever the retention policy
+    ServiceMemoryStats _bases = CollectMemoryStats(NAMES[type], persistedMemory, persisted);
+    _stats.containerBytes += _bases.containerBytes;
+    _stats.peakContainerBytes += _bases.peakContainerBytes;
+    _stats.payloadBytes += _bases.payloadBytes;
+    for (const auto& [_product, _bytes] : _bases.bytesPerProduct) _stats.bytesPerProduct[_product] += _bytes;
+    return _stats;
+}
+
 
 template<typename T>
 void HistoricalDataService<T>::AddListener(ServiceListener<T>* listener)
@@ -123,9 +188,10 @@ ServiceType HistoricalDataService<T>::GetServiceType() const
 
 template<typename T>
 T& HistoricalDataService<T>::GetData(string key){
+    retention.Expire([this](const string& _key) { hd.erase(_key); });
     auto it = hd.find(key);
     if (it != hd.end()) {
-        return it->second;
+        return it->second.value;
     } else {
         // Handle the case where the key is not found. For example:
         throw std::runtime_error("Historical data not found for key: " + key);
@@ -134,22 +200,83 @@ T& HistoricalDataService<T>::GetData(string key){
 
 template<typename T>
 void HistoricalDataService<T>::OnMessage(T& data){
+    ServiceProbe _probe(GetProbeMessageType(type), data.GetProduct());
     std::string productId = data.GetProduct().GetProductId();
 
     auto it = hd.find(productId);
     if (it != hd.end()) {
         // Update the existing position
-        it->second = data;
+        it->second.value = data;
     } else {
         // Insert the new position if it does not exist
-        hd.insert({productId, data});
+        it = hd.emplace(productId, data).first;
     }
+    retention.Touch(it->first, it->second.hook, [this](const string& _key) { hd.erase(_key); });
 }
 template<typename T>
 void HistoricalDataService<T>::PersistData(string persistKey, T& data)
 {
     OnMessage(data);
     connector->Publish(data);
+    retention.Persisted(data.GetProduct().GetProductId(), [this](const string& _key) { hd.erase(_key); });
+}
+
+template<typename T>
+void HistoricalDataService<T>::SetRetentionPolicy(RetentionPolicy _policy)
+{
+    retention.SetPolicy(_policy);
+}
+
+template<typename T>
+void HistoricalDataService<T>::StartOfDay()
+{
+    connector->Truncate();
+    hd.clear();
+    retention.Clear();
+    persisted.clear();
+}
+
+template<typename T>
+void HistoricalDataService<T>::SetDeltaPersistence(size_t _checkpointEvery)
+{
+    if constexpr (!requires(const T& _record) { _record.HDDeltaFormat(_record); }) {
+        if (_checkpointEvery > 0) {
+            throw std::runtime_error("Delta persistence is not supported for this record type");
+        }
+    }
+    checkpointEvery = _checkpointEvery;
+    persisted.clear();
+}
+
+template<typename T>
+vector<string> HistoricalDataService<T>::FormatRecord(const T& data)
+{
+    if constexpr (requires(const T& _record) { _record.HDDeltaFormat(_record); }) {
+        if (checkpointEvery > 0) {
+            const string& _productId = data.GetProduct().GetProductId();
+            auto it = persisted.find(_productId);
+            vector<string> _fields;
+            // count the rows written only: a record without changes does not bring the checkpoint closer
+            if (it == persisted.end() || it->second.second + 1 >= checkpointEvery) {
+                _fields = data.HDFormat();
+                _fields.insert(_fields.begin(), "C");
+                if (it == persisted.end()) {
+                    persisted.emplace(_productId, make_pair(data, size_t(0)));
+                    return _fields;
+                }
+                it->second.second = 0;
+            } else {
+                _fields = data.HDDeltaFormat(it->second.first);
+                // only the product ID: nothing moved
+                if (_fields.size() <= 1) return {};
+                _fields.insert(_fields.begin(), "D");
+                ++it->second.second;
+            }
+            it->second.first = data;
+            return _fields;
+        }
+    }
+    return data.HDFormat();
 }
 
 
@@ -178,6 +305,9 @@ public:
     // Subscribe data from the Connector (not implemented)
     void Subscribe(ifstream& data);
 
+    // Empty the file of the service type
+    void Truncate();
+
 private:
     HistoricalDataService<T>* hist; ///< Reference to the associated HistoricalDataService
     std::unordered_map<ServiceType, std::string> filePathMap;
@@ -195,6 +325,9 @@ HistoricalDataConnector<T>::HistoricalDataConnector(HistoricalDataService<T>* se
     filePathMap[EXECUTION] = "../data/out/executions.txt";
     filePathMap[STREAMING] = "../data/out/streaming.txt";
     filePathMap[INQUIRY] = "../data/out/allinquiries.txt";
+    filePathMap[BAR] = "../data/out/bars.txt";
+    filePathMap[TCA] = "../data/out/tca.txt";
+    filePathMap[TRADE] = "../data/out/trades.txt";
 }
 
 template<typename T>
@@ -204,34 +337,48 @@ HistoricalDataConnector<T>::~HistoricalDataConnector() {}
 template<typename T>
 void HistoricalDataConnector<T>::Publish(T& data)
 {
+    TraceSpan _span("HistoricalDataConnector::Publish");
+    ProbePublish(GetProbeMessageType(hist->GetServiceType()), data.GetProduct().GetProductId());
     ServiceType _type = hist->GetServiceType();
     auto it = filePathMap.find(_type);
     if (it != filePathMap.end()) {
         std::string filePath = it->second;
+        std::vector<std::string> _strings = hist->FormatRecord(data);
+        if (_strings.empty()) return;
 
         // File writing operations
         std::ofstream _file(filePath, std::ios::app);
         if (!_file.is_open()) {
-            std::cerr << "Failed to open file: " << filePath << std::endl;
+            LOG(LEVEL_ERROR, "Failed to open file: {}", filePath);
             return;
         }
 
 
         _file << CurrentDateTimeWithMillis() << ",";
-        std::vector<std::string> _strings = data.HDFormat();
         for (const auto& s : _strings) {
             _file << s << ",";
         }
         _file << std::endl;
         _file.close();
     } else {
-        std::cerr << "Unknown service type" << std::endl;
+        LOG(LEVEL_ERROR, "Unknown service type {}", _type);
     }
 }
 
 template<typename T>
 void HistoricalDataConnector<T>::Subscribe(ifstream& _data) {}
 
+template<typename T>
+void HistoricalDataConnector<T>::Truncate()
+{
+    auto it = filePathMap.find(hist->GetServiceType());
+    if (it == filePathMap.end()) return;
+    std::ofstream _file(it->second, std::ios::trunc);
+    if (!_file.is_open()) {
+        LOG(LEVEL_ERROR, "Failed to open file: {}", it->second);
+    }
+}
+
 
 /**
  * @class HistoricalDataListener
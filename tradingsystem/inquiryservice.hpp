@@ -10,14 +10,26 @@
 #ifndef INQUIRY_SERVICE_HPP
 #define INQUIRY_SERVICE_HPP
 
+#include <array>
+#include <memory_resource>
+#include <string_view>
 #include "soa.hpp"
 #include "tradebookingservice.hpp"
+#include "pricingservice.hpp"
+#include "utils/arena.hpp"
+#include "utils/enumparser.hpp"
+#include "utils/probes.hpp"
 
 // Various inqyury states
 enum InquiryState { RECEIVED, QUOTED, DONE, REJECTED, CUSTOMER_REJECTED };
 
+// Parser for the state column of the inquiry file
+constexpr EnumParser<InquiryState, 5> InquiryStateParser("InquiryState", {{"RECEIVED", RECEIVED}, {"QUOTED", QUOTED}, {"DONE", DONE}, {"REJECTED", REJECTED}, {"CUSTOMER_REJECTED", CUSTOMER_REJECTED}});
+
 /**
  * Inquiry object modeling a customer inquiry from a client.
+ * The inquiry ID is interned in the trading day arena, so an inquiry must not outlive
+ * the trading day it was received in.
  * Type T is the product type.
  */
 template<typename T>
@@ -27,10 +39,10 @@ class Inquiry
 public:
 
   // ctor for an inquiry
-  Inquiry(string _inquiryId, const T &_product, Side _side, long _quantity, double _price, InquiryState _state);
+  Inquiry(string_view _inquiryId, const T &_product, Side _side, long _quantity, double _price, InquiryState _state);
 
   // Get the inquiry ID
-  const string& GetInquiryId() const;
+  string_view GetInquiryId() const;
 
   // Get the product
   const T& GetProduct() const;
@@ -54,7 +66,7 @@ public:
   vector<string> HDFormat() const;
 
 private:
-  string inquiryId;
+  string_view inquiryId;
   T product;
   Side side;
   long quantity;
@@ -88,7 +100,7 @@ vector<string> Inquiry<T>::HDFormat() const {
             break;
     }
     // Add formatted elements to the vector
-    formattedOutput.push_back(inquiryId);
+    formattedOutput.push_back(string(inquiryId));
     formattedOutput.push_back(product.GetProductId());
     formattedOutput.push_back(side == BUY ? "BUY" : "SELL");
     formattedOutput.push_back(std::to_string(quantity));
@@ -98,10 +110,10 @@ vector<string> Inquiry<T>::HDFormat() const {
     return formattedOutput;
 }
 template<typename T>
-Inquiry<T>::Inquiry(string _inquiryId, const T &_product, Side _side, long _quantity, double _price, InquiryState _state) :
+Inquiry<T>::Inquiry(string_view _inquiryId, const T &_product, Side _side, long _quantity, double _price, InquiryState _state) :
         product(_product)
 {
-    inquiryId = _inquiryId;
+    inquiryId = GetTradingDayArena().Intern(_inquiryId);
     side = _side;
     quantity = _quantity;
     price = _price;
@@ -117,7 +129,7 @@ void Inquiry<T>::SetPrice(double _price) {
 }
 
 template<typename T>
-const string& Inquiry<T>::GetInquiryId() const
+string_view Inquiry<T>::GetInquiryId() const
 {
     return inquiryId;
 }
@@ -152,18 +164,35 @@ InquiryState Inquiry<T>::GetState() const
     return state;
 }
 
+// Heap owned by an inquiry: its product; the inquiry ID lives in the arena
+template<typename T>
+size_t HeapBytes(const Inquiry<T>& _inquiry)
+{
+    return HeapBytes(_inquiry.GetProduct());
+}
+
 
 template<typename T>
 class InquiryConnector;
 template<typename T>
 class InquiryListener;
+template<typename T>
+class PricingInquiryListener;
 
 /**
  * @class InquiryService
  * @brief Service for managing customer inquiries.
  *
  * This service handles customer inquiries, keyed on inquiry identifiers. It manages the lifecycle
- * of inquiries, including sending quotes and handling rejections.
+ * of inquiries, including sending quotes and handling rejections. Inquiry IDs and records live
+ * in the trading day arena and are dropped together at the end of the day.
+ *
+ * RECEIVED inquiries are not quoted one by one from their listener callback: they are queued,
+ * and QuotePending prices the whole queue at once from the last mid and spread of each product
+ * (the customer buys at our offer, sells at our bid), then publishes the quotes together. The
+ * connector drains the queue every QUOTE_BATCH inquiries and at the end of its input, so a
+ * burst of RFQs costs one pass per batch instead of a publish recursion per inquiry. Products
+ * without a price yet are quoted at DEFAULT_QUOTE.
  *
  * @tparam T The type of the financial product.
  */
@@ -171,6 +200,9 @@ template<typename T>
 class InquiryService : public Service<string,Inquiry <T> >
 {
 public:
+    static constexpr size_t QUOTE_BATCH = 256;
+    static constexpr double DEFAULT_QUOTE = 100.0;
+
     // Constructors and destructor
     InquiryService();
     ~InquiryService();
@@ -181,28 +213,55 @@ public:
     void AddListener(ServiceListener<Inquiry<T>>* listener);
     const vector<ServiceListener<Inquiry<T>>*>& GetListeners() const;
     InquiryConnector<T>* GetConnector();
+    PricingInquiryListener<T>* GetPricingListener();
 
     // Inquiry management methods
     void SendQuote(const string &inquiryId, double price);
     void RejectInquiry(const string &inquiryId);
 
+    // Queue a RECEIVED inquiry for the next batch of quotes
+    void QueueQuote(string_view inquiryId);
+
+    // Price and publish every queued inquiry; returns the number quoted
+    size_t QuotePending();
+    size_t GetPendingCount() const;
+
+    // Record the last mid and spread of a product for quoting
+    void UpdatePrice(const T& _product, double _mid, double _spread);
+
+    // Drop the intraday inquiries before the trading day arena is released
+    void EndOfDay();
+
+    // Memory held by the service
+    ServiceMemoryStats MemoryStats() const;
+
 private:
-    unordered_map<string, Inquiry<T>> inquiries;  ///< Inquiries keyed by inquiry ID
+    CountingResource memory;                                ///< Tagged allocator drawing from the trading day arena
+    pmr::unordered_map<string_view, Inquiry<T>> inquiries;  ///< Inquiries keyed by arena-owned inquiry ID
     vector<ServiceListener<Inquiry<T>>*> listeners; ///< Listeners for inquiry updates
     InquiryConnector<T>* connector;               ///< Connector for inquiry data
     InquiryListener<T>* inqlstn;                  ///< Listener for inquiry events
+    PricingInquiryListener<T>* pricingListener;   ///< Listener for price changes
+    vector<Inquiry<T>*> pending;                  ///< RECEIVED inquiries waiting for a quote
+    array<double, PRODUCT_COUNT> mids;            ///< Last mid by product handle
+    array<double, PRODUCT_COUNT> halfSpreads;     ///< Last half bid/offer spread by product handle
+    array<bool, PRODUCT_COUNT> priced;            ///< A price was seen for the product
 };
 // **********************************************************************************
 //                  Implementation of InquiryService...
 // **********************************************************************************
 template<typename T>
-InquiryService<T>::InquiryService()
+InquiryService<T>::InquiryService() :
+        memory(GetTradingDayArena().GetResource()), inquiries(&memory)
 {
-    inquiries = unordered_map<string, Inquiry<T>>();
     listeners = vector<ServiceListener<Inquiry<T>>*>();
     connector = new InquiryConnector<T>(this);
     inqlstn = new InquiryListener<T>(this);
+    pricingListener = new PricingInquiryListener<T>(this);
     this->AddListener(inqlstn);
+    mids.fill(DEFAULT_QUOTE);
+    halfSpreads.fill(0);
+    priced.fill(false);
 
 }
 template<typename T>
@@ -225,6 +284,12 @@ InquiryConnector<T>* InquiryService<T>::GetConnector()
     return connector;
 }
 
+template<typename T>
+PricingInquiryListener<T>* InquiryService<T>::GetPricingListener()
+{
+    return pricingListener;
+}
+
 
 template<typename T>
 Inquiry<T>& InquiryService<T>::GetData(string key){
@@ -240,14 +305,15 @@ Inquiry<T>& InquiryService<T>::GetData(string key){
 template<typename T>
 void InquiryService<T>::OnMessage(Inquiry<T>& data)
 {
-    string inquiryId = data.GetInquiryId();
-    auto it = inquiries.find(inquiryId);
+    TraceSpan _span("InquiryService::OnMessage");
+    ServiceProbe _probe(PROBE_INQUIRY, data.GetProduct());
+    // the key is the inquiry ID, which already lives in the trading day arena
+    auto it = inquiries.find(data.GetInquiryId());
     if (it != inquiries.end()) {
-        // Update the existing position
+        // Update the existing inquiry
         it->second = data;
     } else {
-        // Insert the new position if it does not exist
-        inquiries.insert({inquiryId, data});
+        inquiries.emplace(data.GetInquiryId(), data);
     }
 
     for (auto& lstn : listeners)
@@ -272,6 +338,73 @@ void InquiryService<T>::RejectInquiry(const string& inquiryId)
     _inquiry.SetState(REJECTED);
 }
 
+template<typename T>
+void InquiryService<T>::QueueQuote(string_view inquiryId)
+{
+    auto it = inquiries.find(inquiryId);
+    if (it == inquiries.end()) throw std::runtime_error("inquiry not found for key: " + string(inquiryId));
+    pending.push_back(&it->second);
+}
+
+template<typename T>
+size_t InquiryService<T>::GetPendingCount() const
+{
+    return pending.size();
+}
+
+template<typename T>
+void InquiryService<T>::UpdatePrice(const T& _product, double _mid, double _spread)
+{
+    uint32_t _handle = GetProductHandle(_product.GetProductId());
+    if (_handle == INVALID_PRODUCT_HANDLE) return;
+    mids[_handle] = _mid;
+    halfSpreads[_handle] = 0.5 * _spread;
+    priced[_handle] = true;
+}
+
+template<typename T>
+size_t InquiryService<T>::QuotePending()
+{
+    TraceSpan _span("InquiryService::QuotePending");
+    size_t _count = pending.size();
+    if (_count == 0) return 0;
+
+    // gather the market of each inquiry, then price the batch in one pass over flat arrays
+    vector<double> _mids(_count), _halfSpreads(_count), _signs(_count);
+    for (size_t i = 0; i < _count; ++i) {
+        uint32_t _handle = GetProductHandle(pending[i]->GetProduct().GetProductId());
+        bool _priced = _handle != INVALID_PRODUCT_HANDLE && priced[_handle];
+        _mids[i] = _priced ? mids[_handle] : DEFAULT_QUOTE;
+        _halfSpreads[i] = _priced ? halfSpreads[_handle] : 0.0;
+        _signs[i] = pending[i]->GetSide() == BUY ? 1.0 : -1.0;
+    }
+    for (size_t i = 0; i < _count; ++i) {
+        _mids[i] += _signs[i] * _halfSpreads[i];
+    }
+    for (size_t i = 0; i < _count; ++i) {
+        pending[i]->SetPrice(_mids[i]);
+    }
+
+    connector->Publish(pending);
+    pending.clear();
+    return _count;
+}
+
+template<typename T>
+void InquiryService<T>::EndOfDay()
+{
+    // swap in an empty map so no buckets are left pointing into the arena
+    pending.clear();
+    inquiries = decltype(inquiries)(&memory);
+}
+
+template<typename T>
+ServiceMemoryStats InquiryService<T>::MemoryStats() const
+{
+    return CollectMemoryStats("InquiryService", memory, inquiries,
+                              [](string_view, const Inquiry<T>& _value) { return _value.GetProduct().GetProductId(); });
+}
+
 /**
  * @class InquiryConnector
  * @brief Connector for the InquiryService to publish and subscribe inquiry data.
@@ -293,6 +426,9 @@ public:
     // Publish inquiry data to the Connector
     void Publish(Inquiry<T>& data);
 
+    // Publish a batch of quotes: every inquiry goes QUOTED, then every inquiry goes DONE
+    void Publish(vector<Inquiry<T>*>& data);
+
     // Subscribe to external data sources for inquiries
     void Subscribe(ifstream& data);
 
@@ -316,6 +452,7 @@ void InquiryConnector<T>::Subscribe(std::ifstream& data) {
     string _line;
     while (getline(data, _line))
     {
+        TraceMessage _trace("InquiryConnector");
         stringstream _lineStream(_line);
         string _cell;
         vector<string> _cells;
@@ -326,21 +463,17 @@ void InquiryConnector<T>::Subscribe(std::ifstream& data) {
 
         string _inquiryId = _cells[0];
         string _productId = _cells[1];
-        Side _side;
-        if (_cells[2] == "BUY") _side = BUY;
-        else if (_cells[2] == "SELL") _side = SELL;
+        ProbeRecord(PROBE_INQUIRY, _productId);
+        Side _side = SideParser.Parse(_cells[2]);
         long _quantity = stol(_cells[3]);
         double _price = ConvertBondPrice(_cells[4]);
-        InquiryState _state;
-        if (_cells[5] == "RECEIVED\r") _state = InquiryState::RECEIVED;
-        else if (_cells[5] == "QUOTED\r") _state = InquiryState::QUOTED;
-        else if (_cells[5] == "DONE\r") _state = InquiryState::DONE;
-        else if (_cells[5] == "REJECTED\r") _state = InquiryState::REJECTED;
-        else if (_cells[5] == "CUSTOMER_REJECTED\r") _state = InquiryState::CUSTOMER_REJECTED;
+        InquiryState _state = InquiryStateParser.Parse(_cells[5]);
         T _product = GetBond(_productId);
         Inquiry<T> _inquiry(_inquiryId, _product, _side, _quantity, _price, _state);
         inq->OnMessage(_inquiry);
+        if (inq->GetPendingCount() >= InquiryService<T>::QUOTE_BATCH) inq->QuotePending();
     }
+    inq->QuotePending();
 }
 
 template<typename T>
@@ -349,6 +482,7 @@ void InquiryConnector<T>::Publish(Inquiry<T>& data)
     InquiryState _state = data.GetState();
     if (_state == RECEIVED)
     {
+        LOG(LEVEL_DEBUG, "Inquiry {} quoted at {} and done", data.GetInquiryId(), data.GetPrice());
         data.SetState(QUOTED);
         inq->OnMessage(data);
 
@@ -357,6 +491,23 @@ void InquiryConnector<T>::Publish(Inquiry<T>& data)
     }
 }
 
+template<typename T>
+void InquiryConnector<T>::Publish(vector<Inquiry<T>*>& data)
+{
+    LOG(LEVEL_DEBUG, "Quoting a batch of {} inquiries", data.size());
+    // an inquiry queued twice, or answered meanwhile, is no longer RECEIVED when reached
+    for (Inquiry<T>* _inquiry : data) {
+        if (_inquiry->GetState() != RECEIVED) continue;
+        _inquiry->SetState(QUOTED);
+        inq->OnMessage(*_inquiry);
+    }
+    for (Inquiry<T>* _inquiry : data) {
+        if (_inquiry->GetState() != QUOTED) continue;
+        _inquiry->SetState(DONE);
+        inq->OnMessage(*_inquiry);
+    }
+}
+
 /**
  * @class InquiryListener
  * @brief Listener for the InquiryService to process inquiry events.
@@ -403,11 +554,11 @@ InquiryListener<T>::~InquiryListener() {}
 template<typename T>
 void InquiryListener<T>::ProcessAdd(Inquiry<T>& data)
 {
-    //printInYellow("Inquiry listener triggered");
+    LOG(LEVEL_DEBUG, "Inquiry listener triggered for {}", data.GetInquiryId());
 
     InquiryState state = data.GetState();
     if (state == RECEIVED){
-        inq->SendQuote(data.GetInquiryId(), 100.0);
+        inq->QueueQuote(data.GetInquiryId());
     }
 }
 
@@ -418,6 +569,58 @@ template<typename T>
 void InquiryListener<T>::ProcessUpdate(Inquiry<T>& data) {}
 
 
+/**
+ * @class PricingInquiryListener
+ * @brief Listener forwarding prices from the PricingService to the quotes of the InquiryService.
+ *
+ * @tparam T The type of the financial product associated with the inquiry.
+ */
+template<typename T>
+class PricingInquiryListener : public ServiceListener<Price<T>>
+{
+
+public:
+    // Constructor and Destructor
+    PricingInquiryListener(InquiryService<T>* service);
+    ~PricingInquiryListener();
+
+    // Listener callback to process an add event to the Service
+    void ProcessAdd(Price<T>& data);
+
+    // Listener callback to process a remove event to the Service (not implemented)
+    void ProcessRemove(Price<T>& data);
+
+    // Listener callback to process an update event to the Service (not implemented)
+    void ProcessUpdate(Price<T>& data);
+
+private:
+    InquiryService<T>* inq; ///< Reference to the InquiryService
+};
+// **********************************************************************************
+//                  Implementation of PricingInquiryListener...
+// **********************************************************************************
+template<typename T>
+PricingInquiryListener<T>::PricingInquiryListener(InquiryService<T>* service)
+{
+    inq = service;
+}
+
+template<typename T>
+PricingInquiryListener<T>::~PricingInquiryListener() {}
+
+template<typename T>
+void PricingInquiryListener<T>::ProcessAdd(Price<T>& data)
+{
+    inq->UpdatePrice(data.GetProduct(), data.GetMid(), data.GetBidOfferSpread());
+}
+
+template<typename T>
+void PricingInquiryListener<T>::ProcessRemove(Price<T>& data) {}
+
+template<typename T>
+void PricingInquiryListener<T>::ProcessUpdate(Price<T>& data) {}
+
+
 
 
 #endif
@@ -0,0 +1,411 @@
+/**
+ * @file marketanalyticsservice.hpp
+ * @brief Defines the data types and Service for rolling market analytics over order books.
+ *
+ * This file includes the definition of the MarketAnalytics signals and the MarketAnalyticsService,
+ * which listens to the MarketDataService and keeps, per product, the microprice, the top-N depth
+ * imbalance and rolling time-weighted and volume-weighted prices.
+ *
+ * @author Niccolo Fabbri
+ */
+
+#ifndef MARKET_ANALYTICS_SERVICE_HPP
+#define MARKET_ANALYTICS_SERVICE_HPP
+
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <vector>
+#include "soa.hpp"
+#include "marketdataservice.hpp"
+#include "utils/utils.hpp"
+#include "utils/rollingwindow.hpp"
+
+using namespace std;
+
+/**
+ * @class MarketAnalytics
+ * @brief Signals computed from the order book of a product.
+ *
+ * @tparam T The product type.
+ */
+template<typename T>
+class MarketAnalytics
+{
+public:
+    // ctor for the signals of a product
+    MarketAnalytics(const T& _product);
+
+    // Get the product
+    const T& GetProduct() const;
+
+    // Mid of the best bid and offer
+    double GetMid() const;
+
+    // Best offer minus best bid
+    double GetSpread() const;
+
+    // Best bid and offer weighted by the size on the opposite side
+    double GetMicroprice() const;
+
+    // (bid size - offer size) / (bid size + offer size) over the top levels, in [-1, 1]
+    double GetImbalance() const;
+
+    // Mid weighted by the market time it was in force over the rolling window
+    double GetTwap() const;
+
+    // Microprice weighted by the top-of-book size over the rolling window
+    double GetVwap() const;
+
+    // Number of books seen for the product
+    long GetTicks() const;
+
+    // Update the signals
+    void Set(double _mid, double _spread, double _microprice, double _imbalance, double _twap, double _vwap);
+
+private:
+    T product;
+    double mid;
+    double spread;
+    double microprice;
+    double imbalance;
+    double twap;
+    double vwap;
+    long ticks;
+};
+// **********************************************************************************
+//                  Implementation of MarketAnalytics...
+// **********************************************************************************
+template<typename T>
+MarketAnalytics<T>::MarketAnalytics(const T& _product) :
+        product(_product)
+{
+    mid = spread = microprice = imbalance = twap = vwap = 0;
+    ticks = 0;
+}
+
+template<typename T>
+const T& MarketAnalytics<T>::GetProduct() const
+{
+    return product;
+}
+
+template<typename T>
+double MarketAnalytics<T>::GetMid() const
+{
+    return mid;
+}
+
+template<typename T>
+double MarketAnalytics<T>::GetSpread() const
+{
+    return spread;
+}
+
+template<typename T>
+double MarketAnalytics<T>::GetMicroprice() const
+{
+    return microprice;
+}
+
+template<typename T>
+double MarketAnalytics<T>::GetImbalance() const
+{
+    return imbalance;
+}
+
+template<typename T>
+double MarketAnalytics<T>::GetTwap() const
+{
+    return twap;
+}
+
+template<typename T>
+double MarketAnalytics<T>::GetVwap() const
+{
+    return vwap;
+}
+
+template<typename T>
+long MarketAnalytics<T>::GetTicks() const
+{
+    return ticks;
+}
+
+template<typename T>
+void MarketAnalytics<T>::Set(double _mid, double _spread, double _microprice, double _imbalance, double _twap,
+                             double _vwap)
+{
+    mid = _mid;
+    spread = _spread;
+    microprice = _microprice;
+    imbalance = _imbalance;
+    twap = _twap;
+    vwap = _vwap;
+    ticks++;
+}
+
+
+// Forward declaration
+template<typename T>
+class MarketDataAnalyticsListener;
+
+/**
+ * @class MarketAnalyticsService
+ * @brief Service maintaining rolling order book signals per product.
+ *
+ * State lives in one preallocated slot per product handle, so an update is an array index,
+ * a pass over the top levels of the book and O(1) ring buffer updates. The feed carries no
+ * timestamps, so market time is counted in order books of the whole feed: the TWAP weighs a
+ * mid by the number of books, of any product, that arrived while it was in force, which does
+ * not depend on how fast the books are processed. Register its listener
+ * on the MarketDataService before the algo execution listener so strategies read signals
+ * that already include the current book.
+ *
+ * @tparam T The product type.
+ */
+template<typename T>
+class MarketAnalyticsService : public Service<string, MarketAnalytics<T>>
+{
+public:
+    // Number of order book updates in the rolling windows
+    static constexpr size_t WINDOW = 64;
+    // Deepest level used by the imbalance
+    static constexpr size_t MAX_DEPTH = 16;
+
+    // ctor with the number of top levels used by the imbalance
+    MarketAnalyticsService(size_t _depth = 5);
+    ~MarketAnalyticsService();
+
+    // Service interface methods
+    MarketAnalytics<T>& GetData(string key);
+    void OnMessage(MarketAnalytics<T>& data);
+    void AddListener(ServiceListener<MarketAnalytics<T>>* listener);
+    const vector<ServiceListener<MarketAnalytics<T>>*>& GetListeners() const;
+    MarketDataAnalyticsListener<T>* GetListener();
+
+    // Signals of a product by handle, nullptr if no book was seen yet
+    const MarketAnalytics<T>* GetSignals(uint32_t _handle) const;
+
+    // Recompute the signals of the book's product and notify listeners
+    void Update(const OrderBook<T>& _book);
+
+    // Memory held by the service
+    ServiceMemoryStats MemoryStats() const;
+
+private:
+    struct Slot
+    {
+        optional<MarketAnalytics<T>> analytics; ///< Empty until the first book of the product
+        RollingWeightedMean<WINDOW> twap;
+        RollingWeightedMean<WINDOW> vwap;
+        long lastSequence = 0;
+        double lastMid = 0;
+    };
+
+    vector<Slot> slots;                                     ///< One slot per product handle
+    vector<ServiceListener<MarketAnalytics<T>>*> listeners; ///< Listeners for signal updates
+    MarketDataAnalyticsListener<T>* mdListener;             ///< Listener for order books
+    size_t depth;                                           ///< Levels used by the imbalance
+    long sequence;                                          ///< Books seen over all products, the market clock
+
+    // Copy the best MAX_DEPTH orders of a stack into contiguous arrays, best price first
+    static size_t LoadSide(const vector<Order>& _stack, bool _isBid, double* _prices, double* _sizes);
+};
+// **********************************************************************************
+//                  Implementation of MarketAnalyticsService...
+// **********************************************************************************
+template<typename T>
+MarketAnalyticsService<T>::MarketAnalyticsService(size_t _depth) :
+        slots(PRODUCT_COUNT)
+{
+    listeners = vector<ServiceListener<MarketAnalytics<T>>*>();
+    mdListener = new MarketDataAnalyticsListener<T>(this);
+    depth = max<size_t>(1, min(_depth, MAX_DEPTH));
+    sequence = 0;
+}
+
+template<typename T>
+MarketAnalyticsService<T>::~MarketAnalyticsService() {}
+
+template<typename T>
+MarketAnalytics<T>& MarketAnalyticsService<T>::GetData(string key)
+{
+    uint32_t _handle = GetProductHandle(key);
+    if (_handle == INVALID_PRODUCT_HANDLE || !slots[_handle].analytics) {
+        throw std::runtime_error("Market analytics not found for key: " + key);
+    }
+    return *slots[_handle].analytics;
+}
+
+template<typename T>
+const MarketAnalytics<T>* MarketAnalyticsService<T>::GetSignals(uint32_t _handle) const
+{
+    if (_handle >= slots.size() || !slots[_handle].analytics) return nullptr;
+    return &*slots[_handle].analytics;
+}
+
+template<typename T>
+void MarketAnalyticsService<T>::OnMessage(MarketAnalytics<T>& data)
+{
+    TraceSpan _span("MarketAnalyticsService::OnMessage");
+    for (auto& lstn : listeners) {
+        lstn->ProcessAdd(data);
+    }
+}
+
+template<typename T>
+void MarketAnalyticsService<T>::AddListener(ServiceListener<MarketAnalytics<T>>* listener)
+{
+    listeners.push_back(listener);
+}
+
+template<typename T>
+const vector<ServiceListener<MarketAnalytics<T>>*>& MarketAnalyticsService<T>::GetListeners() const
+{
+    return listeners;
+}
+
+template<typename T>
+MarketDataAnalyticsListener<T>* MarketAnalyticsService<T>::GetListener()
+{
+    return mdListener;
+}
+
+template<typename T>
+size_t MarketAnalyticsService<T>::LoadSide(const vector<Order>& _stack, bool _isBid, double* _prices, double* _sizes)
+{
+    // the connector does not sort the stacks: keep the best levels of the whole stack in a heap
+    // with the worst kept level on top, then sort them
+    auto _better = [_isBid](const Order* a, const Order* b) {
+        return _isBid ? a->GetPrice() > b->GetPrice() : a->GetPrice() < b->GetPrice();
+    };
+    size_t _n = min(_stack.size(), MAX_DEPTH);
+    const Order* _levels[MAX_DEPTH];
+    for (size_t i = 0; i < _n; ++i) _levels[i] = &_stack[i];
+    make_heap(_levels, _levels + _n, _better);
+    for (size_t i = _n; i < _stack.size(); ++i) {
+        if (!_better(&_stack[i], _levels[0])) continue;
+        pop_heap(_levels, _levels + _n, _better);
+        _levels[_n - 1] = &_stack[i];
+        push_heap(_levels, _levels + _n, _better);
+    }
+    sort_heap(_levels, _levels + _n, _better);
+    for (size_t i = 0; i < _n; ++i) {
+        _prices[i] = _levels[i]->GetPrice();
+        _sizes[i] = static_cast<double>(_levels[i]->GetQuantity());
+    }
+    return _n;
+}
+
+template<typename T>
+void MarketAnalyticsService<T>::Update(const OrderBook<T>& _book)
+{
+    uint32_t _handle = GetProductHandle(_book.GetProduct().GetProductId());
+    if (_handle == INVALID_PRODUCT_HANDLE) return;
+
+    double _bidPrices[MAX_DEPTH], _bidSizes[MAX_DEPTH] = {};
+    double _offerPrices[MAX_DEPTH], _offerSizes[MAX_DEPTH] = {};
+    size_t _nBids = LoadSide(_book.GetBidStack(), true, _bidPrices, _bidSizes);
+    size_t _nOffers = LoadSide(_book.GetOfferStack(), false, _offerPrices, _offerSizes);
+    if (_nBids == 0 || _nOffers == 0) return;
+
+    double _bidPrice = _bidPrices[0];
+    double _offerPrice = _offerPrices[0];
+    double _bidSize = _bidSizes[0];
+    double _offerSize = _offerSizes[0];
+    double _mid = 0.5 * (_bidPrice + _offerPrice);
+    double _topSize = _bidSize + _offerSize;
+    double _microprice = _topSize > 0 ? (_bidPrice * _offerSize + _offerPrice * _bidSize) / _topSize : _mid;
+
+    // sizes past the loaded levels are zero, so the sums run over a fixed-length contiguous range
+    double _depthBid = 0, _depthOffer = 0;
+    for (size_t i = 0; i < depth; ++i) {
+        _depthBid += _bidSizes[i];
+        _depthOffer += _offerSizes[i];
+    }
+    double _depthTotal = _depthBid + _depthOffer;
+    double _imbalance = _depthTotal > 0 ? (_depthBid - _depthOffer) / _depthTotal : 0.0;
+
+    Slot& _slot = slots[_handle];
+    long _now = ++sequence;
+    if (!_slot.analytics) {
+        _slot.analytics.emplace(_book.GetProduct());
+    } else {
+        // the previous mid was in force until this book arrived
+        _slot.twap.Add(_slot.lastMid, static_cast<double>(_now - _slot.lastSequence));
+    }
+    _slot.vwap.Add(_microprice, _topSize);
+    _slot.lastSequence = _now;
+    _slot.lastMid = _mid;
+
+    _slot.analytics->Set(_mid, _offerPrice - _bidPrice, _microprice, _imbalance, _slot.twap.Mean(_mid),
+                        _slot.vwap.Mean(_mid));
+    OnMessage(*_slot.analytics);
+}
+
+template<typename T>
+ServiceMemoryStats MarketAnalyticsService<T>::MemoryStats() const
+{
+    ServiceMemoryStats _stats;
+    _stats.service = "MarketAnalyticsService";
+    _stats.containerBytes = _stats.peakContainerBytes = slots.capacity() * sizeof(Slot);
+    for (uint32_t i = 0; i < slots.size(); ++i) {
+        if (!slots[i].analytics) continue;
+        size_t _payload = HeapBytes(slots[i].analytics->GetProduct());
+        _stats.entries++;
+        _stats.payloadBytes += _payload;
+        _stats.bytesPerProduct[string(PRODUCT_CUSIPS[i])] = sizeof(Slot) + _payload;
+    }
+    return _stats;
+}
+
+
+/**
+ * @class MarketDataAnalyticsListener
+ * @brief Listener forwarding order books from the MarketDataService to the MarketAnalyticsService.
+ *
+ * @tparam T The product type.
+ */
+template<typename T>
+class MarketDataAnalyticsListener : public ServiceListener<OrderBook<T>>
+{
+public:
+    // Constructor and Destructor
+    MarketDataAnalyticsListener(MarketAnalyticsService<T>* service);
+    ~MarketDataAnalyticsListener();
+
+    // Listener interface methods
+    void ProcessAdd(OrderBook<T>& data);
+    void ProcessRemove(OrderBook<T>& data);
+    void ProcessUpdate(OrderBook<T>& data);
+
+private:
+    MarketAnalyticsService<T>* analytics; ///< Reference to the MarketAnalyticsService
+};
+// **********************************************************************************
+//                  Implementation of MarketDataAnalyticsListener...
+// **********************************************************************************
+template<typename T>
+MarketDataAnalyticsListener<T>::MarketDataAnalyticsListener(MarketAnalyticsService<T>* service)
+{
+    analytics = service;
+}
+
+template<typename T>
+MarketDataAnalyticsListener<T>::~MarketDataAnalyticsListener() {}
+
+template<typename T>
+void MarketDataAnalyticsListener<T>::ProcessAdd(OrderBook<T>& data)
+{
+    TraceSpan _span("MarketDataAnalyticsListener::ProcessAdd");
+    analytics->Update(data);
+}
+
+template<typename T>
+void MarketDataAnalyticsListener<T>::ProcessRemove(OrderBook<T>& data) {}
+
+template<typename T>
+void MarketDataAnalyticsListener<T>::ProcessUpdate(OrderBook<T>& data) {}
+
+#endif //MARKET_ANALYTICS_SERVICE_HPP
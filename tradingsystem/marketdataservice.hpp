@@ -10,16 +10,24 @@
 #ifndef MARKET_DATA_SERVICE_HPP
 #define MARKET_DATA_SERVICE_HPP
 
+#include <array>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include "soa.hpp"
 #include "utils/utils.hpp"
+#include "utils/probes.hpp"
+#include "utils/bulkloader.hpp"
+#include "utils/enumparser.hpp"
 
 using namespace std;
 
 // Side for market data
 enum PricingSide { BID, OFFER };
 
+// Parser for the side column of the market data file
+constexpr EnumParser<PricingSide, 2> PricingSideParser("PricingSide", {{"BID", BID}, {"OFFER", OFFER}});
+
 /**
  * A market data order with price, quantity, and side.
  */
@@ -133,7 +141,7 @@ public:
   // Get the offer stack
   const vector<Order>& GetOfferStack() const;
 
-  const BidOffer& GetBidAsk() const;
+  BidOffer GetBidAsk() const;
 
 private:
   T product;
@@ -170,7 +178,7 @@ const vector<Order>& OrderBook<T>::GetOfferStack() const
 
 
 template<typename T>
-const BidOffer &OrderBook<T>::GetBidAsk() const {
+BidOffer OrderBook<T>::GetBidAsk() const {
     const auto& bids = GetBidStack();
     const auto& asks = GetOfferStack();
 
@@ -189,8 +197,14 @@ const BidOffer &OrderBook<T>::GetBidAsk() const {
         }
     }
 
-    static BidOffer bestBidOffer(*bestBid, *bestOffer);
-    return bestBidOffer;
+    return BidOffer(*bestBid, *bestOffer);
+}
+
+// Heap owned by an order book: its product and its bid and offer stacks
+template<typename T>
+size_t HeapBytes(const OrderBook<T>& _book)
+{
+    return HeapBytes(_book.GetProduct()) + HeapBytes(_book.GetBidStack()) + HeapBytes(_book.GetOfferStack());
 }
 
 
@@ -224,12 +238,16 @@ public:
     MarketDataConnector<T>* GetConnector();
 
     // Additional methods
-    const BidOffer& GetBestBidOffer(const string &productId);
+    BidOffer GetBestBidOffer(const string &productId);
     const OrderBook<T>& AggregateDepth(const string &productId);
     int GetBookDepth() const;
 
+    // Memory held by the service
+    ServiceMemoryStats MemoryStats() const;
+
 private:
-    unordered_map<string, OrderBook<T>> orderBooks;  ///< Order books keyed by product identifier
+    CountingResource memory;                              ///< Tagged allocator of the store
+    pmr::unordered_map<string, OrderBook<T>> orderBooks;  ///< Order books keyed by product identifier
     vector<ServiceListener<OrderBook<T>>*> listeners; ///< Listeners for market data updates
     MarketDataConnector<T>* connector;               ///< Connector for market data
     int bookDepth;                                   ///< Depth of the order book
@@ -241,9 +259,9 @@ private:
 //                  Implementation of OrderBook...
 // **********************************************************************************
 template<typename T>
-MarketDataService<T>::MarketDataService()
+MarketDataService<T>::MarketDataService() :
+        orderBooks(&memory)
 {
-    orderBooks = unordered_map<string, OrderBook<T>>();
     listeners = vector<ServiceListener<OrderBook<T>>*>();
     connector = new MarketDataConnector<T>(this);
     bookDepth = 5;
@@ -252,6 +270,12 @@ MarketDataService<T>::MarketDataService()
 template<typename T>
 MarketDataService<T>::~MarketDataService() {}
 
+template<typename T>
+ServiceMemoryStats MarketDataService<T>::MemoryStats() const
+{
+    return CollectMemoryStats("MarketDataService", memory, orderBooks);
+}
+
 template<typename T>
 int MarketDataService<T>::GetBookDepth() const
 {
@@ -291,6 +315,8 @@ OrderBook<T>& MarketDataService<T>::GetData(string key)
 template<typename T>
 void MarketDataService<T>::OnMessage(OrderBook<T>& data)
 {
+    TraceSpan _span("MarketDataService::OnMessage");
+    ServiceProbe _probe(PROBE_ORDER_BOOK, data.GetProduct());
     string productId = data.GetProduct().GetProductId();
 
     auto it = orderBooks.find(productId);
@@ -310,7 +336,7 @@ void MarketDataService<T>::OnMessage(OrderBook<T>& data)
 
 // #### GET BEST BID OFFER FUNCTION #####
 template<typename T>
-const BidOffer& MarketDataService<T>::GetBestBidOffer(const string& _productId)
+BidOffer MarketDataService<T>::GetBestBidOffer(const string& _productId)
 {
     const auto& bids = orderBooks[_productId].GetBidStack();
     const auto& asks = orderBooks[_productId].GetOfferStack();
@@ -339,8 +365,7 @@ const BidOffer& MarketDataService<T>::GetBestBidOffer(const string& _productId)
     }
 
     // Construct and return BidOffer
-    static BidOffer bestBidOffer(*bestBid, *bestOffer);
-    return bestBidOffer;
+    return BidOffer(*bestBid, *bestOffer);
 }
 
 // ####### AGGREGATE DEPTH ######
@@ -396,8 +421,8 @@ public:
 private:
     MarketDataService<T>* mkt; ///< Reference to the associated MarketDataService
 
-    // Helper methods for parsing and creating orders
-    std::tuple<std::string, double, long, PricingSide> ParseLine(const std::string& line);
+    // Helper methods for parsing and creating orders; parsing runs on the bulk loader threads
+    static std::tuple<std::string, double, long, PricingSide> ParseLine(const std::string& line);
     Order CreateOrder(const std::tuple<std::string, double, long, PricingSide>& orderData);
 };
 // **********************************************************************************
@@ -428,7 +453,7 @@ std::tuple<std::string, double, long, PricingSide> MarketDataConnector<T>::Parse
     std::string productId = cells[0];
     double price = ConvertBondPrice(cells[1]);
     long quantity = std::stol(cells[2]);
-    PricingSide side = (cells[3] == "BID" || cells[3] == "BID\r") ? BID : OFFER;
+    PricingSide side = PricingSideParser.Parse(cells[3]);
 
     return std::make_tuple(productId, price, quantity, side);
 }
@@ -446,29 +471,47 @@ template<typename T>
 void MarketDataConnector<T>::Subscribe(std::ifstream& data) {
     int _bookDepth = mkt->GetBookDepth();
     int _thread = _bookDepth * 2;
-    long _count = 0;
-    std::vector<Order> _bidStack;
-    std::vector<Order> _offerStack;
-    std::string _line;
 
-    while (std::getline(data, _line)) {
-        auto orderData = ParseLine(_line);
+    // a product's book is assembled from its own lines only, so an interleaved feed still
+    // builds every book while books reach the services in file (time) order
+    struct PendingBook
+    {
+        long count = 0;
+        std::vector<Order> bidStack;
+        std::vector<Order> offerStack;
+    };
+    std::array<PendingBook, PRODUCT_COUNT> _pending;
+
+    // lines are parsed in parallel, orders arrive in file order
+    BulkLoader<std::tuple<std::string, double, long, PricingSide>> _loader;
+    _loader.Load(data,
+                 [](std::string_view _line) { return ParseLine(std::string(_line)); },
+                 [&](const auto& orderData)
+    {
+        ProbeRecord(PROBE_ORDER_BOOK, std::get<0>(orderData));
+        uint32_t _handle = GetProductHandle(std::get<0>(orderData));
+        if (_handle == INVALID_PRODUCT_HANDLE) {
+            throw std::runtime_error("Unknown product in market data: " + std::get<0>(orderData));
+        }
+        PendingBook& _book = _pending[_handle];
         Order order = CreateOrder(orderData);
         PricingSide side = std::get<3>(orderData);
         if (side == BID)
-            _bidStack.push_back(order);
+            _book.bidStack.push_back(order);
         else
-            _offerStack.push_back(order);
+            _book.offerStack.push_back(order);
 
-        _count++;
-        if (_count % _thread == 0) {
+        _book.count++;
+        if (_book.count % _thread == 0) {
+            // one message per assembled book, so every sampled ID reaches the services
+            TraceMessage _trace("MarketDataConnector");
             T _product = GetBond(std::get<0>(orderData));
-            OrderBook<T> _orderBook(_product, _bidStack, _offerStack);
+            OrderBook<T> _orderBook(_product, _book.bidStack, _book.offerStack);
             mkt->OnMessage(_orderBook);
-            _bidStack.clear();
-            _offerStack.clear();
+            _book.bidStack.clear();
+            _book.offerStack.clear();
         }
-    }
+    });
 }
 
 
@@ -15,6 +15,7 @@
 #include "soa.hpp"
 #include "tradebookingservice.hpp"
 #include "utils/utils.hpp"
+#include "utils/probes.hpp"
 using namespace std;
 
 /**
@@ -49,6 +50,9 @@ public:
     const map<string, long>& GetPositions() const;
 
     vector<string> HDFormat() const;
+
+    // Book and quantity pairs that changed since _previous, after the product ID
+    vector<string> HDDeltaFormat(const Position<T>& _previous) const;
 private:
   T product;
   map<string,long> positions;
@@ -78,6 +82,34 @@ vector<string> Position<T>::HDFormat() const {
     return formattedOutput;
 }
 
+template<typename T>
+vector<string> Position<T>::HDDeltaFormat(const Position<T>& _previous) const {
+    vector<string> formattedOutput;
+    formattedOutput.push_back(product.GetProductId());
+
+    // both maps are sorted by book, walk them together
+    auto _before = _previous.positions.begin();
+    for (const auto& positionPair : positions) {
+        while (_before != _previous.positions.end() && _before->first < positionPair.first) {
+            formattedOutput.push_back(_before->first);
+            formattedOutput.push_back("0");
+            ++_before;
+        }
+        bool _known = _before != _previous.positions.end() && _before->first == positionPair.first;
+        if (!_known || _before->second != positionPair.second) {
+            formattedOutput.push_back(positionPair.first);
+            formattedOutput.push_back(std::to_string(positionPair.second));
+        }
+        if (_known) ++_before;
+    }
+    for (; _before != _previous.positions.end(); ++_before) {
+        formattedOutput.push_back(_before->first);
+        formattedOutput.push_back("0");
+    }
+
+    return formattedOutput;
+}
+
 template<typename T>
 Position<T>::Position(const T& _product) :
   product(_product)
@@ -123,6 +155,13 @@ const map<string, long>& Position<T>::GetPositions() const {
     return positions;
 }
 
+// Heap owned by a position: its product and the per-book map
+template<typename T>
+size_t HeapBytes(const Position<T>& _position)
+{
+    return HeapBytes(_position.GetProduct()) + HeapBytes(_position.GetPositions());
+}
+
 
 
 
@@ -155,10 +194,14 @@ public:
 
     // Additional service methods
     void AddTrade(const Trade<T> &trade);
-    const unordered_map<string, Position<T>>& GetPositions() const;
+    const pmr::unordered_map<string, Position<T>>& GetPositions() const;
+
+    // Memory held by the service
+    ServiceMemoryStats MemoryStats() const;
 
 private:
-    unordered_map<string, Position<T>> positions;  ///< Positions keyed by product identifier
+    CountingResource memory;                            ///< Tagged allocator of the store
+    pmr::unordered_map<string, Position<T>> positions;  ///< Positions keyed by product identifier
     vector<ServiceListener<Position<T>>*> listeners; ///< Listeners for position updates
     TradeBookingPosListener<T>* bookListener; ///< Listener for trade booking updates
 
@@ -170,14 +213,15 @@ private:
 //                  Implementation of PositionService...
 // **********************************************************************************
 template<typename T>
-const unordered_map<string, Position<T>>& PositionService<T>::GetPositions() const {
+const pmr::unordered_map<string, Position<T>>& PositionService<T>::GetPositions() const {
     return positions;
 }
 
 
 template<typename T>
-PositionService<T>::PositionService() {
-    positions = unordered_map<string, Position<T>>();
+PositionService<T>::PositionService() :
+        positions(&memory)
+{
     listeners = vector<ServiceListener<Position<T>>*>();
     bookListener = new TradeBookingPosListener<T>(this);
 }
@@ -185,6 +229,12 @@ PositionService<T>::PositionService() {
 template<typename T>
 PositionService<T>::~PositionService(){}
 
+template<typename T>
+ServiceMemoryStats PositionService<T>::MemoryStats() const
+{
+    return CollectMemoryStats("PositionService", memory, positions);
+}
+
 template<typename T>
 void PositionService<T>::AddListener(ServiceListener<Position<T>>* listener)
 {
@@ -208,6 +258,7 @@ Position<T>& PositionService<T>::GetData(std::string key){
 
 template<typename T>
 void PositionService<T>::OnMessage(Position<T> &data) {
+    ServiceProbe _probe(PROBE_POSITION, data.GetProduct());
     std::string productId = data.GetProduct().GetProductId();
 
     // Check if the position already exists in the map
@@ -233,7 +284,7 @@ const std::vector<ServiceListener<Position<T>>*>& PositionService<T>::GetListene
 
 template<typename T>
 void PositionService<T>::UpdatePositionFromTrade(const Trade<T>& trade, Position<T>& position) {
-    string book = trade.GetBook();
+    string book(trade.GetBook());
     long quantity = trade.GetQuantity();
     Side side = trade.GetSide();
 
@@ -258,6 +309,8 @@ void PositionService<T>::MergePositions(const Position<T>& fromPosition, Positio
 
 template<typename T>
 void PositionService<T>::AddTrade(const Trade<T>& trade) {
+    TraceSpan _span("PositionService::AddTrade");
+    ServiceProbe _probe(PROBE_TRADE, trade.GetProduct());
     T product = trade.GetProduct();
     string productId = product.GetProductId();
 
@@ -319,21 +372,21 @@ TradeBookingPosListener<T>::~TradeBookingPosListener() {}
 template<typename T>
 void TradeBookingPosListener<T>::ProcessAdd(Trade<T>& data)
 {
-
-    //printInYellow("Position Listener Triggered");
+    LOG(LEVEL_DEBUG, "Position listener triggered for trade {}", data.GetTradeId());
 
     pos->AddTrade(data);
 
     // DEBUG PRINTING
-   /* const auto& positions = pos->GetPositions();
-    for (const auto& pair : positions) {
-        const auto& position = pair.second;
-        cout << "Product: " << pair.first << endl;
-        for (const auto& bookPos : position.GetPositions()) {
-            cout << "  Book: " << bookPos.first << ", Quantity: " << bookPos.second << endl;
+    if (GetLogger().Enabled(LEVEL_DEBUG)) {
+        const auto& positions = pos->GetPositions();
+        for (const auto& pair : positions) {
+            const auto& position = pair.second;
+            LOG(LEVEL_DEBUG, "Product: {} Aggregate Position: {}", pair.first, position.GetAggregatePosition());
+            for (const auto& bookPos : position.GetPositions()) {
+                LOG(LEVEL_DEBUG, "  Book: {}, Quantity: {}", bookPos.first, bookPos.second);
+            }
         }
-        cout << "  Aggregate Position: " << position.GetAggregatePosition() << endl;
-    }*/
+    }
 }
 
 template<typename T>
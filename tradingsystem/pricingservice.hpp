@@ -10,12 +10,18 @@
 #ifndef PRICING_SERVICE_HPP
 #define PRICING_SERVICE_HPP
 
+#include <array>
+#include <cmath>
 #include <string>
 #include "soa.hpp"
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <tuple>
 #include "utils/utils.hpp" // convert bond prices
+#include "utils/probes.hpp"
+#include "utils/bulkloader.hpp"
+#include "utils/tickvalidator.hpp"
 /**
  * A price object consisting of mid and bid/offer spread.
  * Type T is the product type.
@@ -102,10 +108,91 @@ vector<string> Price<T>::GuiOut() const {
 
 
 
+/**
+ * A price tick rejected by the validation of the price feed, with the reasons as TickReject flags.
+ */
+class QuarantinedTick
+{
+public:
+    QuarantinedTick(const string& _productId, double _bid, double _ask, long _millis, uint8_t _reasons);
+
+    const string& GetProductId() const;
+    double GetBid() const;
+    double GetAsk() const;
+    long GetMillis() const;
+    uint8_t GetReasons() const;
+
+    // Formatted output for logs and files
+    vector<string> HDFormat() const;
+
+private:
+    string productId;
+    double bid;
+    double ask;
+    long millis;
+    uint8_t reasons;
+};
+// **********************************************************************************
+//                  Implementation of QuarantinedTick...
+// **********************************************************************************
+QuarantinedTick::QuarantinedTick(const string& _productId, double _bid, double _ask, long _millis, uint8_t _reasons)
+{
+    productId = _productId;
+    bid = _bid;
+    ask = _ask;
+    millis = _millis;
+    reasons = _reasons;
+}
+
+const string& QuarantinedTick::GetProductId() const
+{
+    return productId;
+}
+
+double QuarantinedTick::GetBid() const
+{
+    return bid;
+}
+
+double QuarantinedTick::GetAsk() const
+{
+    return ask;
+}
+
+long QuarantinedTick::GetMillis() const
+{
+    return millis;
+}
+
+uint8_t QuarantinedTick::GetReasons() const
+{
+    return reasons;
+}
+
+vector<string> QuarantinedTick::HDFormat() const
+{
+    return {productId, FormatPrice(bid), FormatPrice(ask), to_string(millis), FormatTickReject(reasons)};
+}
+
+
 // Forward declaration of PricingConnector
 template<typename T>
 class PricingConnector; // fwd declaration (writing in this file)
 
+// Upper bound on the price sources of a product
+constexpr size_t MAX_PRICE_SOURCES = 8;
+
+/**
+ * @struct PriceSource
+ * @brief A price stream feeding the composite price: its quality and how fast its prices go stale.
+ */
+struct PriceSource
+{
+    string name;
+    double quality;          ///< Weight of a fresh price
+    double halfLifeMillis;   ///< Age halving the weight of a price, 0 for prices that never go stale
+};
+
 /**
  * @class PricingService
  * @brief Manages and distributes mid prices and bid/offers for financial products.
@@ -113,6 +200,12 @@ class PricingConnector; // fwd declaration (writing in this file)
  * This service is responsible for managing pricing information, specifically mid prices and bid/offer spreads,
  * and notifying listeners about price updates. It is keyed on the product identifier.
  *
+ * Each product keeps the last price of every source. The stored price is the composite: the mid
+ * and spread of the sources weighted by quality * 2^(-age / half-life). An update touches the
+ * sources of its product only, and listeners are notified only when the composite moves, so
+ * repeated prices stop here. The connector feeds the primary source; other streams register
+ * with AddSource and publish through OnSourceMessage.
+ *
  * @tparam T The type of the financial product.
  */
 template<typename T>
@@ -123,31 +216,78 @@ public:
     PricingService();
     ~PricingService();
 
-    // Service interface methods
+    // Service interface methods; OnMessage publishes on the primary source
     Price<T>& GetData(std::string key);
     void OnMessage(Price<T>& data);
     void AddListener(ServiceListener<Price<T>>* listener);
     const std::vector<ServiceListener<Price<T>>*>& GetListeners() const;
     PricingConnector<T>* GetConnector();
 
+    // Memory held by the service
+    ServiceMemoryStats MemoryStats() const;
+
+    // Register a price source, returning its id; the primary source has id PRIMARY_SOURCE
+    size_t AddSource(const string& _name, double _quality, double _halfLifeMillis);
+    const PriceSource& GetSource(size_t _source) const;
+
+    // Update the price of a product from a source and publish the composite if it moved
+    void OnSourceMessage(Price<T>& data, size_t _source);
+
+    // Source updates that left the composite unchanged
+    long GetSuppressedCount() const;
+
+    // Validation of the ticks read by the connector, and listeners for the ticks it rejects
+    TickValidator& GetValidator();
+    void AddQuarantineListener(ServiceListener<QuarantinedTick>* listener);
+    void Quarantine(QuarantinedTick& tick);
+
+    static constexpr size_t PRIMARY_SOURCE = 0;
+
 private:
-    std::unordered_map<std::string, Price<T>> prices;  ///< Map of prices keyed by product identifier.
+    /// Last price of a source for a product
+    struct SourceQuote
+    {
+        double mid = 0;
+        double spread = 0;
+        long millis = 0;
+        bool valid = false;
+    };
+
+    CountingResource memory;                                ///< Tagged allocator of the store
+    std::pmr::unordered_map<std::string, Price<T>> prices;  ///< Map of composite prices keyed by product identifier.
     std::vector<ServiceListener<Price<T>>*> listeners; ///< Listeners for price updates.
     PricingConnector<T>* connector;                    ///< Connector for reading price data.
+    std::vector<PriceSource> sources;                  ///< Registered sources, by id
+    std::array<std::array<SourceQuote, MAX_PRICE_SOURCES>, PRODUCT_COUNT> quotes; ///< [handle][source]
+    long suppressed;
+    TickValidator validator;                                      ///< Checks of the connector ticks
+    std::vector<ServiceListener<QuarantinedTick>*> quarantine;    ///< Listeners for rejected ticks
+
+    // Store the composite and notify listeners
+    void Publish(Price<T>& data);
 };
 // **********************************************************************************
 //                  Implementation of PricingService...
 // **********************************************************************************
 template<typename T>
-PricingService<T>::PricingService() {
-    prices = std::unordered_map<std::string, Price<T>>();
+PricingService<T>::PricingService() :
+        prices(&memory)
+{
     listeners = std::vector<ServiceListener<Price<T>>*>();
     connector = new PricingConnector<T>(this); // passing the context to the Pricing Connector
+    suppressed = 0;
+    AddSource("primary", 1.0, 0.0);
 }
 
 template<typename T>
 PricingService<T>::~PricingService() {}
 
+template<typename T>
+ServiceMemoryStats PricingService<T>::MemoryStats() const
+{
+    return CollectMemoryStats("PricingService", memory, prices);
+}
+
 // Getter for the map
 template<typename T>
 Price<T>& PricingService<T>::GetData(std::string key) // return Price obj
@@ -174,8 +314,101 @@ void PricingService<T>::AddListener(ServiceListener<Price<T>>* listener)
     listeners.push_back(listener);
 }
 
+template<typename T>
+size_t PricingService<T>::AddSource(const string& _name, double _quality, double _halfLifeMillis)
+{
+    if (sources.size() == MAX_PRICE_SOURCES) {
+        throw std::runtime_error("Too many price sources: " + _name);
+    }
+    if (!(_quality > 0) || _halfLifeMillis < 0) {
+        throw std::runtime_error("Invalid quality or half-life for price source: " + _name);
+    }
+    sources.push_back(PriceSource{_name, _quality, _halfLifeMillis});
+    return sources.size() - 1;
+}
+
+template<typename T>
+const PriceSource& PricingService<T>::GetSource(size_t _source) const
+{
+    return sources.at(_source);
+}
+
+template<typename T>
+long PricingService<T>::GetSuppressedCount() const
+{
+    return suppressed;
+}
+
+template<typename T>
+TickValidator& PricingService<T>::GetValidator()
+{
+    return validator;
+}
+
+template<typename T>
+void PricingService<T>::AddQuarantineListener(ServiceListener<QuarantinedTick>* listener)
+{
+    quarantine.push_back(listener);
+}
+
+template<typename T>
+void PricingService<T>::Quarantine(QuarantinedTick& tick)
+{
+    for (auto listener : quarantine) {
+        listener->ProcessAdd(tick);
+    }
+}
+
 template<typename T>
 void PricingService<T>::OnMessage(Price<T> &data) {
+    OnSourceMessage(data, PRIMARY_SOURCE);
+}
+
+template<typename T>
+void PricingService<T>::OnSourceMessage(Price<T>& data, size_t _source)
+{
+    TraceSpan _span("PricingService::OnMessage");
+    if (_source >= sources.size()) {
+        throw std::runtime_error("Unknown price source " + to_string(_source));
+    }
+    uint32_t _handle = GetProductHandle(data.GetProduct().GetProductId());
+    if (_handle == INVALID_PRODUCT_HANDLE) {
+        // no source slots for products outside the universe: the latest price wins
+        Publish(data);
+        return;
+    }
+
+    long _now = GetCurrentTimeMillis();
+    auto& _quotes = quotes[_handle];
+    _quotes[_source] = SourceQuote{data.GetMid(), data.GetBidOfferSpread(), _now, true};
+
+    // weighted mean around the updating source, exact when it is the only one
+    double _weights = 0, _midShift = 0, _spreadShift = 0;
+    for (size_t s = 0; s < sources.size(); ++s) {
+        const SourceQuote& _quote = _quotes[s];
+        if (!_quote.valid) continue;
+        double _weight = sources[s].quality;
+        if (sources[s].halfLifeMillis > 0) _weight *= exp2(-(_now - _quote.millis) / sources[s].halfLifeMillis);
+        _weights += _weight;
+        _midShift += _weight * (_quote.mid - data.GetMid());
+        _spreadShift += _weight * (_quote.spread - data.GetBidOfferSpread());
+    }
+    double _mid = data.GetMid() + _midShift / _weights;
+    double _spread = data.GetBidOfferSpread() + _spreadShift / _weights;
+
+    auto it = prices.find(data.GetProduct().GetProductId());
+    if (it != prices.end() && it->second.GetMid() == _mid && it->second.GetBidOfferSpread() == _spread) {
+        suppressed++;
+        return;
+    }
+    Price<T> _composite(data.GetProduct(), _mid, _spread);
+    Publish(_composite);
+}
+
+template<typename T>
+void PricingService<T>::Publish(Price<T>& data)
+{
+    ServiceProbe _probe(PROBE_PRICE, data.GetProduct());
     std::string productId = data.GetProduct().GetProductId();
     auto it = prices.find(productId);
     if (it != prices.end()) {
@@ -205,7 +438,9 @@ const std::vector<ServiceListener<Price<T>>*>& PricingService<T>::GetListeners()
  *
  * This class is responsible for reading and processing incoming price data, and updating
  * the PricingService with new price information. It handles the input data stream and parses
- * price information from it.
+ * price information from it. Parsed ticks are validated in batches of TickValidator::BATCH
+ * before they reach the service; rejected ticks go to the quarantine listeners instead.
+ * Lines are productId,bid,ask with an optional fourth column of epoch milliseconds.
  *
  * @tparam T The type of the financial product.
  */
@@ -223,10 +458,11 @@ public:
 private:
     PricingService<T>* pricing;  ///< Reference to the associated PricingService.
 
-    // Internal methods for processing data
-    void ProcessLine(const string& _line);
-    vector<string> SplitLine(std::stringstream& _lineStream);
-    void ProcessCells(const vector<string>& _cells);
+    // Internal methods for processing data; parsing runs on the bulk loader threads
+    static std::tuple<std::string, double, double, long> ParseLine(const std::string& _line);
+    static vector<string> SplitLine(std::stringstream& _lineStream);
+    void ProcessBatch(std::vector<std::tuple<std::string, double, double, long>>& _batch);
+    void ProcessRecord(const std::tuple<std::string, double, double, long>& _record);
 };
 // **********************************************************************************
 //                  Implementation of PricingConnector...
@@ -241,25 +477,59 @@ PricingConnector<T>::PricingConnector(PricingService<T> *service) {
 template<typename T>
 void PricingConnector<T>::Subscribe(std::ifstream& data)
 {
-    //std::cout << "Subscribed called" << std::endl;
-    std::string _line;
-    while (std::getline(data, _line))
-    {
-        //std::cout << "streaming line..." << std::endl;
-        ProcessLine(_line);
+    // lines are parsed in parallel, prices reach the service in file order
+    BulkLoader<std::tuple<std::string, double, double, long>> _loader;
+    std::vector<std::tuple<std::string, double, double, long>> _batch;
+    _batch.reserve(TickValidator::BATCH);
+    _loader.Load(data,
+                 [](std::string_view _line) { return ParseLine(std::string(_line)); },
+                 [this, &_batch](const std::tuple<std::string, double, double, long>& _record) {
+                     _batch.push_back(_record);
+                     if (_batch.size() == TickValidator::BATCH) ProcessBatch(_batch);
+                 });
+    ProcessBatch(_batch);
+}
+
+template<typename T>
+void PricingConnector<T>::ProcessBatch(std::vector<std::tuple<std::string, double, double, long>>& _batch)
+{
+    // lay the batch out as arrays for the validator
+    constexpr size_t N = TickValidator::BATCH;
+    uint32_t _handles[N];
+    double _bids[N], _asks[N];
+    long _millis[N];
+    uint8_t _reasons[N];
+    for (size_t i = 0; i < _batch.size(); ++i) {
+        _handles[i] = GetProductHandle(std::get<0>(_batch[i]));
+        _bids[i] = std::get<1>(_batch[i]);
+        _asks[i] = std::get<2>(_batch[i]);
+        _millis[i] = std::get<3>(_batch[i]);
+    }
+    pricing->GetValidator().Validate(_batch.size(), _handles, _bids, _asks, _millis, _reasons);
+
+    for (size_t i = 0; i < _batch.size(); ++i) {
+        if (_reasons[i] == TICK_OK) {
+            ProcessRecord(_batch[i]);
+        } else {
+            QuarantinedTick _tick(std::get<0>(_batch[i]), _bids[i], _asks[i], _millis[i], _reasons[i]);
+            pricing->Quarantine(_tick);
+        }
     }
-    //std::cout << "finshed" << std::endl;
+    _batch.clear();
 }
 template<typename T>
 void PricingConnector<T>::Publish(Price<T> &data) {}
 
 // processing functions
 template<typename T>
-void PricingConnector<T>::ProcessLine(const std::string& _line)
+std::tuple<std::string, double, double, long> PricingConnector<T>::ParseLine(const std::string& _line)
 {
     std::stringstream _lineStream(_line);
     std::vector<std::string> _cells = SplitLine(_lineStream);
-    ProcessCells(_cells);
+    double bid = ConvertBondPrice(_cells[1]); // convert the price function
+    double ask = ConvertBondPrice(_cells[2]);
+    long millis = _cells.size() > 3 ? std::stol(_cells[3]) : 0;
+    return std::make_tuple(_cells[0], bid, ask, millis);
 }
 
 template<typename T>
@@ -275,11 +545,11 @@ std::vector<std::string> PricingConnector<T>::SplitLine(std::stringstream& _line
 }
 
 template<typename T>
-void PricingConnector<T>::ProcessCells(const std::vector<std::string>& _cells)
+void PricingConnector<T>::ProcessRecord(const std::tuple<std::string, double, double, long>& _record)
 {
-    std::string _productId = _cells[0];
-    double bid = ConvertBondPrice(_cells[1]); // convert the price function
-    double ask = ConvertBondPrice(_cells[2]);
+    TraceMessage _trace("PricingConnector");
+    ProbeRecord(PROBE_PRICE, std::get<0>(_record));
+    const auto& [_productId, bid, ask, millis] = _record;
     double mid = (bid + ask) / 2.0; // get mid
     double spread = ask - bid;
 
@@ -289,4 +559,29 @@ void PricingConnector<T>::ProcessCells(const std::vector<std::string>& _cells)
     pricing->OnMessage(_price);
 }
 
+
+/**
+ * @class QuarantineLogListener
+ * @brief Listener logging the ticks rejected by the validation of the price feed.
+ */
+class QuarantineLogListener : public ServiceListener<QuarantinedTick>
+{
+public:
+    void ProcessAdd(QuarantinedTick& data);
+    void ProcessRemove(QuarantinedTick& data);
+    void ProcessUpdate(QuarantinedTick& data);
+};
+// **********************************************************************************
+//                  Implementation of QuarantineLogListener...
+// **********************************************************************************
+void QuarantineLogListener::ProcessAdd(QuarantinedTick& data)
+{
+    LOG(LEVEL_WARNING, "Quarantined tick {} bid {} ask {}: {}", data.GetProductId(), data.GetBid(), data.GetAsk(),
+        FormatTickReject(data.GetReasons()));
+}
+
+void QuarantineLogListener::ProcessRemove(QuarantinedTick& data) {}
+
+void QuarantineLogListener::ProcessUpdate(QuarantinedTick& data) {}
+
 #endif
@@ -0,0 +1,736 @@
+/**
+ * @file queryserver.hpp
+ * @brief Defines the local query server answering reads of the service state over a Unix socket.
+ *
+ * This file includes the binary records of the query protocol, the QueryServer, which keeps
+ * lock-free snapshots of positions, PV01s, top of book and inquiry states and serves them from
+ * its own thread, and the listeners feeding the snapshots from the services.
+ *
+ * @author Niccolo Fabbri
+ */
+#ifndef QUERY_SERVER_HPP
+#define QUERY_SERVER_HPP
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "soa.hpp"
+#include "positionservice.hpp"
+#include "riskservice.hpp"
+#include "marketdataservice.hpp"
+#include "inquiryservice.hpp"
+#include "utils/seqlock.hpp"
+
+using namespace std;
+
+// Kinds of query; a request names a kind and a product handle, or QUERY_ALL_PRODUCTS
+enum QueryKind : uint8_t { QUERY_POSITION = 1, QUERY_PV01, QUERY_TOP_OF_BOOK, QUERY_INQUIRIES, QUERY_BOOKS };
+enum QueryStatus : uint8_t { QUERY_OK = 0, QUERY_UNKNOWN_KIND, QUERY_UNKNOWN_PRODUCT, QUERY_NO_DATA };
+constexpr uint8_t QUERY_ALL_PRODUCTS = 0xFF;
+constexpr size_t QUERY_MAX_BOOKS = 8;
+constexpr size_t QUERY_INQUIRY_STATES = 5;
+
+// Wire records, in host byte order: a 4-byte request is answered by a header and count records
+struct QueryRequest
+{
+    uint8_t kind;
+    uint8_t product;
+    uint16_t reserved;
+};
+
+struct QueryResponseHeader
+{
+    uint8_t kind;
+    uint8_t status;
+    uint16_t count;   ///< Records following the header
+    uint32_t bytes;   ///< Bytes following the header
+};
+
+// Every snapshot carries the number of updates behind it, 0 for a product never seen
+struct PositionSnapshot
+{
+    uint32_t handle;
+    uint32_t version;
+    int64_t aggregate;
+    int64_t books[QUERY_MAX_BOOKS];  ///< Quantity by book id, see QUERY_BOOKS
+};
+
+struct Pv01Snapshot
+{
+    uint32_t handle;
+    uint32_t version;
+    double pv01;
+    int64_t quantity;
+    double yield;    ///< Yield the PV01 was computed at
+};
+
+struct TopOfBookSnapshot
+{
+    uint32_t handle;
+    uint32_t version;
+    double bid;
+    double offer;
+    int64_t bidQuantity;
+    int64_t offerQuantity;
+};
+
+struct InquirySnapshot
+{
+    uint32_t handle;
+    uint32_t version;
+    uint32_t states[QUERY_INQUIRY_STATES];  ///< Inquiries currently in each InquiryState
+    uint32_t reserved;
+};
+
+struct BookSnapshot
+{
+    char names[QUERY_MAX_BOOKS][16];  ///< Book names by book id, NUL padded
+    uint32_t count;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(QueryRequest) == 4 && sizeof(QueryResponseHeader) == 8, "packed protocol headers");
+static_assert(sizeof(PositionSnapshot) == 80 && sizeof(Pv01Snapshot) == 32 && sizeof(TopOfBookSnapshot) == 40
+              && sizeof(InquirySnapshot) == 32 && sizeof(BookSnapshot) == 136, "packed protocol records");
+
+// Forward declarations
+template<typename T>
+class PositionQueryListener;
+template<typename T>
+class RiskQueryListener;
+template<typename T>
+class MarketDataQueryListener;
+template<typename T>
+class InquiryQueryListener;
+
+/**
+ * @class QueryServer
+ * @brief Serves point and bulk reads of the trading state without touching the services.
+ *
+ * The listeners copy each update into a per-product SeqLock snapshot on the trading thread,
+ * a few stores per message. The server thread runs a poll loop on a Unix-domain stream
+ * socket and answers every request from the snapshots, so a client never takes a lock or
+ * calls into a service, and a slow client only delays itself. A bulk answer is consistent
+ * per product, not across products.
+ *
+ * Requests are 4-byte QueryRequest records and may be pipelined; each is answered by a
+ * QueryResponseHeader followed by its records.
+ *
+ * @tparam T The product type.
+ */
+template<typename T>
+class QueryServer
+{
+public:
+    static constexpr size_t MAX_CLIENTS = 64;
+    static constexpr size_t MAX_PENDING_BYTES = 1 << 20;  ///< Unread answers before a client is dropped
+
+    // Constructor and destructor
+    QueryServer();
+    ~QueryServer();
+
+    // Listeners feeding the snapshots
+    PositionQueryListener<T>* GetPositionListener();
+    RiskQueryListener<T>* GetRiskListener();
+    MarketDataQueryListener<T>* GetMarketDataListener();
+    InquiryQueryListener<T>* GetInquiryListener();
+
+    // Update the snapshots, from the trading thread
+    void OnPosition(const Position<T>& _position);
+    void OnPV01(const PV01<T>& _pv01);
+    void OnOrderBook(const OrderBook<T>& _book);
+    void OnInquiry(const Inquiry<T>& _inquiry);
+
+    // Listen on a Unix socket at _path and serve it on a background thread
+    void Start(const string& _path);
+    void Stop();
+    bool IsRunning() const;
+
+    // Append the answer to a request to _out, from any thread
+    void Answer(const QueryRequest& _request, vector<char>& _out) const;
+
+    // Forget the intraday inquiries and zero their counts
+    void EndOfDay();
+
+private:
+    struct Client
+    {
+        int fd;
+        vector<char> in;
+        vector<char> out;
+        size_t sent;
+        bool closed;  ///< The client shut down its side: close once its answers are sent
+    };
+
+    array<SeqLock<PositionSnapshot>, PRODUCT_COUNT> positions;
+    array<SeqLock<Pv01Snapshot>, PRODUCT_COUNT> pv01s;
+    array<SeqLock<TopOfBookSnapshot>, PRODUCT_COUNT> tops;
+    array<SeqLock<InquirySnapshot>, PRODUCT_COUNT> inquiries;
+    SeqLock<BookSnapshot> books;
+
+    // Writer side state, trading thread only
+    BookSnapshot bookNames;
+    array<InquirySnapshot, PRODUCT_COUNT> inquiryCounts;
+    unordered_map<string_view, pair<uint32_t, InquiryState>> inquiryStates;  ///< Product handle and state of each inquiry, keyed by arena-owned ID
+
+    PositionQueryListener<T>* positionListener;
+    RiskQueryListener<T>* riskListener;
+    MarketDataQueryListener<T>* marketDataListener;
+    InquiryQueryListener<T>* inquiryListener;
+
+    string path;
+    int listenFd;
+    int wakeFds[2];
+    atomic<bool> running;
+    thread worker;
+
+    // Book id of a book name, QUERY_MAX_BOOKS once the ids are used up
+    uint32_t GetBookId(const string& _book);
+
+    void Run();
+    void Accept(vector<Client>& _clients);
+    bool Read(Client& _client);
+    bool Flush(Client& _client);
+};
+// **********************************************************************************
+//                  Implementation of QueryServer...
+// **********************************************************************************
+template<typename T>
+QueryServer<T>::QueryServer() :
+        bookNames(), inquiryCounts(), listenFd(-1), wakeFds{-1, -1}, running(false)
+{
+    positionListener = new PositionQueryListener<T>(this);
+    riskListener = new RiskQueryListener<T>(this);
+    marketDataListener = new MarketDataQueryListener<T>(this);
+    inquiryListener = new InquiryQueryListener<T>(this);
+}
+
+template<typename T>
+QueryServer<T>::~QueryServer()
+{
+    Stop();
+}
+
+template<typename T>
+PositionQueryListener<T>* QueryServer<T>::GetPositionListener()
+{
+    return positionListener;
+}
+
+template<typename T>
+RiskQueryListener<T>* QueryServer<T>::GetRiskListener()
+{
+    return riskListener;
+}
+
+template<typename T>
+MarketDataQueryListener<T>* QueryServer<T>::GetMarketDataListener()
+{
+    return marketDataListener;
+}
+
+template<typename T>
+InquiryQueryListener<T>* QueryServer<T>::GetInquiryListener()
+{
+    return inquiryListener;
+}
+
+template<typename T>
+uint32_t QueryServer<T>::GetBookId(const string& _book)
+{
+    // names are stored truncated, so match on the same prefix
+    constexpr size_t _length = sizeof(bookNames.names[0]) - 1;
+    string_view _name = string_view(_book).substr(0, _length);
+    for (uint32_t i = 0; i < bookNames.count; ++i) {
+        if (_name == bookNames.names[i]) return i;
+    }
+    if (bookNames.count == QUERY_MAX_BOOKS) return QUERY_MAX_BOOKS;
+    strncpy(bookNames.names[bookNames.count], _book.c_str(), _length);
+    bookNames.count++;
+    books.Store(bookNames);
+    return bookNames.count - 1;
+}
+
+template<typename T>
+void QueryServer<T>::OnPosition(const Position<T>& _position)
+{
+    uint32_t _handle = GetProductHandle(_position.GetProduct().GetProductId());
+    if (_handle == INVALID_PRODUCT_HANDLE) return;
+
+    PositionSnapshot _snapshot{};
+    _snapshot.handle = _handle;
+    _snapshot.version = static_cast<uint32_t>(positions[_handle].GetVersion() + 1);
+    _snapshot.aggregate = _position.GetAggregatePosition();
+    for (const auto& _book : _position.GetPositions()) {
+        uint32_t _id = GetBookId(_book.first);
+        if (_id < QUERY_MAX_BOOKS) _snapshot.books[_id] = _book.second;
+    }
+    positions[_handle].Store(_snapshot);
+}
+
+template<typename T>
+void QueryServer<T>::OnPV01(const PV01<T>& _pv01)
+{
+    uint32_t _handle = GetProductHandle(_pv01.GetProduct().GetProductId());
+    if (_handle == INVALID_PRODUCT_HANDLE) return;
+    pv01s[_handle].Store(Pv01Snapshot{_handle, static_cast<uint32_t>(pv01s[_handle].GetVersion() + 1),
+                                      _pv01.GetPV01(), _pv01.GetQuantity(), _pv01.GetYield()});
+}
+
+template<typename T>
+void QueryServer<T>::OnOrderBook(const OrderBook<T>& _book)
+{
+    uint32_t _handle = GetProductHandle(_book.GetProduct().GetProductId());
+    if (_handle == INVALID_PRODUCT_HANDLE || _book.GetBidStack().empty() || _book.GetOfferStack().empty()) return;
+
+    BidOffer _touch = _book.GetBidAsk();
+    tops[_handle].Store(TopOfBookSnapshot{_handle, static_cast<uint32_t>(tops[_handle].GetVersion() + 1),
+                                          _touch.GetBidOrder().GetPrice(), _touch.GetOfferOrder().GetPrice(),
+                                          _touch.GetBidOrder().GetQuantity(), _touch.GetOfferOrder().GetQuantity()});
+}
+
+template<typename T>
+void QueryServer<T>::OnInquiry(const Inquiry<T>& _inquiry)
+{
+    uint32_t _handle = GetProductHandle(_inquiry.GetProduct().GetProductId());
+    if (_handle == INVALID_PRODUCT_HANDLE) return;
+
+    auto [it, _inserted] = inquiryStates.try_emplace(_inquiry.GetInquiryId(), _handle, _inquiry.GetState());
+    if (!_inserted) {
+        // a state change moves one count, published once when the product is unchanged
+        uint32_t _previous = it->second.first;
+        inquiryCounts[_previous].states[it->second.second]--;
+        if (_previous != _handle) {
+            inquiryCounts[_previous].version++;
+            inquiries[_previous].Store(inquiryCounts[_previous]);
+        }
+        it->second = {_handle, _inquiry.GetState()};
+    }
+    InquirySnapshot& _counts = inquiryCounts[_handle];
+    _counts.states[_inquiry.GetState()]++;
+    _counts.handle = _handle;
+    _counts.version++;
+    inquiries[_handle].Store(_counts);
+}
+
+template<typename T>
+void QueryServer<T>::EndOfDay()
+{
+    inquiryStates.clear();
+    for (uint32_t h = 0; h < PRODUCT_COUNT; ++h) {
+        uint32_t _version = inquiryCounts[h].version;
+        inquiryCounts[h] = InquirySnapshot{h, _version == 0 ? 0 : _version + 1, {}, 0};
+        if (_version != 0) inquiries[h].Store(inquiryCounts[h]);
+    }
+}
+
+template<typename T>
+void QueryServer<T>::Answer(const QueryRequest& _request, vector<char>& _out) const
+{
+    size_t _start = _out.size();
+    QueryResponseHeader _header{_request.kind, QUERY_OK, 0, 0};
+    _out.resize(_start + sizeof(_header));
+
+    auto _append = [&_out, &_header](const auto& _record) {
+        const char* _bytes = reinterpret_cast<const char*>(&_record);
+        _out.insert(_out.end(), _bytes, _bytes + sizeof(_record));
+        _header.count++;
+    };
+
+    bool _all = _request.product == QUERY_ALL_PRODUCTS;
+    uint32_t _first = _all ? 0 : _request.product;
+    uint32_t _last = _all ? PRODUCT_COUNT : _request.product + 1u;
+    if (_request.kind != QUERY_BOOKS && !_all && _request.product >= PRODUCT_COUNT) {
+        _header.status = QUERY_UNKNOWN_PRODUCT;
+        _first = _last = 0;
+    }
+
+    // products without data are left out of a bulk answer, and fail a point query
+    auto _collect = [&](const auto& _snapshots) {
+        for (uint32_t h = _first; h < _last; ++h) {
+            auto _snapshot = _snapshots[h].Load();
+            if (_snapshot.version != 0) _append(_snapshot);
+        }
+        if (!_all && _header.count == 0 && _header.status == QUERY_OK) _header.status = QUERY_NO_DATA;
+    };
+    switch (_request.kind) {
+        case QUERY_POSITION: _collect(positions); break;
+        case QUERY_PV01: _collect(pv01s); break;
+        case QUERY_TOP_OF_BOOK: _collect(tops); break;
+        case QUERY_INQUIRIES: _collect(inquiries); break;
+        case QUERY_BOOKS: _append(books.Load()); break;
+        default: _header.status = QUERY_UNKNOWN_KIND; break;
+    }
+
+    _header.bytes = static_cast<uint32_t>(_out.size() - _start - sizeof(_header));
+    memcpy(_out.data() + _start, &_header, sizeof(_header));
+}
+
+template<typename T>
+void QueryServer<T>::Start(const string& _path)
+{
+    if (running.load()) {
+        throw std::runtime_error("Query server already running on " + path);
+    }
+    sockaddr_un _address{};
+    _address.sun_family = AF_UNIX;
+    if (_path.empty() || _path.size() >= sizeof(_address.sun_path)) {
+        throw std::runtime_error("Invalid query socket path: " + _path);
+    }
+    strncpy(_address.sun_path, _path.c_str(), sizeof(_address.sun_path) - 1);
+
+    // a socket left by a previous run would fail the bind
+    unlink(_path.c_str());
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr*>(&_address), sizeof(_address)) != 0
+        || listen(listenFd, SOMAXCONN) != 0 || pipe(wakeFds) != 0) {
+        string _error = strerror(errno);
+        if (listenFd >= 0) close(listenFd);
+        listenFd = -1;
+        throw std::runtime_error("Cannot listen on query socket " + _path + ": " + _error);
+    }
+    fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+
+    path = _path;
+    running.store(true);
+    worker = thread(&QueryServer<T>::Run, this);
+    LOG(LEVEL_INFO, "Query server listening on {}", path);
+}
+
+template<typename T>
+void QueryServer<T>::Stop()
+{
+    if (!running.exchange(false)) return;
+    char _wake = 0;
+    if (write(wakeFds[1], &_wake, 1) < 0) {
+        LOG(LEVEL_ERROR, "Cannot wake the query server: {}", string_view(strerror(errno)));
+    }
+    worker.join();
+    close(listenFd);
+    close(wakeFds[0]);
+    close(wakeFds[1]);
+    listenFd = wakeFds[0] = wakeFds[1] = -1;
+    unlink(path.c_str());
+}
+
+template<typename T>
+bool QueryServer<T>::IsRunning() const
+{
+    return running.load();
+}
+
+template<typename T>
+void QueryServer<T>::Run()
+{
+    vector<Client> _clients;
+    vector<pollfd> _polls;
+    while (running.load(memory_order_relaxed)) {
+        _polls.clear();
+        _polls.push_back({wakeFds[0], POLLIN, 0});
+        _polls.push_back({listenFd, POLLIN, 0});
+        for (const auto& _client : _clients) {
+            short _events = _client.sent < _client.out.size() ? POLLIN | POLLOUT : POLLIN;
+            // a closed client has nothing more to read, only answers to take
+            if (_client.closed) _events = POLLOUT;
+            _polls.push_back({_client.fd, _events, 0});
+        }
+        if (poll(_polls.data(), _polls.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            LOG(LEVEL_ERROR, "Query server poll failed: {}", string_view(strerror(errno)));
+            break;
+        }
+        if (_polls[0].revents) break;
+
+        // serve the clients polled this round, then take the new ones
+        size_t _kept = 0;
+        for (size_t i = 0; i < _clients.size(); ++i) {
+            Client& _client = _clients[i];
+            short _events = _polls[i + 2].revents;
+            bool _open = !(_events & (POLLERR | POLLNVAL));
+            if (_open && !_client.closed && (_events & (POLLIN | POLLHUP))) _open = Read(_client);
+            if (_open && _client.sent < _client.out.size()) _open = Flush(_client);
+            if (_client.closed && _client.sent == _client.out.size()) _open = false;
+            if (!_open) {
+                close(_client.fd);
+                continue;
+            }
+            if (_kept != i) _clients[_kept] = std::move(_client);
+            _kept++;
+        }
+        _clients.resize(_kept);
+        if (_polls[1].revents & POLLIN) Accept(_clients);
+    }
+    for (const auto& _client : _clients) close(_client.fd);
+}
+
+template<typename T>
+void QueryServer<T>::Accept(vector<Client>& _clients)
+{
+    while (true) {
+        int _fd = accept(listenFd, nullptr, nullptr);
+        if (_fd < 0) return;
+        if (_clients.size() == MAX_CLIENTS) {
+            close(_fd);
+            continue;
+        }
+        fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+        int _on = 1;
+        setsockopt(_fd, SOL_SOCKET, SO_NOSIGPIPE, &_on, sizeof(_on));
+#endif
+        _clients.push_back(Client{_fd, {}, {}, 0, false});
+    }
+}
+
+template<typename T>
+bool QueryServer<T>::Read(Client& _client)
+{
+    char _buffer[4096];
+    while (true) {
+        ssize_t _read = recv(_client.fd, _buffer, sizeof(_buffer), 0);
+        // end of the requests: the ones already read are still answered
+        if (_read == 0) {
+            _client.closed = true;
+            break;
+        }
+        if (_read < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+            break;
+        }
+        _client.in.insert(_client.in.end(), _buffer, _buffer + _read);
+    }
+
+    // answer every complete request, keep a partial one for the next read
+    size_t _used = 0;
+    for (; _used + sizeof(QueryRequest) <= _client.in.size(); _used += sizeof(QueryRequest)) {
+        QueryRequest _request;
+        memcpy(&_request, _client.in.data() + _used, sizeof(_request));
+        Answer(_request, _client.out);
+    }
+    _client.in.erase(_client.in.begin(), _client.in.begin() + _used);
+    return _client.out.size() - _client.sent <= MAX_PENDING_BYTES;
+}
+
+template<typename T>
+bool QueryServer<T>::Flush(Client& _client)
+{
+#ifdef MSG_NOSIGNAL
+    constexpr int _flags = MSG_NOSIGNAL;
+#else
+    constexpr int _flags = 0;
+#endif
+    while (_client.sent < _client.out.size()) {
+        ssize_t _written = send(_client.fd, _client.out.data() + _client.sent, _client.out.size() - _client.sent, _flags);
+        if (_written < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        _client.sent += _written;
+    }
+    _client.out.clear();
+    _client.sent = 0;
+    return true;
+}
+
+
+/**
+ * @class PositionQueryListener
+ * @brief Listener copying positions from the PositionService into the QueryServer snapshots.
+ *
+ * @tparam T The product type.
+ */
+template<typename T>
+class PositionQueryListener : public ServiceListener<Position<T>>
+{
+public:
+    // Constructor and Destructor
+    PositionQueryListener(QueryServer<T>* _server);
+    ~PositionQueryListener();
+
+    // Listener interface methods
+    void ProcessAdd(Position<T>& data);
+    void ProcessRemove(Position<T>& data);
+    void ProcessUpdate(Position<T>& data);
+
+private:
+    QueryServer<T>* server; ///< Reference to the QueryServer
+};
+// **********************************************************************************
+//                  Implementation of PositionQueryListener...
+// **********************************************************************************
+template<typename T>
+PositionQueryListener<T>::PositionQueryListener(QueryServer<T>* _server)
+{
+    server = _server;
+}
+
+template<typename T>
+PositionQueryListener<T>::~PositionQueryListener() {}
+
+template<typename T>
+void PositionQueryListener<T>::ProcessAdd(Position<T>& data)
+{
+    server->OnPosition(data);
+}
+
+template<typename T>
+void PositionQueryListener<T>::ProcessRemove(Position<T>& data) {}
+
+template<typename T>
+void PositionQueryListener<T>::ProcessUpdate(Position<T>& data) {}
+
+
+/**
+ * @class RiskQueryListener
+ * @brief Listener copying PV01s from the RiskService into the QueryServer snapshots.
+ *
+ * @tparam T The product type.
+ */
+template<typename T>
+class RiskQueryListener : public ServiceListener<PV01<T>>
+{
+public:
+    // Constructor and Destructor
+    RiskQueryListener(QueryServer<T>* _server);
+    ~RiskQueryListener();
+
+    // Listener interface methods
+    void ProcessAdd(PV01<T>& data);
+    void ProcessRemove(PV01<T>& data);
+    void ProcessUpdate(PV01<T>& data);
+
+private:
+    QueryServer<T>* server; ///< Reference to the QueryServer
+};
+// **********************************************************************************
+//                  Implementation of RiskQueryListener...
+// **********************************************************************************
+template<typename T>
+RiskQueryListener<T>::RiskQueryListener(QueryServer<T>* _server)
+{
+    server = _server;
+}
+
+template<typename T>
+RiskQueryListener<T>::~RiskQueryListener() {}
+
+template<typename T>
+void RiskQueryListener<T>::ProcessAdd(PV01<T>& data)
+{
+    server->OnPV01(data);
+}
+
+template<typename T>
+void RiskQueryListener<T>::ProcessRemove(PV01<T>& data) {}
+
+template<typename T>
+void RiskQueryListener<T>::ProcessUpdate(PV01<T>& data) {}
+
+
+/**
+ * @class MarketDataQueryListener
+ * @brief Listener copying the top of book from the MarketDataService into the QueryServer snapshots.
+ *
+ * @tparam T The product type.
+ */
+template<typename T>
+class MarketDataQueryListener : public ServiceListener<OrderBook<T>>
+{
+public:
+    // Constructor and Destructor
+    MarketDataQueryListener(QueryServer<T>* _server);
+    ~MarketDataQueryListener();
+
+    // Listener interface methods
+    void ProcessAdd(OrderBook<T>& data);
+    void ProcessRemove(OrderBook<T>& data);
+    void ProcessUpdate(OrderBook<T>& data);
+
+private:
+    QueryServer<T>* server; ///< Reference to the QueryServer
+};
+// **********************************************************************************
+//                  Implementation of MarketDataQueryListener...
+// **********************************************************************************
+template<typename T>
+MarketDataQueryListener<T>::MarketDataQueryListener(QueryServer<T>* _server)
+{
+    server = _server;
+}
+
+template<typename T>
+MarketDataQueryListener<T>::~MarketDataQueryListener() {}
+
+template<typename T>
+void MarketDataQueryListener<T>::ProcessAdd(OrderBook<T>& data)
+{
+    server->OnOrderBook(data);
+}
+
+template<typename T>
+void MarketDataQueryListener<T>::ProcessRemove(OrderBook<T>& data) {}
+
+template<typename T>
+void MarketDataQueryListener<T>::ProcessUpdate(OrderBook<T>& data) {}
+
+
+/**
+ * @class InquiryQueryListener
+ * @brief Listener counting inquiry states from the InquiryService into the QueryServer snapshots.
+ *
+ * @tparam T The product type.
+ */
+template<typename T>
+class InquiryQueryListener : public ServiceListener<Inquiry<T>>
+{
+public:
+    // Constructor and Destructor
+    InquiryQueryListener(QueryServer<T>* _server);
+    ~InquiryQueryListener();
+
+    // Listener interface methods
+    void ProcessAdd(Inquiry<T>& data);
+    void ProcessRemove(Inquiry<T>& data);
+    void ProcessUpdate(Inquiry<T>& data);
+
+private:
+    QueryServer<T>* server; ///< Reference to the QueryServer
+};
+// **********************************************************************************
+//                  Implementation of InquiryQueryListener...
+// **********************************************************************************
+template<typename T>
+InquiryQueryListener<T>::InquiryQueryListener(QueryServer<T>* _server)
+{
+    server = _server;
+}
+
+template<typename T>
+InquiryQueryListener<T>::~InquiryQueryListener() {}
+
+template<typename T>
+void InquiryQueryListener<T>::ProcessAdd(Inquiry<T>& data)
+{
+    server->OnInquiry(data);
+}
+
+template<typename T>
+void InquiryQueryListener<T>::ProcessRemove(Inquiry<T>& data) {}
+
+template<typename T>
+void InquiryQueryListener<T>::ProcessUpdate(Inquiry<T>& data) {}
+
+#endif //QUERY_SERVER_HPP
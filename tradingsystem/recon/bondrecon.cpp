@@ -0,0 +1,145 @@
+/**
+ * @file bondrecon.cpp
+ * @brief End-of-day reconciliation of the reported positions and risk against the booked trades.
+ *
+ * Recomputes the position of every product and book from the trade journal on all cores and
+ * diffs it against the last positions and PV01s, read either from their journals or from the
+ * query socket of a running trading system. Prints every break and exits with status 1 if
+ * there is any.
+ *
+ * Usage: bond_recon [--threads N] <trades journal> <positions journal> <risk journal>
+ *        bond_recon [--threads N] <trades journal> --socket <query socket path>
+ *
+ * @author Niccolo Fabbri
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "../reconciliation.hpp"
+#include "../queryserver.hpp"
+
+using namespace std;
+
+// Send one query and read its answer, false on a closed socket or a failed query
+bool Query(int _fd, QueryKind _kind, vector<char>& _body)
+{
+    QueryRequest _request{_kind, QUERY_ALL_PRODUCTS, 0};
+    if (send(_fd, &_request, sizeof(_request), 0) != sizeof(_request)) return false;
+
+    auto _receive = [_fd](char* _buffer, size_t _size) {
+        for (size_t _read = 0; _read < _size;) {
+            ssize_t _bytes = recv(_fd, _buffer + _read, _size - _read, 0);
+            if (_bytes <= 0) return false;
+            _read += _bytes;
+        }
+        return true;
+    };
+    QueryResponseHeader _header;
+    if (!_receive(reinterpret_cast<char*>(&_header), sizeof(_header))) return false;
+    _body.resize(_header.bytes);
+    return _receive(_body.data(), _body.size()) && _header.status == QUERY_OK;
+}
+
+// Fill the snapshot with the live positions and PV01s served by a trading system
+bool LoadLiveSnapshot(const string& _path, ReconSnapshot& _snapshot)
+{
+    sockaddr_un _address{};
+    _address.sun_family = AF_UNIX;
+    strncpy(_address.sun_path, _path.c_str(), sizeof(_address.sun_path) - 1);
+    int _fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (_fd < 0 || connect(_fd, reinterpret_cast<sockaddr*>(&_address), sizeof(_address)) != 0) {
+        if (_fd >= 0) close(_fd);
+        return false;
+    }
+
+    vector<char> _books, _positions, _pv01s;
+    bool _ok = Query(_fd, QUERY_BOOKS, _books) && Query(_fd, QUERY_POSITION, _positions)
+               && Query(_fd, QUERY_PV01, _pv01s) && _books.size() == sizeof(BookSnapshot);
+    close(_fd);
+    if (!_ok) return false;
+
+    BookSnapshot _names;
+    memcpy(&_names, _books.data(), sizeof(_names));
+    for (size_t i = 0; i + sizeof(PositionSnapshot) <= _positions.size(); i += sizeof(PositionSnapshot)) {
+        PositionSnapshot _position;
+        memcpy(&_position, _positions.data() + i, sizeof(_position));
+        for (uint32_t b = 0; b < _names.count; ++b) {
+            _snapshot.positions[_position.handle][string(_names.names[b], strnlen(_names.names[b], 16))] = _position.books[b];
+        }
+        _snapshot.hasPosition[_position.handle] = true;
+    }
+    for (size_t i = 0; i + sizeof(Pv01Snapshot) <= _pv01s.size(); i += sizeof(Pv01Snapshot)) {
+        Pv01Snapshot _pv01;
+        memcpy(&_pv01, _pv01s.data() + i, sizeof(_pv01));
+        _snapshot.pv01s[_pv01.handle] = _pv01.pv01;
+        _snapshot.riskQuantities[_pv01.handle] = _pv01.quantity;
+        _snapshot.yields[_pv01.handle] = _pv01.yield;
+        _snapshot.hasYield[_pv01.handle] = true;
+        _snapshot.hasRisk[_pv01.handle] = true;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t _threads = thread::hardware_concurrency();
+    string _socket;
+    vector<string> _files;
+    for (int i = 1; i < argc; ++i) {
+        string _arg = argv[i];
+        if (_arg == "--threads" && i + 1 < argc) _threads = strtoul(argv[++i], nullptr, 10);
+        else if (_arg == "--socket" && i + 1 < argc) _socket = argv[++i];
+        else _files.push_back(_arg);
+    }
+    if (_files.size() != (_socket.empty() ? 3u : 1u)) {
+        fprintf(stderr, "usage: %s [--threads N] <trades journal> <positions journal> <risk journal>\n"
+                        "       %s [--threads N] <trades journal> --socket <query socket path>\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    Reconciler _reconciler(_threads);
+    auto _begin = chrono::steady_clock::now();
+    ifstream _trades(_files[0], ios::binary);
+    if (!_trades) {
+        fprintf(stderr, "cannot open %s\n", _files[0].c_str());
+        return 2;
+    }
+    _reconciler.LoadTrades(_trades);
+    double _tradeSeconds = chrono::duration<double>(chrono::steady_clock::now() - _begin).count();
+
+    if (_socket.empty()) {
+        ifstream _positions(_files[1], ios::binary), _risk(_files[2], ios::binary);
+        if (!_positions || !_risk) {
+            fprintf(stderr, "cannot open %s or %s\n", _files[1].c_str(), _files[2].c_str());
+            return 2;
+        }
+        _reconciler.LoadPositions(_positions);
+        _reconciler.LoadRisk(_risk);
+    } else if (!LoadLiveSnapshot(_socket, _reconciler.GetSnapshot())) {
+        fprintf(stderr, "cannot read the live snapshot from %s\n", _socket.c_str());
+        return 2;
+    }
+
+    vector<ReconBreak> _breaks = _reconciler.Reconcile();
+    double _seconds = chrono::duration<double>(chrono::steady_clock::now() - _begin).count();
+    const PositionTally& _tally = _reconciler.GetTally();
+    printf("%ld trades (%ld malformed rows) reduced in %.3fs on %zu threads, %.1fM trades/s\n",
+           _tally.TradeCount(), _tally.malformed, _tradeSeconds, _threads,
+           _tradeSeconds > 0 ? _tally.TradeCount() / _tradeSeconds / 1e6 : 0.0);
+    if (_reconciler.GetSkippedRows() > 0) {
+        printf("%ld unreadable position or risk rows skipped\n", _reconciler.GetSkippedRows());
+    }
+    for (uint32_t h = 0; h < PRODUCT_COUNT; ++h) {
+        printf("%-10s trades %-10ld position %ld\n", string(PRODUCT_CUSIPS[h]).c_str(), _tally.trades[h],
+               _tally.Aggregate(h));
+    }
+    for (const auto& _break : _breaks) {
+        printf("BREAK %-10s %-18s expected %.6f actual %.6f\n", _break.productId.c_str(), _break.item.c_str(),
+               _break.expected, _break.actual);
+    }
+    printf("%zu breaks, %.3fs total\n", _breaks.size(), _seconds);
+    return _breaks.empty() ? 0 : 1;
+}
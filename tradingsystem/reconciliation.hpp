@@ -0,0 +1,401 @@
+/**
+ * @file reconciliation.hpp
+ * @brief Defines the end-of-day reconciliation of positions and risk against the booked trades.
+ *
+ * This file includes the definition of PositionTally, the positions recomputed from a trade
+ * journal, ReconSnapshot, the positions and PV01s reported by the system, and the Reconciler,
+ * which builds both from the historical journals and lists every break between them.
+ *
+ * @author Niccolo Fabbri
+ */
+#ifndef RECONCILIATION_HPP
+#define RECONCILIATION_HPP
+
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <istream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "utils/utils.hpp"
+#include "utils/bulkloader.hpp"
+#include "utils/yieldengine.hpp"
+
+using namespace std;
+
+// Split a journal line on commas into at most _capacity fields, dropping the empty field after a trailing comma
+size_t SplitFields(string_view _line, string_view* _fields, size_t _capacity)
+{
+    size_t _count = 0;
+    while (_count < _capacity) {
+        size_t _comma = _line.find(',');
+        _fields[_count++] = _line.substr(0, _comma);
+        if (_comma == string_view::npos) break;
+        _line.remove_prefix(_comma + 1);
+        if (_line.empty()) break;
+    }
+    return _count;
+}
+
+// Whole-field integer and floating point parsing, false on anything else
+bool ParseField(string_view _field, long& _value)
+{
+    auto _result = from_chars(_field.data(), _field.data() + _field.size(), _value);
+    return _result.ec == errc() && _result.ptr == _field.data() + _field.size();
+}
+
+bool ParseField(string_view _field, double& _value)
+{
+    auto _result = from_chars(_field.data(), _field.data() + _field.size(), _value);
+    return _result.ec == errc() && _result.ptr == _field.data() + _field.size();
+}
+
+/**
+ * @struct PositionTally
+ * @brief Positions by book and product recomputed from booked trades; one per journal chunk, then merged.
+ */
+struct PositionTally
+{
+    vector<string> books;                            ///< Book names in order of first appearance
+    vector<array<long, PRODUCT_COUNT>> quantities;   ///< By book, then product handle
+    array<long, PRODUCT_COUNT> trades{};             ///< Trades by product handle
+    long malformed = 0;                              ///< Rows that are not a trade of a known product
+
+    // Fold one journal row: productId,tradeId,price,book,quantity,side, optionally after a timestamp
+    void AddRow(string_view _line);
+    void Add(uint32_t _handle, string_view _book, long _quantity);
+    void Merge(const PositionTally& _other);
+
+    long Get(uint32_t _handle, const string& _book) const;
+    long Aggregate(uint32_t _handle) const;
+    long TradeCount() const;
+};
+// **********************************************************************************
+//                  Implementation of PositionTally...
+// **********************************************************************************
+void PositionTally::AddRow(string_view _line)
+{
+    string_view _fields[8];
+    size_t _count = SplitFields(_line, _fields, 8);
+    // the historical journal puts a timestamp first, the trades input does not
+    size_t _first = _count > 0 && GetProductHandle(_fields[0]) == INVALID_PRODUCT_HANDLE ? 1 : 0;
+    long _quantity = 0;
+    if (_count < _first + 6 || !ParseField(_fields[_first + 4], _quantity)) {
+        malformed++;
+        return;
+    }
+    uint32_t _handle = GetProductHandle(_fields[_first]);
+    string_view _side = _fields[_first + 5];
+    if (_handle == INVALID_PRODUCT_HANDLE || (_side != "BUY" && _side != "SELL")) {
+        malformed++;
+        return;
+    }
+    Add(_handle, _fields[_first + 3], _side == "BUY" ? _quantity : -_quantity);
+}
+
+void PositionTally::Add(uint32_t _handle, string_view _book, long _quantity)
+{
+    size_t _id = 0;
+    while (_id < books.size() && books[_id] != _book) ++_id;
+    if (_id == books.size()) {
+        books.emplace_back(_book);
+        quantities.push_back({});
+    }
+    quantities[_id][_handle] += _quantity;
+    trades[_handle]++;
+}
+
+void PositionTally::Merge(const PositionTally& _other)
+{
+    for (size_t i = 0; i < _other.books.size(); ++i) {
+        size_t _id = 0;
+        while (_id < books.size() && books[_id] != _other.books[i]) ++_id;
+        if (_id == books.size()) {
+            books.push_back(_other.books[i]);
+            quantities.push_back({});
+        }
+        for (uint32_t h = 0; h < PRODUCT_COUNT; ++h) quantities[_id][h] += _other.quantities[i][h];
+    }
+    for (uint32_t h = 0; h < PRODUCT_COUNT; ++h) trades[h] += _other.trades[h];
+    malformed += _other.malformed;
+}
+
+long PositionTally::Get(uint32_t _handle, const string& _book) const
+{
+    for (size_t i = 0; i < books.size(); ++i) {
+        if (books[i] == _book) return quantities[i][_handle];
+    }
+    return 0;
+}
+
+long PositionTally::Aggregate(uint32_t _handle) const
+{
+    long _total = 0;
+    for (const auto& _book : quantities) _total += _book[_handle];
+    return _total;
+}
+
+long PositionTally::TradeCount() const
+{
+    long _total = 0;
+    for (long _trades : trades) _total += _trades;
+    return _total;
+}
+
+
+/**
+ * @struct ReconSnapshot
+ * @brief Positions and PV01s of every product as reported by the system.
+ */
+struct ReconSnapshot
+{
+    array<map<string, long>, PRODUCT_COUNT> positions;  ///< Quantity by book
+    array<bool, PRODUCT_COUNT> hasPosition{};
+    array<double, PRODUCT_COUNT> pv01s{};               ///< PV01 per unit of face
+    array<long, PRODUCT_COUNT> riskQuantities{};        ///< Quantity the PV01 was computed on
+    array<double, PRODUCT_COUNT> yields{};              ///< Yield the PV01 was computed at
+    array<bool, PRODUCT_COUNT> hasRisk{};
+    array<bool, PRODUCT_COUNT> hasYield{};
+};
+
+/**
+ * @struct ReconBreak
+ * @brief A figure of the system that differs from its recomputation.
+ */
+struct ReconBreak
+{
+    string productId;
+    string item;      ///< "position <book>", "risk quantity", "unit pv01" or "risk vs position"
+    double expected;
+    double actual;
+};
+
+
+/**
+ * @class Reconciler
+ * @brief Recomputes positions from the trade journal and diffs them against the reported positions and risk.
+ *
+ * The trade journal is streamed in blocks; each block is cut into one chunk per thread and
+ * every chunk is folded into its own PositionTally, so the reduction by product and book
+ * runs on all cores without shared state, and the tallies are merged as the blocks complete.
+ * The position and risk journals are parsed on the worker threads too, and applied in file
+ * order: a full row (C, or a row without marker) replaces a product, a delta row (D) updates
+ * the fields it lists. The snapshot can also be filled from a live source instead.
+ *
+ * The unit PV01 of each product is recomputed from the yield it was reported at, as the
+ * risk service does: half the clean price move of a 1bp yield bump either side, per unit of face.
+ */
+class Reconciler
+{
+public:
+    static constexpr double PV01_TOLERANCE = 1e-9;
+    static constexpr size_t MAX_ROW_FIELDS = 64;  ///< Fields read from a journal row, about 30 books
+
+    // ctor with the number of threads and the block size read from the journals
+    Reconciler(size_t _threads = thread::hardware_concurrency(), size_t _blockBytes = 16 << 20);
+
+    // Recompute positions from a trade journal
+    void LoadTrades(istream& _data);
+
+    // Last reported positions and PV01s, from the positions and risk journals
+    void LoadPositions(istream& _data);
+    void LoadRisk(istream& _data);
+
+    // Reported figures, to be filled directly from a live source
+    ReconSnapshot& GetSnapshot();
+    const PositionTally& GetTally() const;
+
+    // Journal rows of the position and risk journals that could not be read
+    long GetSkippedRows() const;
+
+    // Every difference between the recomputation and the snapshot
+    vector<ReconBreak> Reconcile() const;
+
+private:
+    // A parsed position or risk journal row
+    struct JournalRow
+    {
+        uint32_t handle;
+        bool full;
+        vector<pair<string, string>> fields;  ///< Name and value pairs
+    };
+
+    size_t threads;
+    size_t blockBytes;
+    PositionTally tally;
+    ReconSnapshot snapshot;
+    long skipped;
+    array<BondSchedule, PRODUCT_COUNT> schedules;  ///< Coupon schedules at the settlement date of the risk
+
+    // PV01 per unit of face of a product at a yield
+    double UnitPV01(uint32_t _handle, double _yield) const;
+
+    // Parse a row as the product handle, full or delta, and its name/value pairs; full rows of
+    // records written as values only (the PV01) take their names from _names
+    static JournalRow ParseRow(string_view _line, bool _namedFull, const char* const* _names);
+};
+// **********************************************************************************
+//                  Implementation of Reconciler...
+// **********************************************************************************
+Reconciler::Reconciler(size_t _threads, size_t _blockBytes)
+{
+    threads = max<size_t>(_threads, 1);
+    blockBytes = _blockBytes;
+    skipped = 0;
+    const date& _settlement = GetYieldEngine().GetSettlementDate();
+    for (uint32_t h = 0; h < PRODUCT_COUNT; ++h) {
+        schedules[h] = BondSchedule::Of(GetBond(string(PRODUCT_CUSIPS[h])), _settlement);
+    }
+}
+
+double Reconciler::UnitPV01(uint32_t _handle, double _yield) const
+{
+    const double _bump = 1e-4;
+    const BondSchedule& _schedule = schedules[_handle];
+    return (_schedule.CleanPrice(_yield - _bump) - _schedule.CleanPrice(_yield + _bump)) / 200.0;
+}
+
+void Reconciler::LoadTrades(istream& _data)
+{
+    BulkLoader<PositionTally> _loader(blockBytes, threads);
+    _loader.Reduce(_data, tally,
+                   [](PositionTally& _partial, string_view _line) { _partial.AddRow(_line); },
+                   [](PositionTally& _total, const PositionTally& _partial) { _total.Merge(_partial); });
+}
+
+Reconciler::JournalRow Reconciler::ParseRow(string_view _line, bool _namedFull, const char* const* _names)
+{
+    JournalRow _row{INVALID_PRODUCT_HANDLE, true, {}};
+    string_view _fields[MAX_ROW_FIELDS];
+    size_t _count = SplitFields(_line, _fields, MAX_ROW_FIELDS);
+
+    // timestamp, then an optional C/D marker, then the product
+    size_t _first = 1;
+    if (_count > 1 && (_fields[1] == "C" || _fields[1] == "D")) {
+        _row.full = _fields[1] == "C";
+        _first = 2;
+    }
+    if (_count <= _first) return _row;
+    _row.handle = GetProductHandle(_fields[_first]);
+
+    bool _named = _namedFull || !_row.full;
+    for (size_t i = _first + 1, n = 0; i < _count; ++n) {
+        if (_named) {
+            if (i + 1 >= _count) {
+                _row.handle = INVALID_PRODUCT_HANDLE;
+                break;
+            }
+            _row.fields.emplace_back(_fields[i], _fields[i + 1]);
+            i += 2;
+        } else {
+            if (!_names[n]) break;
+            _row.fields.emplace_back(_names[n], _fields[i]);
+            i += 1;
+        }
+    }
+    return _row;
+}
+
+void Reconciler::LoadPositions(istream& _data)
+{
+    BulkLoader<JournalRow> _loader(blockBytes, threads);
+    _loader.Load(_data, [](string_view _line) { return ParseRow(_line, true, nullptr); }, [this](JournalRow& _row) {
+        if (_row.handle == INVALID_PRODUCT_HANDLE) {
+            skipped++;
+            return;
+        }
+        long _quantity = 0;
+        map<string, long>& _books = snapshot.positions[_row.handle];
+        if (_row.full) _books.clear();
+        for (const auto& _field : _row.fields) {
+            if (!ParseField(_field.second, _quantity)) {
+                skipped++;
+                continue;
+            }
+            _books[_field.first] = _quantity;
+        }
+        snapshot.hasPosition[_row.handle] = true;
+    });
+}
+
+void Reconciler::LoadRisk(istream& _data)
+{
+    static const char* const RISK_FIELDS[] = {"pv01", "quantity", "yield", nullptr};
+    BulkLoader<JournalRow> _loader(blockBytes, threads);
+    _loader.Load(_data, [](string_view _line) { return ParseRow(_line, false, RISK_FIELDS); }, [this](JournalRow& _row) {
+        if (_row.handle == INVALID_PRODUCT_HANDLE) {
+            skipped++;
+            return;
+        }
+        for (const auto& _field : _row.fields) {
+            bool _parsed = false;
+            if (_field.first == "pv01") _parsed = ParseField(_field.second, snapshot.pv01s[_row.handle]);
+            if (_field.first == "quantity") _parsed = ParseField(_field.second, snapshot.riskQuantities[_row.handle]);
+            if (_field.first == "yield") {
+                _parsed = ParseField(_field.second, snapshot.yields[_row.handle]);
+                snapshot.hasYield[_row.handle] = snapshot.hasYield[_row.handle] || _parsed;
+            }
+            if (!_parsed) skipped++;
+        }
+        snapshot.hasRisk[_row.handle] = true;
+    });
+}
+
+ReconSnapshot& Reconciler::GetSnapshot()
+{
+    return snapshot;
+}
+
+const PositionTally& Reconciler::GetTally() const
+{
+    return tally;
+}
+
+long Reconciler::GetSkippedRows() const
+{
+    return skipped;
+}
+
+vector<ReconBreak> Reconciler::Reconcile() const
+{
+    vector<ReconBreak> _breaks;
+    for (uint32_t h = 0; h < PRODUCT_COUNT; ++h) {
+        string _productId(PRODUCT_CUSIPS[h]);
+
+        // every book either side knows, a missing book counts as flat
+        map<string, long> _reported = snapshot.positions[h];
+        for (const auto& _book : tally.books) _reported.try_emplace(_book, 0);
+        long _reportedTotal = 0;
+        for (const auto& [_book, _quantity] : _reported) {
+            long _expected = tally.Get(h, _book);
+            if (_expected != _quantity) {
+                _breaks.push_back({_productId, "position " + _book, double(_expected), double(_quantity)});
+            }
+            _reportedTotal += _quantity;
+        }
+
+        long _expected = tally.Aggregate(h);
+        if (!snapshot.hasRisk[h]) {
+            if (_expected != 0) _breaks.push_back({_productId, "risk quantity", double(_expected), 0});
+            continue;
+        }
+        if (snapshot.riskQuantities[h] != _expected) {
+            _breaks.push_back({_productId, "risk quantity", double(_expected), double(snapshot.riskQuantities[h])});
+        }
+        if (snapshot.hasPosition[h] && snapshot.riskQuantities[h] != _reportedTotal) {
+            _breaks.push_back({_productId, "risk vs position", double(_reportedTotal), double(snapshot.riskQuantities[h])});
+        }
+        // without the yield it was computed at, the PV01 cannot be checked
+        double _unit = snapshot.hasYield[h] ? UnitPV01(h, snapshot.yields[h]) : NAN;
+        if (!(fabs(snapshot.pv01s[h] - _unit) <= PV01_TOLERANCE)) {
+            _breaks.push_back({_productId, "unit pv01", _unit, snapshot.pv01s[h]});
+        }
+    }
+    return _breaks;
+}
+
+#endif //RECONCILIATION_HPP
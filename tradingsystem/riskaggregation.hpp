@@ -0,0 +1,294 @@
+/**
+ * @file riskaggregation.hpp
+ * @brief Defines the hierarchy used to aggregate risk from books up to the firm.
+ *
+ * This file includes the definition of RiskHierarchy, a tree of books, desks, businesses and
+ * the firm, where every node keeps its position by product, and reports its PV01 by product,
+ * sector and key-rate bucket at the current prices.
+ *
+ * @author Niccolo Fabbri
+ */
+#ifndef RISK_AGGREGATION_HPP
+#define RISK_AGGREGATION_HPP
+
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "utils/utils.hpp"
+
+using namespace std;
+
+// Key-rate pillars in years, the tenors of the on-the-run bonds; pillar k is the k-th knot of the curve
+constexpr size_t KEY_RATE_PILLARS = 7;
+constexpr double KEY_RATE_YEARS[KEY_RATE_PILLARS] = {2, 3, 5, 7, 10, 20, 30};
+
+// Levels of the aggregation tree, from the leaves to the root
+enum RiskLevel { RISK_BOOK, RISK_DESK, RISK_BUSINESS, RISK_FIRM, RISK_LEVEL_COUNT };
+
+/**
+ * @class RiskHierarchy
+ * @brief Aggregation tree book -> desk -> business -> firm, crossed with product, sector and bucket.
+ *
+ * A trade on a book adds its quantity to the book and to each of its ancestors, so an update
+ * costs the depth of the tree and every node position is read directly, whatever the number
+ * of books. Books first seen in a trade are placed under the default desk; AddBook moves a
+ * book and its risk to another desk at any time.
+ *
+ * Risk is not frozen at booking: the owner sets the PV01 and key-rate PV01s per unit of face
+ * of each product whenever it reprices it, and a node's PV01 by product, sector (a group of
+ * products, e.g. front end, belly, long end) or key-rate bucket is its positions times those.
+ */
+class RiskHierarchy
+{
+public:
+    static constexpr int NO_NODE = -1;
+    static constexpr int FIRM_NODE = 0;
+    static constexpr size_t MAX_SECTORS = PRODUCT_COUNT;
+
+    // ctor with the name of the root and of the desk and business receiving unknown books
+    RiskHierarchy(const string& _firm = "FIRM", const string& _defaultDesk = "UNASSIGNED",
+                  const string& _defaultBusiness = "UNASSIGNED");
+
+    // Configure the tree; adding an existing node moves it under the new parent
+    int AddBusiness(const string& _business);
+    int AddDesk(const string& _desk, const string& _business);
+    int AddBook(const string& _book, const string& _desk);
+
+    // Configure a sector from product ids; a product belongs to at most one
+    size_t AddSector(const string& _sector, const vector<string>& _productIds);
+
+    // Push the position delta of a trade on a book up the tree
+    void Apply(const string& _book, uint32_t _handle, long _quantity);
+
+    // Current PV01 and key-rate PV01s of a product per unit of face
+    void SetProductRisk(uint32_t _handle, double _unitPV01, const array<double, KEY_RATE_PILLARS>& _keyRates);
+
+    // Node lookup, NO_NODE if absent
+    int FindNode(RiskLevel _level, const string& _name) const;
+    RiskLevel GetLevel(int _node) const;
+    const string& GetName(int _node) const;
+    int GetParent(int _node) const;
+    size_t GetNodeCount() const;
+
+    // Sector lookup, MAX_SECTORS if absent
+    size_t FindSector(const string& _sector) const;
+
+    // Aggregates of a node, PV01s at the current product risk
+    double GetPV01(int _node) const;
+    double GetPV01(int _node, uint32_t _handle) const;
+    long GetQuantity(int _node, uint32_t _handle) const;
+    double GetSectorPV01(int _node, size_t _sector) const;
+    double GetBucketPV01(int _node, size_t _pillar) const;
+
+private:
+    struct Cells
+    {
+        array<long, PRODUCT_COUNT> quantity{};
+    };
+
+    vector<int> parents;
+    vector<RiskLevel> levels;
+    vector<string> names;
+    vector<Cells> cells;
+    array<unordered_map<string, int>, RISK_LEVEL_COUNT> index;  ///< Node of each name, by level
+    array<size_t, PRODUCT_COUNT> sectorOf;                       ///< Sector of each product handle
+    vector<string> sectors;
+    array<double, PRODUCT_COUNT> unitPV01s;                      ///< PV01 per unit of face, by handle
+    array<array<double, PRODUCT_COUNT>, KEY_RATE_PILLARS> keyRates; ///< Key-rate PV01 per unit of face, [pillar][handle]
+    string defaultDesk;
+    string defaultBusiness;
+
+    int AddNode(RiskLevel _level, const string& _name, int _parent);
+
+    // Add (_sign = 1) or remove (_sign = -1) the cells of a node from every ancestor from _from up
+    void PushCells(const Cells& _delta, int _from, int _sign);
+
+    void CheckNode(int _node) const;
+};
+// **********************************************************************************
+//                  Implementation of RiskHierarchy...
+// **********************************************************************************
+RiskHierarchy::RiskHierarchy(const string& _firm, const string& _defaultDesk, const string& _defaultBusiness)
+{
+    defaultDesk = _defaultDesk;
+    defaultBusiness = _defaultBusiness;
+    sectorOf.fill(MAX_SECTORS);
+    unitPV01s.fill(0);
+    for (auto& _pillar : keyRates) _pillar.fill(0);
+    AddNode(RISK_FIRM, _firm, NO_NODE);
+}
+
+int RiskHierarchy::AddNode(RiskLevel _level, const string& _name, int _parent)
+{
+    auto it = index[_level].find(_name);
+    if (it != index[_level].end()) {
+        int _node = it->second;
+        if (parents[_node] != _parent) {
+            // move the node's risk from its old ancestors to the new ones
+            Cells _moved = cells[_node];
+            PushCells(_moved, parents[_node], -1);
+            parents[_node] = _parent;
+            PushCells(_moved, _parent, 1);
+        }
+        return _node;
+    }
+
+    int _node = static_cast<int>(names.size());
+    parents.push_back(_parent);
+    levels.push_back(_level);
+    names.push_back(_name);
+    cells.emplace_back();
+    index[_level].emplace(_name, _node);
+    return _node;
+}
+
+int RiskHierarchy::AddBusiness(const string& _business)
+{
+    return AddNode(RISK_BUSINESS, _business, FIRM_NODE);
+}
+
+int RiskHierarchy::AddDesk(const string& _desk, const string& _business)
+{
+    return AddNode(RISK_DESK, _desk, AddBusiness(_business));
+}
+
+int RiskHierarchy::AddBook(const string& _book, const string& _desk)
+{
+    int _deskNode = FindNode(RISK_DESK, _desk);
+    if (_deskNode == NO_NODE) _deskNode = AddDesk(_desk, defaultBusiness);
+    return AddNode(RISK_BOOK, _book, _deskNode);
+}
+
+size_t RiskHierarchy::AddSector(const string& _sector, const vector<string>& _productIds)
+{
+    if (sectors.size() == MAX_SECTORS) {
+        throw std::runtime_error("Too many sectors: " + _sector);
+    }
+    size_t _id = sectors.size();
+    sectors.push_back(_sector);
+    for (const auto& _productId : _productIds) {
+        uint32_t _handle = GetProductHandle(_productId);
+        if (_handle == INVALID_PRODUCT_HANDLE) {
+            throw std::runtime_error("Unknown product in sector " + _sector + ": " + _productId);
+        }
+        sectorOf[_handle] = _id;
+    }
+    return _id;
+}
+
+void RiskHierarchy::PushCells(const Cells& _delta, int _from, int _sign)
+{
+    for (int _node = _from; _node != NO_NODE; _node = parents[_node]) {
+        Cells& _cells = cells[_node];
+        for (size_t i = 0; i < PRODUCT_COUNT; ++i) {
+            _cells.quantity[i] += _sign * _delta.quantity[i];
+        }
+    }
+}
+
+void RiskHierarchy::Apply(const string& _book, uint32_t _handle, long _quantity)
+{
+    if (_handle >= PRODUCT_COUNT) return;
+
+    int _node = FindNode(RISK_BOOK, _book);
+    if (_node == NO_NODE) _node = AddBook(_book, defaultDesk);
+
+    for (; _node != NO_NODE; _node = parents[_node]) {
+        cells[_node].quantity[_handle] += _quantity;
+    }
+}
+
+void RiskHierarchy::SetProductRisk(uint32_t _handle, double _unitPV01, const array<double, KEY_RATE_PILLARS>& _keyRates)
+{
+    if (_handle >= PRODUCT_COUNT) return;
+    unitPV01s[_handle] = _unitPV01;
+    for (size_t k = 0; k < KEY_RATE_PILLARS; ++k) keyRates[k][_handle] = _keyRates[k];
+}
+
+int RiskHierarchy::FindNode(RiskLevel _level, const string& _name) const
+{
+    auto it = index[_level].find(_name);
+    return it != index[_level].end() ? it->second : NO_NODE;
+}
+
+void RiskHierarchy::CheckNode(int _node) const
+{
+    if (_node < 0 || static_cast<size_t>(_node) >= names.size()) {
+        throw std::runtime_error("Unknown risk node " + to_string(_node));
+    }
+}
+
+RiskLevel RiskHierarchy::GetLevel(int _node) const
+{
+    CheckNode(_node);
+    return levels[_node];
+}
+
+const string& RiskHierarchy::GetName(int _node) const
+{
+    CheckNode(_node);
+    return names[_node];
+}
+
+int RiskHierarchy::GetParent(int _node) const
+{
+    CheckNode(_node);
+    return parents[_node];
+}
+
+size_t RiskHierarchy::GetNodeCount() const
+{
+    return names.size();
+}
+
+size_t RiskHierarchy::FindSector(const string& _sector) const
+{
+    for (size_t s = 0; s < sectors.size(); ++s) {
+        if (sectors[s] == _sector) return s;
+    }
+    return MAX_SECTORS;
+}
+
+double RiskHierarchy::GetPV01(int _node) const
+{
+    CheckNode(_node);
+    double _pv01 = 0;
+    for (uint32_t i = 0; i < PRODUCT_COUNT; ++i) _pv01 += cells[_node].quantity[i] * unitPV01s[i];
+    return _pv01;
+}
+
+double RiskHierarchy::GetPV01(int _node, uint32_t _handle) const
+{
+    CheckNode(_node);
+    return cells[_node].quantity.at(_handle) * unitPV01s[_handle];
+}
+
+long RiskHierarchy::GetQuantity(int _node, uint32_t _handle) const
+{
+    CheckNode(_node);
+    return cells[_node].quantity.at(_handle);
+}
+
+double RiskHierarchy::GetSectorPV01(int _node, size_t _sector) const
+{
+    CheckNode(_node);
+    if (_sector >= sectors.size()) throw std::runtime_error("Unknown sector " + to_string(_sector));
+    double _pv01 = 0;
+    for (uint32_t i = 0; i < PRODUCT_COUNT; ++i) {
+        if (sectorOf[i] == _sector) _pv01 += cells[_node].quantity[i] * unitPV01s[i];
+    }
+    return _pv01;
+}
+
+double RiskHierarchy::GetBucketPV01(int _node, size_t _pillar) const
+{
+    CheckNode(_node);
+    const array<double, PRODUCT_COUNT>& _keyRates = keyRates.at(_pillar);
+    double _pv01 = 0;
+    for (uint32_t i = 0; i < PRODUCT_COUNT; ++i) _pv01 += cells[_node].quantity[i] * _keyRates[i];
+    return _pv01;
+}
+
+#endif //RISK_AGGREGATION_HPP
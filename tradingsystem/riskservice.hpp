@@ -11,8 +11,21 @@
 #ifndef RISK_SERVICE_HPP
 #define RISK_SERVICE_HPP
 
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <numeric>
+#include <optional>
 #include "soa.hpp"
 #include "positionservice.hpp"
+#include "pricingservice.hpp"
+#include "curveservice.hpp"
+#include "riskaggregation.hpp"
+#include "utils/probes.hpp"
+#include "utils/yieldengine.hpp"
+
+static_assert(KEY_RATE_PILLARS == YieldCurve::KNOTS, "one key rate per curve knot");
 
 /**
  * PV01 risk.
@@ -26,7 +39,7 @@ public:
 
   // ctor for a PV01 value
   PV01() = default;
-  PV01(const T &_product, double _pv01, long _quantity);
+  PV01(const T &_product, double _pv01, long _quantity, double _yield = 0);
 
   // Get the product on this PV01 value
   const T& GetProduct() const;
@@ -37,37 +50,80 @@ public:
   // Get the quantity that this risk value is associated with
   long GetQuantity() const;
 
+  // Get the yield the PV01 was computed at, 0 for an aggregate
+  double GetYield() const;
+
   vector<string> HDFormat() const;
 
+  // Field name and value pairs that changed since _previous, after the product ID
+  vector<string> HDDeltaFormat(const PV01<T>& _previous) const;
+
 private:
   T product;
   double pv01;
   long quantity;
+  double yield;
 
 };
 
+// Shortest text that reads back as the same PV01, which is far below the 6 decimals of to_string
+string FormatPV01(double _pv01)
+{
+    char _buffer[32];
+    auto _result = to_chars(_buffer, _buffer + sizeof(_buffer), _pv01);
+    return string(_buffer, _result.ptr);
+}
+
 template<typename T>
 vector<string> PV01<T>::HDFormat() const {
     vector<string> formattedOutput;
     string productId = product.GetProductId();
 
-    // Format pv01 and quantity into strings
-    string formattedPV01 = to_string(pv01);
+    // Format pv01, quantity and yield into strings
+    string formattedPV01 = FormatPV01(pv01);
     string formattedQuantity = to_string(quantity);
+    string formattedYield = FormatPV01(yield);
 
     // Adding formatted elements to the vector
     formattedOutput.push_back(productId);
     formattedOutput.push_back(formattedPV01);
     formattedOutput.push_back(formattedQuantity);
+    formattedOutput.push_back(formattedYield);
 
     return formattedOutput;
 }
+
 template<typename T>
-PV01<T>::PV01(const T &_product, double _pv01, long _quantity) :
+vector<string> PV01<T>::HDDeltaFormat(const PV01<T>& _previous) const {
+    vector<string> formattedOutput;
+    formattedOutput.push_back(product.GetProductId());
+
+    // compare as written, so a change below the printed precision is not a change
+    string formattedPV01 = FormatPV01(pv01);
+    if (formattedPV01 != FormatPV01(_previous.pv01)) {
+        formattedOutput.push_back("pv01");
+        formattedOutput.push_back(formattedPV01);
+    }
+    if (quantity != _previous.quantity) {
+        formattedOutput.push_back("quantity");
+        formattedOutput.push_back(to_string(quantity));
+    }
+    string formattedYield = FormatPV01(yield);
+    if (formattedYield != FormatPV01(_previous.yield)) {
+        formattedOutput.push_back("yield");
+        formattedOutput.push_back(formattedYield);
+    }
+
+    return formattedOutput;
+}
+
+template<typename T>
+PV01<T>::PV01(const T &_product, double _pv01, long _quantity, double _yield) :
         product(_product)
 {
     pv01 = _pv01;
     quantity = _quantity;
+    yield = _yield;
 }
 
 
@@ -89,6 +145,12 @@ long PV01<T>::GetQuantity() const
     return quantity;
 }
 
+template<typename T>
+double PV01<T>::GetYield() const
+{
+    return yield;
+}
+
 /**
  * @class BucketedSector
  * @brief Represents a bucketed sector for grouping and aggregating securities' risks.
@@ -140,8 +202,20 @@ const string& BucketedSector<T>::GetName() const
 }
 
 //Forward Declaration
+
+// Heap owned by a PV01: its product
+template<typename T>
+size_t HeapBytes(const PV01<T>& _pv01)
+{
+    return HeapBytes(_pv01.GetProduct());
+}
+
 template<typename T>
 class PositionRiskListner;
+template<typename T>
+class PricingRiskListener;
+template<typename T>
+class TradeRiskListener;
 
 /**
  * @class RiskService
@@ -151,6 +225,22 @@ class PositionRiskListner;
  * for individual securities and aggregated risk for sectors. It handles positions and updates
  * the associated risk as needed.
  *
+ * Alongside the PV01 records, yield risk is kept as arrays indexed by product handle: the
+ * position, and per unit of face the modified duration, convexity, PV01 and key-rate PV01s.
+ * A price tick recomputes the analytics of its bond only and a position update only writes
+ * its quantity, so every portfolio figure is one reduction over the arrays. The PV01 records
+ * published on a position update carry the current PV01 per unit of face.
+ *
+ * Key-rate PV01 k is the PV01 of a 1bp bump of the k-th curve knot: the natural spline carries
+ * the bump to the time of every cash flow, whose discount at the bond yield moves accordingly.
+ * The spline is linear in the knot yields, so the move of each cash flow per unit bump of each
+ * knot is computed once from the knot times, and a tick only reprices the flows to first order.
+ * The spline reproduces a parallel shift, so the key rates of a bond add up to its PV01.
+ *
+ * Booked trades also feed a RiskHierarchy (book, desk, business, firm), which keeps the
+ * position of every node by product; each repricing hands the hierarchy the new PV01 and
+ * key-rate PV01s of the bond, so its node PV01s follow the market.
+ *
  * @tparam T The type of financial product.
  */
 template<typename T>
@@ -168,29 +258,126 @@ public:
     const vector<ServiceListener<PV01<T>>*>& GetListeners() const;
     PositionRiskListner<T>* GetListener();
 
+    PricingRiskListener<T>* GetPricingListener();
+    TradeRiskListener<T>* GetTradeListener();
+
     // Risk management functions
     void AddPosition(Position<T> &position);
     PV01<BucketedSector<T>> GetBucketedRisk(const BucketedSector<T>& sector) const;
 
+    // Push the position delta of a booked trade up the aggregation tree
+    void AddTrade(const Trade<T>& _trade);
+    RiskHierarchy& GetHierarchy();
+
+    // Recompute the yield risk of a bond for a new clean price
+    void UpdatePrice(const T& _product, double _cleanPrice);
+
+    // Read yields from the curve snapshot instead of solving them, its listener must run first
+    void SetCurveService(CurveService<T>* _curveService);
+
+    // Yield risk of a bond per unit of face, by handle
+    double GetModifiedDuration(uint32_t _handle) const;
+    double GetConvexity(uint32_t _handle) const;
+    double GetUnitPV01(uint32_t _handle) const;
+    double GetKeyRatePV01(uint32_t _handle, size_t _pillar) const;
+
+    // Number of repricings of a product so far, to tell when its per unit risk last changed
+    long GetRiskVersion(uint32_t _handle) const;
+
+    // Portfolio yield risk over the current positions
+    double GetPortfolioPV01() const;
+    double GetPortfolioKeyRatePV01(size_t _pillar) const;
+    double GetPortfolioDuration() const;
+    double GetPortfolioConvexity() const;
+
+    // Memory held by the service
+    ServiceMemoryStats MemoryStats() const;
+
 private:
-    unordered_map<string, PV01<T>> pvs;              ///< Map of PV01 values keyed by product ID
+    CountingResource memory;                              ///< Tagged allocator of the store
+    pmr::unordered_map<string, PV01<T>> pvs;              ///< Map of PV01 values keyed by product ID
     vector<ServiceListener<PV01<T>>*> listeners;     ///< Listeners for risk data changes
     PositionRiskListner<T>* posListener;             ///< Listener for position data changes
+    PricingRiskListener<T>* pricingListener;         ///< Listener for price changes
+    TradeRiskListener<T>* tradeListener;             ///< Listener for booked trades
+    RiskHierarchy hierarchy;                         ///< Aggregation tree of the booked risk
+    CurveService<T>* curveService;                   ///< Yield curve, optional
+
+    // Yield risk by product handle, per unit of face
+    array<BondSchedule, PRODUCT_COUNT> schedules;                    ///< Coupon schedules at settlement
+    array<double, PRODUCT_COUNT> maturities;                         ///< Years to maturity
+    array<double, PRODUCT_COUNT> quantities;                         ///< Aggregate positions
+    array<double, PRODUCT_COUNT> yields;                             ///< Yields the risk was last computed at
+    array<double, PRODUCT_COUNT> marketValues;                       ///< Dirty price per unit of face
+    array<double, PRODUCT_COUNT> durations;                          ///< Modified durations
+    array<double, PRODUCT_COUNT> convexities;                        ///< Convexities
+    array<double, PRODUCT_COUNT> unitPV01s;                          ///< PV01 per unit of face
+    array<long, PRODUCT_COUNT> riskVersions;                         ///< Repricings of each product
+    array<array<double, PRODUCT_COUNT>, KEY_RATE_PILLARS> keyRates;  ///< Key-rate PV01s, [pillar][handle]
+    array<vector<array<double, KEY_RATE_PILLARS>>, PRODUCT_COUNT> flowLoadings; ///< Yield move of each cash flow per unit bump of each knot, [handle][flow][pillar]
+
+    // Recompute the yield risk of a bond at a yield
+    void Revalue(uint32_t _handle, double _yield);
 };
 // **********************************************************************************
 //                  Implementation of RiskService...
 // **********************************************************************************
 template<typename T>
-RiskService<T>::RiskService()
+RiskService<T>::RiskService() :
+        pvs(&memory)
 {
-    pvs = unordered_map<string, PV01<T>>();
     listeners = vector<ServiceListener<PV01<T>>*>();
     posListener = new PositionRiskListner<T>(this);
+    pricingListener = new PricingRiskListener<T>(this);
+    tradeListener = new TradeRiskListener<T>(this);
+    curveService = nullptr;
+    riskVersions.fill(0);
+
+    // schedules and cash flow loadings only change with the settlement date
+    const date& _settlement = GetYieldEngine().GetSettlementDate();
+    for (uint32_t i = 0; i < PRODUCT_COUNT; ++i) {
+        Bond _bond = GetBond(string(PRODUCT_CUSIPS[i]));
+        schedules[i] = BondSchedule::Of(_bond, _settlement);
+        maturities[i] = static_cast<double>((_bond.GetMaturityDate() - _settlement).days()) / 365.25;
+    }
+
+    // the knots of the curve are the maturities of the on-the-run bonds; the spline through a unit
+    // bump of knot k gives the yield move of every cash flow for that key rate
+    array<double, KEY_RATE_PILLARS> _knots;
+    copy(maturities.begin(), maturities.end(), _knots.begin());
+    sort(_knots.begin(), _knots.end());
+    array<optional<YieldCurve>, KEY_RATE_PILLARS> _bumps;
+    for (size_t k = 0; k < KEY_RATE_PILLARS; ++k) {
+        array<double, KEY_RATE_PILLARS> _unit{};
+        _unit[k] = 1.0;
+        _bumps[k].emplace(YieldCurve::Fit(0, _settlement, _knots, _unit));
+    }
+    for (uint32_t i = 0; i < PRODUCT_COUNT; ++i) {
+        // flow j is paid w + j coupon periods (half years) from settlement
+        size_t _flows = static_cast<size_t>(schedules[i].periods);
+        flowLoadings[i].resize(_flows);
+        for (size_t j = 0; j < _flows; ++j) {
+            double _years = 0.5 * (schedules[i].fraction + static_cast<double>(j));
+            for (size_t k = 0; k < KEY_RATE_PILLARS; ++k) flowLoadings[i][j][k] = _bumps[k]->GetYield(_years);
+        }
+    }
+
+    // risk at the coupon yields until the first prices arrive
+    quantities.fill(0);
+    for (uint32_t i = 0; i < PRODUCT_COUNT; ++i) {
+        Revalue(i, schedules[i].coupon * 2.0 / 100.0);
+    }
 }
 
 template<typename T>
 RiskService<T>::~RiskService() {}
 
+template<typename T>
+ServiceMemoryStats RiskService<T>::MemoryStats() const
+{
+    return CollectMemoryStats("RiskService", memory, pvs);
+}
+
 template<typename T>
 void RiskService<T>::AddListener(ServiceListener<PV01<T>>* _listener)
 {
@@ -202,6 +389,30 @@ PositionRiskListner<T>* RiskService<T>::GetListener()
 {
     return posListener;
 }
+template<typename T>
+PricingRiskListener<T>* RiskService<T>::GetPricingListener()
+{
+    return pricingListener;
+}
+
+template<typename T>
+TradeRiskListener<T>* RiskService<T>::GetTradeListener()
+{
+    return tradeListener;
+}
+
+template<typename T>
+RiskHierarchy& RiskService<T>::GetHierarchy()
+{
+    return hierarchy;
+}
+
+template<typename T>
+void RiskService<T>::SetCurveService(CurveService<T>* _curveService)
+{
+    curveService = _curveService;
+}
+
 template<typename T>
 const std::vector<ServiceListener<PV01<T>>*>& RiskService<T>::GetListeners() const {
     return listeners;
@@ -221,6 +432,7 @@ PV01<T>& RiskService<T>::GetData(string key)
 template<typename T>
 void RiskService<T>::OnMessage(PV01<T>& data)
 {
+    ServiceProbe _probe(PROBE_PV01, data.GetProduct());
     string productId = data.GetProduct().GetProductId();
 
     // Check if the product ID already exists in the map
@@ -242,11 +454,21 @@ void RiskService<T>::OnMessage(PV01<T>& data)
 template<typename T>
 void RiskService<T>::AddPosition(Position<T>& position)
 {
+    TraceSpan _span("RiskService::AddPosition");
+    ServiceProbe _probe(PROBE_POSITION, position.GetProduct());
     T product = position.GetProduct();
     string iD = product.GetProductId();
-    double val = calculatePV01(iD);
     long qty = position.GetAggregatePosition();
-    PV01<T> pv01(product, val, qty);
+
+    // PV01 per unit of face at the last price
+    uint32_t _handle = GetProductHandle(iD);
+    double val = 0, yield = 0;
+    if (_handle != INVALID_PRODUCT_HANDLE) {
+        quantities[_handle] = static_cast<double>(qty);
+        val = unitPV01s[_handle];
+        yield = yields[_handle];
+    }
+    PV01<T> pv01(product, val, qty, yield);
 
     auto it = pvs.find(iD);
     if (it != pvs.end()) {
@@ -265,7 +487,6 @@ void RiskService<T>::AddPosition(Position<T>& position)
 }
 
 
-
 template<typename T>
 PV01<BucketedSector<T>> RiskService<T>::GetBucketedRisk(const BucketedSector<T>& sector) const
 {
@@ -284,13 +505,131 @@ PV01<BucketedSector<T>> RiskService<T>::GetBucketedRisk(const BucketedSector<T>&
     }
 
     // Create and return a PV01 object for the entire sector
-    // Note: You need to decide how to handle the product field for the sector PV01
-    // For now, we are using a default-constructed BucketedSector<T> object
-    BucketedSector<T> dummySector; // Assuming BucketedSector<T> has a default constructor
-    return PV01<BucketedSector<T>>(dummySector, totalPV01, totalQuantity);
+    return PV01<BucketedSector<T>>(sector, totalPV01, totalQuantity);
+}
+
+template<typename T>
+void RiskService<T>::AddTrade(const Trade<T>& _trade)
+{
+    TraceSpan _span("RiskService::AddTrade");
+    const string& _productId = _trade.GetProduct().GetProductId();
+    long _quantity = _trade.GetSide() == BUY ? _trade.GetQuantity() : -_trade.GetQuantity();
+    hierarchy.Apply(string(_trade.GetBook()), GetProductHandle(_productId), _quantity);
+}
+
+
+
+
+template<typename T>
+void RiskService<T>::UpdatePrice(const T& _product, double _cleanPrice)
+{
+    uint32_t _handle = GetProductHandle(_product.GetProductId());
+    if (_handle == INVALID_PRODUCT_HANDLE) return;
+
+    double _yield = curveService ? curveService->GetCurve()->GetYield(maturities[_handle])
+                                 : GetYieldEngine().PriceToYield(_handle, _cleanPrice);
+    Revalue(_handle, _yield);
+}
+
+template<typename T>
+void RiskService<T>::Revalue(uint32_t _handle, double _yield)
+{
+    const BondSchedule& _schedule = schedules[_handle];
+
+    // effective duration and convexity from a 1bp bump either side, all three prices at the same
+    // yield: the curve yield can differ from the one implied by the market price
+    const double _bump = 1e-4;
+    double _dirty = _schedule.CleanPrice(_yield) + _schedule.accrued;
+    double _down = _schedule.CleanPrice(_yield - _bump) + _schedule.accrued;
+    double _up = _schedule.CleanPrice(_yield + _bump) + _schedule.accrued;
+
+    yields[_handle] = _yield;
+    marketValues[_handle] = _dirty / 100.0;
+    durations[_handle] = (_down - _up) / (2.0 * _bump * _dirty);
+    convexities[_handle] = (_down + _up - 2.0 * _dirty) / (_bump * _bump * _dirty);
+    unitPV01s[_handle] = durations[_handle] * marketValues[_handle] * 1e-4;
+
+    // a flow paid in m periods is worth F v^m, which moves by F m/2 v^(m+1) per unit of yield
+    double _v = 1.0 / (1.0 + 0.5 * _yield);
+    double _discount = pow(_v, _schedule.fraction + 1.0);
+    const auto& _loadings = flowLoadings[_handle];
+    array<double, KEY_RATE_PILLARS> _keyRates{};
+    for (size_t j = 0; j < _loadings.size(); ++j) {
+        double _flow = _schedule.coupon + (j + 1 == _loadings.size() ? 100.0 : 0.0);
+        double _sensitivity = _flow * 0.5 * (_schedule.fraction + static_cast<double>(j)) * _discount;
+        for (size_t k = 0; k < KEY_RATE_PILLARS; ++k) _keyRates[k] += _sensitivity * _loadings[j][k];
+        _discount *= _v;
+    }
+    // per unit of face, for a 1bp bump
+    for (size_t k = 0; k < KEY_RATE_PILLARS; ++k) {
+        _keyRates[k] *= 1e-6;
+        keyRates[k][_handle] = _keyRates[k];
+    }
+    hierarchy.SetProductRisk(_handle, unitPV01s[_handle], _keyRates);
+    riskVersions[_handle]++;
+}
+
+template<typename T>
+long RiskService<T>::GetRiskVersion(uint32_t _handle) const
+{
+    return riskVersions.at(_handle);
+}
+
+template<typename T>
+double RiskService<T>::GetModifiedDuration(uint32_t _handle) const
+{
+    return durations.at(_handle);
+}
+
+template<typename T>
+double RiskService<T>::GetConvexity(uint32_t _handle) const
+{
+    return convexities.at(_handle);
 }
 
+template<typename T>
+double RiskService<T>::GetUnitPV01(uint32_t _handle) const
+{
+    return unitPV01s.at(_handle);
+}
 
+template<typename T>
+double RiskService<T>::GetKeyRatePV01(uint32_t _handle, size_t _pillar) const
+{
+    return keyRates.at(_pillar).at(_handle);
+}
+
+template<typename T>
+double RiskService<T>::GetPortfolioPV01() const
+{
+    return inner_product(quantities.begin(), quantities.end(), unitPV01s.begin(), 0.0);
+}
+
+template<typename T>
+double RiskService<T>::GetPortfolioKeyRatePV01(size_t _pillar) const
+{
+    const array<double, PRODUCT_COUNT>& _keyRates = keyRates.at(_pillar);
+    return inner_product(quantities.begin(), quantities.end(), _keyRates.begin(), 0.0);
+}
+
+template<typename T>
+double RiskService<T>::GetPortfolioDuration() const
+{
+    // market value weighted, i.e. the portfolio PV01 per unit of market value
+    double _value = inner_product(quantities.begin(), quantities.end(), marketValues.begin(), 0.0);
+    return _value != 0 ? GetPortfolioPV01() / (_value * 1e-4) : 0.0;
+}
+
+template<typename T>
+double RiskService<T>::GetPortfolioConvexity() const
+{
+    double _value = 0, _weighted = 0;
+    for (uint32_t i = 0; i < PRODUCT_COUNT; ++i) {
+        _value += quantities[i] * marketValues[i];
+        _weighted += quantities[i] * marketValues[i] * convexities[i];
+    }
+    return _value != 0 ? _weighted / _value : 0.0;
+}
 
 
 /**
@@ -342,7 +681,7 @@ PositionRiskListner<T>::~PositionRiskListner() {}
 template<typename T>
 void PositionRiskListner<T>::ProcessAdd(Position<T>& _data)
 {
-    //printInYellow("Risk Listener triggered");
+    LOG(LEVEL_DEBUG, "Risk listener triggered for {}", _data.GetProduct().GetProductId());
     risk->AddPosition(_data);
 }
 
@@ -353,4 +692,115 @@ template<typename T>
 void PositionRiskListner<T>::ProcessUpdate(Position<T>& _data) {}
 
 
+/**
+ * @class PricingRiskListener
+ * @brief Listener forwarding prices from the PricingService to the RiskService yield risk.
+ *
+ * @tparam T The type of financial product.
+ */
+template<typename T>
+class PricingRiskListener : public ServiceListener<Price<T>>
+{
+
+private:
+
+    RiskService<T>* risk;
+
+public:
+
+    // Constructor and Destructor
+    PricingRiskListener(RiskService<T>* service);
+    ~PricingRiskListener();
+
+    // Listener callback to process an add event to the Service
+    void ProcessAdd(Price<T>& _data);
+
+    // Listener callback to process a remove event to the Service (not implemented)
+    void ProcessRemove(Price<T>& _data);
+
+    // Listener callback to process an update event to the Service (not implemented)
+    void ProcessUpdate(Price<T>& _data);
+
+};
+// **********************************************************************************
+//                  Implementation of PricingRiskListener...
+// **********************************************************************************
+template<typename T>
+PricingRiskListener<T>::PricingRiskListener(RiskService<T>* service)
+{
+    risk = service;
+}
+
+template<typename T>
+PricingRiskListener<T>::~PricingRiskListener() {}
+
+template<typename T>
+void PricingRiskListener<T>::ProcessAdd(Price<T>& _data)
+{
+    TraceSpan _span("PricingRiskListener::ProcessAdd");
+    risk->UpdatePrice(_data.GetProduct(), _data.GetMid());
+}
+
+template<typename T>
+void PricingRiskListener<T>::ProcessRemove(Price<T>& _data) {}
+
+template<typename T>
+void PricingRiskListener<T>::ProcessUpdate(Price<T>& _data) {}
+
+
+/**
+ * @class TradeRiskListener
+ * @brief Listener forwarding booked trades from the TradeBookingService to the risk hierarchy.
+ *
+ * @tparam T The type of financial product.
+ */
+template<typename T>
+class TradeRiskListener : public ServiceListener<Trade<T>>
+{
+
+private:
+
+    RiskService<T>* risk;
+
+public:
+
+    // Constructor and Destructor
+    TradeRiskListener(RiskService<T>* service);
+    ~TradeRiskListener();
+
+    // Listener callback to process an add event to the Service
+    void ProcessAdd(Trade<T>& _data);
+
+    // Listener callback to process a remove event to the Service (not implemented)
+    void ProcessRemove(Trade<T>& _data);
+
+    // Listener callback to process an update event to the Service (not implemented)
+    void ProcessUpdate(Trade<T>& _data);
+
+};
+// **********************************************************************************
+//                  Implementation of TradeRiskListener...
+// **********************************************************************************
+template<typename T>
+TradeRiskListener<T>::TradeRiskListener(RiskService<T>* service)
+{
+    risk = service;
+}
+
+template<typename T>
+TradeRiskListener<T>::~TradeRiskListener() {}
+
+template<typename T>
+void TradeRiskListener<T>::ProcessAdd(Trade<T>& _data)
+{
+    risk->AddTrade(_data);
+}
+
+template<typename T>
+void TradeRiskListener<T>::ProcessRemove(Trade<T>& _data) {}
+
+template<typename T>
+void TradeRiskListener<T>::ProcessUpdate(Trade<T>& _data) {}
+
+
 #endif
@@ -11,6 +11,7 @@
 
 #include "soa.hpp"
 #include "marketdataservice.hpp"
+#include "utils/probes.hpp"
 
 /**
  * @class PriceStreamOrder
@@ -195,6 +196,14 @@ const PriceStreamOrder& PriceStream<T>::GetOfferOrder() const
 
 
 // FORWARD DECLARATIONS FOR THE SERVICE
+
+// Heap owned by a price stream: its product
+template<typename T>
+size_t HeapBytes(const PriceStream<T>& _stream)
+{
+    return HeapBytes(_stream.GetProduct());
+}
+
 template<typename T>
 class AlgoStream;
 template<typename T>
@@ -215,7 +224,8 @@ class StreamingService : public Service<string,PriceStream <T> >
 {
 private:
     // required attributes
-    unordered_map<string, PriceStream<T>> pStreams;
+    CountingResource memory;  ///< Tagged allocator of the store
+    pmr::unordered_map<string, PriceStream<T>> pStreams;
     vector<ServiceListener<PriceStream<T>>*> listeners;
     ServiceListener<AlgoStream<T>>* asListener; // service listener
 
@@ -268,21 +278,30 @@ public:
    */
     void PublishPrice(PriceStream<T>& priceStream);
 
+    // Memory held by the service
+    ServiceMemoryStats MemoryStats() const;
+
 };
 
 // **********************************************************************************
 //                  Implementation of StreamingService...
 // **********************************************************************************
 template<typename T>
-StreamingService<T>::StreamingService()
+StreamingService<T>::StreamingService() :
+        pStreams(&memory)
 {
-    pStreams = unordered_map<string, PriceStream<T>>();
     listeners = vector<ServiceListener<PriceStream<T>>*>();
     asListener = new ASStreamingListener<T>(this);
 }
 template<typename T>
 StreamingService<T>::~StreamingService() {}
 
+template<typename T>
+ServiceMemoryStats StreamingService<T>::MemoryStats() const
+{
+    return CollectMemoryStats("StreamingService", memory, pStreams);
+}
+
 template<typename T>
 void StreamingService<T>::AddListener(ServiceListener<PriceStream<T>>* listener)
 {
@@ -311,6 +330,8 @@ PriceStream<T>& StreamingService<T>::GetData(string key){
 }
 template<typename T>
 void StreamingService<T>::OnMessage(PriceStream<T>& data){
+    TraceSpan _span("StreamingService::OnMessage");
+    ServiceProbe _probe(PROBE_PRICE_STREAM, data.GetProduct());
     std::string productId = data.GetProduct().GetProductId();
 
     auto it = pStreams.find(productId);
@@ -411,7 +432,7 @@ ASStreamingListener<T>::~ASStreamingListener() {}
 template<typename T>
 void ASStreamingListener<T>::ProcessAdd(AlgoStream<T>& data)
 {
-    //printInYellow("Streaming from AS listener triggered");
+    LOG(LEVEL_DEBUG, "Streaming from AS listener triggered");
     PriceStream<T>* _priceStream = data.GetPriceStream();
     stream->OnMessage(*_priceStream);
 }
@@ -0,0 +1,435 @@
+/**
+ * @file tcaservice.hpp
+ * @brief Defines the data types and Service for transaction-cost analysis of executions.
+ *
+ * This file includes the definition of ExecutionCost, the cost of one order sent against the
+ * market at its arrival, TcaAccumulator, the running totals of a set of orders, and the
+ * TcaService, which listens to the ExecutionService and aggregates the costs by product,
+ * strategy and venue as orders are sent.
+ *
+ * @author Niccolo Fabbri
+ */
+#ifndef TCA_SERVICE_HPP
+#define TCA_SERVICE_HPP
+
+#include <array>
+#include <optional>
+#include <string>
+#include <vector>
+#include "soa.hpp"
+#include "executionservice.hpp"
+#include "allocationengine.hpp"
+#include "utils/utils.hpp"
+
+using namespace std;
+
+/**
+ * @class ExecutionCost
+ * @brief Cost of an order sent, measured against the order book when it was created.
+ *
+ * There are no venue fills: a sent order counts as done in full at its price, which the algo
+ * sets at the touch it takes. Slippage is in price points per 100 face, positive when the price
+ * is worse than the arrival mid. Spread capture is the share of the arrival half-spread earned:
+ * 1 at the touch of the passive side, -1 when crossing to the far touch, as the algo always
+ * does unless the market moved before a throttled order went out. Participation is the order
+ * quantity over the quantity shown at the arrival touch taken.
+ *
+ * @tparam T The product type.
+ */
+template<typename T>
+class ExecutionCost
+{
+public:
+    ExecutionCost(const T& _product, const string& _orderId, Market _venue, uint32_t _strategyId, PricingSide _side,
+                  double _arrivalMid, double _arrivalSpread, long _touchQuantity, double _price, long _quantity);
+
+    // Getters
+    const T& GetProduct() const;
+    const string& GetOrderId() const;
+    Market GetVenue() const;
+    uint32_t GetStrategyId() const;
+    PricingSide GetSide() const;
+    double GetArrivalMid() const;
+    long GetTouchQuantity() const;
+    double GetPrice() const;
+    long GetQuantity() const;
+    double GetSlippage() const;
+    double GetSpreadCapture() const;
+    double GetParticipation() const;
+
+    // Formatted output for historical data
+    vector<string> HDFormat() const;
+
+private:
+    T product;
+    string orderId;
+    Market venue;
+    uint32_t strategyId;
+    PricingSide side;
+    double arrivalMid;
+    double arrivalSpread;
+    long touchQuantity;
+    double price;
+    long quantity;
+};
+// **********************************************************************************
+//                  Implementation of ExecutionCost...
+// **********************************************************************************
+template<typename T>
+ExecutionCost<T>::ExecutionCost(const T& _product, const string& _orderId, Market _venue, uint32_t _strategyId,
+                                PricingSide _side, double _arrivalMid, double _arrivalSpread, long _touchQuantity,
+                                double _price, long _quantity) :
+        product(_product)
+{
+    orderId = _orderId;
+    venue = _venue;
+    strategyId = _strategyId;
+    side = _side;
+    arrivalMid = _arrivalMid;
+    arrivalSpread = _arrivalSpread;
+    touchQuantity = _touchQuantity;
+    price = _price;
+    quantity = _quantity;
+}
+
+template<typename T>
+const T& ExecutionCost<T>::GetProduct() const
+{
+    return product;
+}
+
+template<typename T>
+const string& ExecutionCost<T>::GetOrderId() const
+{
+    return orderId;
+}
+
+template<typename T>
+Market ExecutionCost<T>::GetVenue() const
+{
+    return venue;
+}
+
+template<typename T>
+uint32_t ExecutionCost<T>::GetStrategyId() const
+{
+    return strategyId;
+}
+
+template<typename T>
+PricingSide ExecutionCost<T>::GetSide() const
+{
+    return side;
+}
+
+template<typename T>
+double ExecutionCost<T>::GetArrivalMid() const
+{
+    return arrivalMid;
+}
+
+template<typename T>
+long ExecutionCost<T>::GetTouchQuantity() const
+{
+    return touchQuantity;
+}
+
+template<typename T>
+double ExecutionCost<T>::GetPrice() const
+{
+    return price;
+}
+
+template<typename T>
+long ExecutionCost<T>::GetQuantity() const
+{
+    return quantity;
+}
+
+template<typename T>
+double ExecutionCost<T>::GetSlippage() const
+{
+    // a BID order sells at the bid, an OFFER order buys at the offer
+    return side == BID ? arrivalMid - price : price - arrivalMid;
+}
+
+template<typename T>
+double ExecutionCost<T>::GetSpreadCapture() const
+{
+    return arrivalSpread > 0 ? -GetSlippage() / (0.5 * arrivalSpread) : 0.0;
+}
+
+template<typename T>
+double ExecutionCost<T>::GetParticipation() const
+{
+    return touchQuantity > 0 ? static_cast<double>(quantity) / static_cast<double>(touchQuantity) : 0.0;
+}
+
+template<typename T>
+vector<string> ExecutionCost<T>::HDFormat() const
+{
+    vector<string> formattedOutput;
+    formattedOutput.push_back(product.GetProductId());
+    formattedOutput.push_back(orderId);
+    formattedOutput.push_back(string(MARKET_NAMES[venue]));
+    formattedOutput.push_back(to_string(strategyId));
+    formattedOutput.push_back(side == BID ? "BID" : "OFFER");
+    formattedOutput.push_back(FormatPrice(arrivalMid));
+    formattedOutput.push_back(FormatPrice(price));
+    formattedOutput.push_back(to_string(quantity));
+    formattedOutput.push_back(to_string(GetSlippage()));
+    formattedOutput.push_back(to_string(GetSpreadCapture()));
+    formattedOutput.push_back(to_string(GetParticipation()));
+    return formattedOutput;
+}
+
+
+/**
+ * @struct TcaAccumulator
+ * @brief Running totals of a set of orders sent; the averages are weighted by quantity.
+ */
+struct TcaAccumulator
+{
+    long orders = 0;
+    long quantity = 0;
+    long touchQuantity = 0;
+    double slippage = 0;       ///< Sum of quantity * slippage
+    double spreadCapture = 0;  ///< Sum of quantity * spread capture
+
+    template<typename T>
+    void Add(const ExecutionCost<T>& _cost);
+
+    double AverageSlippage() const;
+    double AverageSpreadCapture() const;
+    double Participation() const;
+};
+// **********************************************************************************
+//                  Implementation of TcaAccumulator...
+// **********************************************************************************
+template<typename T>
+void TcaAccumulator::Add(const ExecutionCost<T>& _cost)
+{
+    double _quantity = static_cast<double>(_cost.GetQuantity());
+    orders++;
+    quantity += _cost.GetQuantity();
+    touchQuantity += _cost.GetTouchQuantity();
+    slippage += _quantity * _cost.GetSlippage();
+    spreadCapture += _quantity * _cost.GetSpreadCapture();
+}
+
+double TcaAccumulator::AverageSlippage() const
+{
+    return quantity > 0 ? slippage / static_cast<double>(quantity) : 0.0;
+}
+
+double TcaAccumulator::AverageSpreadCapture() const
+{
+    return quantity > 0 ? spreadCapture / static_cast<double>(quantity) : 0.0;
+}
+
+double TcaAccumulator::Participation() const
+{
+    return touchQuantity > 0 ? static_cast<double>(quantity) / static_cast<double>(touchQuantity) : 0.0;
+}
+
+
+// Forward declarations
+template<typename T>
+class ExecutionTcaListener;
+
+/**
+ * @class TcaService
+ * @brief Service measuring the cost of every order sent and aggregating it as orders go out.
+ *
+ * Each order is costed against the arrival snapshot it carries from its creation, so an order
+ * held by the rate limits is still measured against the book it reacted to. The costs are
+ * added to fixed-size accumulators by product, by strategy (the last slot gathers ids beyond
+ * AllocationEngine::STRATEGY_COUNT) and by venue; orders without a snapshot are skipped.
+ * The service is keyed on product identifier and holds the last execution cost of each product.
+ *
+ * @tparam T The product type.
+ */
+template<typename T>
+class TcaService : public Service<string, ExecutionCost<T>>
+{
+public:
+    static constexpr size_t STRATEGY_SLOTS = AllocationEngine::STRATEGY_COUNT + 1;
+
+    // Constructor and destructor
+    TcaService();
+    ~TcaService();
+
+    // Service interface methods
+    ExecutionCost<T>& GetData(string key);
+    void OnMessage(ExecutionCost<T>& data);
+    void AddListener(ServiceListener<ExecutionCost<T>>* listener);
+    const vector<ServiceListener<ExecutionCost<T>>*>& GetListeners() const;
+    ExecutionTcaListener<T>* GetListener();
+
+    // Cost an order sent against its arrival snapshot
+    void OnExecution(const ExecutionOrder<T>& _order);
+
+    // Aggregates
+    const TcaAccumulator& GetByProduct(uint32_t _handle) const;
+    const TcaAccumulator& GetByStrategy(uint32_t _strategyId) const;
+    const TcaAccumulator& GetByVenue(Market _venue) const;
+
+    // Memory held by the service
+    ServiceMemoryStats MemoryStats() const;
+
+private:
+    array<TcaAccumulator, PRODUCT_COUNT> byProduct;
+    array<TcaAccumulator, STRATEGY_SLOTS> byStrategy;
+    array<TcaAccumulator, MARKET_COUNT> byVenue;
+    vector<optional<ExecutionCost<T>>> lastCosts;  ///< Last execution cost of each product
+    vector<ServiceListener<ExecutionCost<T>>*> listeners;
+    ExecutionTcaListener<T>* executionListener;
+};
+// **********************************************************************************
+//                  Implementation of TcaService...
+// **********************************************************************************
+template<typename T>
+TcaService<T>::TcaService() :
+        lastCosts(PRODUCT_COUNT)
+{
+    listeners = vector<ServiceListener<ExecutionCost<T>>*>();
+    executionListener = new ExecutionTcaListener<T>(this);
+}
+
+template<typename T>
+TcaService<T>::~TcaService() {}
+
+template<typename T>
+ExecutionCost<T>& TcaService<T>::GetData(string key)
+{
+    uint32_t _handle = GetProductHandle(key);
+    if (_handle != INVALID_PRODUCT_HANDLE && lastCosts[_handle]) return *lastCosts[_handle];
+    throw std::runtime_error("Execution cost not found for key: " + key);
+}
+
+template<typename T>
+void TcaService<T>::OnMessage(ExecutionCost<T>& data)
+{
+    for (auto& lstn : listeners) {
+        lstn->ProcessAdd(data);
+    }
+}
+
+template<typename T>
+void TcaService<T>::AddListener(ServiceListener<ExecutionCost<T>>* listener)
+{
+    listeners.push_back(listener);
+}
+
+template<typename T>
+const vector<ServiceListener<ExecutionCost<T>>*>& TcaService<T>::GetListeners() const
+{
+    return listeners;
+}
+
+template<typename T>
+ExecutionTcaListener<T>* TcaService<T>::GetListener()
+{
+    return executionListener;
+}
+
+template<typename T>
+void TcaService<T>::OnExecution(const ExecutionOrder<T>& _order)
+{
+    TraceSpan _span("TcaService::OnExecution");
+    uint32_t _handle = GetProductHandle(_order.GetProduct().GetProductId());
+    if (_handle == INVALID_PRODUCT_HANDLE || !_order.HasArrival()) return;
+
+    ExecutionCost<T> _cost(_order.GetProduct(), _order.GetOrderId(), _order.GetVenue(), _order.GetStrategyId(),
+                           _order.GetPricingSide(), _order.GetArrivalMid(), _order.GetArrivalSpread(),
+                           _order.GetTouchQuantity(), _order.GetPrice(),
+                           _order.GetVisibleQuantity() + _order.GetHiddenQuantity());
+    byProduct[_handle].Add(_cost);
+    byStrategy[min<size_t>(_cost.GetStrategyId(), STRATEGY_SLOTS - 1)].Add(_cost);
+    byVenue[_cost.GetVenue()].Add(_cost);
+    lastCosts[_handle] = _cost;
+    OnMessage(*lastCosts[_handle]);
+}
+
+template<typename T>
+const TcaAccumulator& TcaService<T>::GetByProduct(uint32_t _handle) const
+{
+    return byProduct.at(_handle);
+}
+
+template<typename T>
+const TcaAccumulator& TcaService<T>::GetByStrategy(uint32_t _strategyId) const
+{
+    return byStrategy[min<size_t>(_strategyId, STRATEGY_SLOTS - 1)];
+}
+
+template<typename T>
+const TcaAccumulator& TcaService<T>::GetByVenue(Market _venue) const
+{
+    return byVenue.at(_venue);
+}
+
+template<typename T>
+ServiceMemoryStats TcaService<T>::MemoryStats() const
+{
+    ServiceMemoryStats _stats;
+    _stats.service = "TcaService";
+    _stats.containerBytes = _stats.peakContainerBytes = lastCosts.capacity() * sizeof(optional<ExecutionCost<T>>);
+    for (size_t i = 0; i < lastCosts.size(); ++i) {
+        if (!lastCosts[i]) continue;
+        size_t _payload = HeapBytes(lastCosts[i]->GetProduct()) + HeapBytes(lastCosts[i]->GetOrderId());
+        _stats.entries++;
+        _stats.payloadBytes += _payload;
+        _stats.bytesPerProduct[string(PRODUCT_CUSIPS[i])] += sizeof(optional<ExecutionCost<T>>) + _payload;
+    }
+    return _stats;
+}
+
+
+/**
+ * @class ExecutionTcaListener
+ * @brief Listener forwarding the orders sent by the ExecutionService to the TcaService.
+ *
+ * @tparam T The product type.
+ */
+template<typename T>
+class ExecutionTcaListener : public ServiceListener<ExecutionOrder<T>>
+{
+public:
+    // Constructor and Destructor
+    ExecutionTcaListener(TcaService<T>* service);
+    ~ExecutionTcaListener();
+
+    // Listener interface methods
+    void ProcessAdd(ExecutionOrder<T>& data);
+    void ProcessRemove(ExecutionOrder<T>& data);
+    void ProcessUpdate(ExecutionOrder<T>& data);
+
+private:
+    TcaService<T>* tca; ///< Reference to the TcaService
+};
+// **********************************************************************************
+//                  Implementation of ExecutionTcaListener...
+// **********************************************************************************
+template<typename T>
+ExecutionTcaListener<T>::ExecutionTcaListener(TcaService<T>* service)
+{
+    tca = service;
+}
+
+template<typename T>
+ExecutionTcaListener<T>::~ExecutionTcaListener() {}
+
+template<typename T>
+void ExecutionTcaListener<T>::ProcessAdd(ExecutionOrder<T>& data)
+{
+    tca->OnExecution(data);
+}
+
+template<typename T>
+void ExecutionTcaListener<T>::ProcessRemove(ExecutionOrder<T>& data) {}
+
+template<typename T>
+void ExecutionTcaListener<T>::ProcessUpdate(ExecutionOrder<T>& data) {}
+
+#endif //TCA_SERVICE_HPP
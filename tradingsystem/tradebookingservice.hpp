@@ -12,14 +12,27 @@
 #include <tuple>
 #include <fstream>
 #include <sstream>
+#include <memory_resource>
+#include <string_view>
 #include "soa.hpp"
 #include "utils/utils.hpp"
+#include "utils/probes.hpp"
+#include "utils/arena.hpp"
+#include "utils/bulkloader.hpp"
+#include "utils/enumparser.hpp"
+#include "utils/retention.hpp"
 #include "executionservice.hpp"
+#include "allocationengine.hpp"
 // Trade sides
 enum Side { BUY, SELL };
 
+// Parser for the side column of the trade and inquiry files
+constexpr EnumParser<Side, 2> SideParser("Side", {{"BUY", BUY}, {"SELL", SELL}});
+
 /**
  * Trade object with a price, side, and quantity on a particular book.
+ * The trade ID is interned in the trading day arena, so a trade must not outlive the
+ * trading day it was booked in; the book is a view of a name stored once elsewhere.
  * Type T is the product type.
  */
 template<typename T>
@@ -28,20 +41,21 @@ class Trade
 
 public:
 
-  // ctor for a trade
-  Trade(T &_product, string _tradeId, double _price, string _book, long _quantity, Side _side);
+  // ctor for a trade; the ID is interned, the book must be a view that outlives the trade
+  // (a book name of the AllocationEngine)
+  Trade(T &_product, string_view _tradeId, double _price, string_view _book, long _quantity, Side _side);
 
   // Get the product
   const T& GetProduct() const;
 
   // Get the trade ID
-  const string& GetTradeId() const;
+  string_view GetTradeId() const;
 
   // Get the mid price
   double GetPrice() const;
 
   // Get the book
-  const string& GetBook() const;
+  string_view GetBook() const;
 
   // Get the quantity
   long GetQuantity() const;
@@ -49,11 +63,14 @@ public:
   // Get the side
   Side GetSide() const;
 
+  // Formatted output for historical data, in the column order of the trades input file
+  vector<string> HDFormat() const;
+
 private:
   T product;
-  string tradeId;
+  string_view tradeId;
   double price;
-  string book;
+  string_view book;
   long quantity;
   Side side;
 
@@ -62,10 +79,10 @@ private:
 
 
 template<typename T>
-Trade<T>::Trade(T &_product, string _tradeId, double _price, string _book, long _quantity, Side _side) :
+Trade<T>::Trade(T &_product, string_view _tradeId, double _price, string_view _book, long _quantity, Side _side) :
   product(_product)
 {
-  tradeId = _tradeId;
+  tradeId = GetTradingDayArena().Intern(_tradeId);
   price = _price;
   book = _book;
   quantity = _quantity;
@@ -79,7 +96,7 @@ const T& Trade<T>::GetProduct() const
 }
 
 template<typename T>
-const string& Trade<T>::GetTradeId() const
+string_view Trade<T>::GetTradeId() const
 {
   return tradeId;
 }
@@ -91,7 +108,7 @@ double Trade<T>::GetPrice() const
 }
 
 template<typename T>
-const string& Trade<T>::GetBook() const
+string_view Trade<T>::GetBook() const
 {
   return book;
 }
@@ -108,7 +125,28 @@ Side Trade<T>::GetSide() const
   return side;
 }
 
+template<typename T>
+vector<string> Trade<T>::HDFormat() const
+{
+  vector<string> formattedOutput;
+  formattedOutput.push_back(product.GetProductId());
+  formattedOutput.push_back(string(tradeId));
+  formattedOutput.push_back(FormatPrice(price));
+  formattedOutput.push_back(string(book));
+  formattedOutput.push_back(to_string(quantity));
+  formattedOutput.push_back(side == BUY ? "BUY" : "SELL");
+  return formattedOutput;
+}
+
 // fwd declaration for connector
+
+// Heap owned by a trade: its product; the trade ID lives in the arena, the book is shared
+template<typename T>
+size_t HeapBytes(const Trade<T>& _trade)
+{
+    return HeapBytes(_trade.GetProduct());
+}
+
 template<typename T>
 class TradeBookingConnector;
 template<typename T>
@@ -120,7 +158,8 @@ class ExecutionBookingListener;
  *
  * This service manages the booking of trades for different types of financial products.
  * It maintains a record of all trades and notifies listeners about new or updated trades.
- * The service is keyed on the trade ID.
+ * The service is keyed on the trade ID. Trade IDs and trade records live in the trading
+ * day arena and are dropped together at the end of the day.
  *
  * @tparam T The type of the financial product.
  */
@@ -145,18 +184,35 @@ public:
     TradeBookingConnector<T>* GetConnector();
     ExecutionBookingListener<T>* GetListener();
 
+    // Drop the intraday trades before the trading day arena is released
+    void EndOfDay();
+
+    // Memory held by the service
+    ServiceMemoryStats MemoryStats() const;
+
+    // Bound the trades kept in memory; listeners still see every trade
+    void SetRetentionPolicy(RetentionPolicy _policy);
+
+    // Rules allocating execution fills to books, compiled before the first fill
+    AllocationEngine& GetAllocationEngine();
+
 private:
-    std::unordered_map<std::string, Trade<T>> trades; // Storage for trades
+    std::pmr::unsynchronized_pool_resource pool; // Recycles the nodes of evicted trades, drawing from the trading day arena
+    CountingResource memory; // Tagged allocator of the trades
+    std::pmr::unordered_map<std::string_view, Retained<std::string_view, Trade<T>>> trades; // Storage for trades, keyed on arena-owned IDs
+    RetentionIndex<std::string_view> retention; // Recency of the trades for the retention policy
     std::vector<ServiceListener<Trade<T>>*> listeners; // Listeners for trade events
     TradeBookingConnector<T>* connector; // Connector for trade data
     ExecutionBookingListener<T>* exeListener; // Listener for execution order events
+    AllocationEngine allocation; // Book of each execution fill
 };
 // **********************************************************************************
 //                  Implementation of TradeBookingService...
 // **********************************************************************************
 template<typename T>
-TradeBookingService<T>::TradeBookingService() {
-    trades = std::unordered_map<std::string, Trade<T>>();
+TradeBookingService<T>::TradeBookingService() :
+        pool(GetTradingDayArena().GetResource()), memory(&pool), trades(&memory)
+{
     listeners = std::vector<ServiceListener<Trade<T>>*>();
     connector = new TradeBookingConnector<T>(this);
     exeListener = new ExecutionBookingListener<T>(this);
@@ -173,16 +229,17 @@ TradeBookingConnector<T>* TradeBookingService<T>::GetConnector()
 
 template<typename T>
 void TradeBookingService<T>::OnMessage(Trade<T> &data) {
-    // Save trade
-    std::string tradeId = data.GetTradeId();
-    auto it = trades.find(tradeId);
+    TraceSpan _span("TradeBookingService::OnMessage");
+    ServiceProbe _probe(PROBE_TRADE, data.GetProduct());
+    // Save trade, keyed on its ID which already lives in the trading day arena
+    auto it = trades.find(data.GetTradeId());
     if (it != trades.end()) {
         // Update the existing trade
-        it->second = data;
+        it->second.value = data;
     } else {
-        // Insert the new trade
-        trades.insert({tradeId, data});
+        it = trades.emplace(data.GetTradeId(), data).first;
     }
+    retention.Touch(it->first, it->second.hook, [this](std::string_view _key) { trades.erase(_key); });
 
 
     for (auto listener: listeners){
@@ -209,15 +266,44 @@ const std::vector<ServiceListener<Trade<T>>*>& TradeBookingService<T>::GetListen
 }
 template<typename T>
 Trade<T>& TradeBookingService<T>::GetData(std::string key){
+    retention.Expire([this](std::string_view _key) { trades.erase(_key); });
     auto it = trades.find(key);
     if (it != trades.end()) {
-        return it->second;
+        return it->second.value;
     } else {
         // Handle the case where the key is not found. For example:
         throw std::runtime_error("Trade not found for key: " + key);
     }
 }
 
+template<typename T>
+void TradeBookingService<T>::EndOfDay()
+{
+    // swap in an empty map so no buckets are left pointing into the arena
+    trades = decltype(trades)(&memory);
+    retention.Clear();
+    pool.release();
+}
+
+template<typename T>
+void TradeBookingService<T>::SetRetentionPolicy(RetentionPolicy _policy)
+{
+    retention.SetPolicy(_policy);
+}
+
+template<typename T>
+AllocationEngine& TradeBookingService<T>::GetAllocationEngine()
+{
+    return allocation;
+}
+
+template<typename T>
+ServiceMemoryStats TradeBookingService<T>::MemoryStats() const
+{
+    return CollectMemoryStats("TradeBookingService", memory, trades,
+                              [](string_view, const auto& _record) { return _record.value.GetProduct().GetProductId(); });
+}
+
 template<typename T>
 void TradeBookingService<T>::BookTrade(const Trade<T> &trade)
 {
@@ -227,7 +313,6 @@ void TradeBookingService<T>::BookTrade(const Trade<T> &trade)
 
 
 
-
 /**
  * @class TradeBookingConnector
  * @brief Connector for the TradeBookingService to handle trade data interaction.
@@ -253,8 +338,8 @@ public:
 private:
     TradeBookingService<T>* _book; // Reference to the associated TradeBookingService
 
-    // Helper methods for parsing and creating trades
-    std::tuple<std::string, std::string, double, std::string, long, std::string> ParseLine(const std::string& line);
+    // Helper methods for parsing and creating trades; parsing runs on the bulk loader threads
+    static std::tuple<std::string, std::string, double, std::string, long, std::string> ParseLine(const std::string& line);
     Trade<T> CreateTrade(const std::tuple<std::string, std::string, double, std::string, long, std::string>& tradeData);
 };
 
@@ -277,18 +362,19 @@ void TradeBookingConnector<T>::Publish(Trade<T> &data) {}
 template<typename T>
 void TradeBookingConnector<T>::Subscribe(std::ifstream& data)
 {
-    std::string line;
-    while (std::getline(data, line))
+    // lines are parsed in parallel, trades are booked in file order
+    BulkLoader<std::tuple<std::string, std::string, double, std::string, long, std::string>> loader;
+    loader.Load(data,
+                [](std::string_view line) { return ParseLine(std::string(line)); },
+                [this](const auto& tradeData)
     {
-        auto tradeData = ParseLine(line);
+        TraceMessage _trace("TradeBookingConnector");
+        ProbeRecord(PROBE_TRADE, std::get<0>(tradeData));
         Trade<T> trade = CreateTrade(tradeData);
-/*        std::cout<< "Product: "<< trade.GetProduct();
-        std::cout<< " Price: "<< trade.GetPrice();
-        std::cout<< " Book: "<< trade.GetBook();
-        std::cout<< " Quantity: "<< trade.GetQuantity();
-        std::cout<< " Side: "<< trade.GetSide() << std::endl;*/
+        LOG(LEVEL_DEBUG, "Trade {} Product: {} Price: {} Book: {} Quantity: {} Side: {}", trade.GetTradeId(),
+            trade.GetProduct().GetProductId(), trade.GetPrice(), trade.GetBook(), trade.GetQuantity(), trade.GetSide() == BUY ? "BUY" : "SELL");
         _book->OnMessage(trade);
-    }
+    });
 }
 
 template<typename T>
@@ -319,15 +405,15 @@ Trade<T> TradeBookingConnector<T>::CreateTrade(const std::tuple<std::string, std
     std::string productId, tradeId, book, sideStr;
     double price;
     long quantity;
-    Side side;
 
     std::tie(productId, tradeId, price, book, quantity, sideStr) = tradeData;
-
-    if (sideStr == "BUY") side = BUY;
-    else if (sideStr == "SELL") side = SELL;
+    Side side = SideParser.Parse(sideStr);
 
     T product = GetBond(productId);
-    return Trade<T>(product, tradeId, price, book, quantity, side);
+    // the engine keeps one copy of each book name for every trade to view
+    AllocationEngine& allocation = _book->GetAllocationEngine();
+    string_view bookName = allocation.GetBookName(allocation.AddBook(book));
+    return Trade<T>(product, tradeId, price, bookName, quantity, side);
 }
 
 
@@ -356,11 +442,9 @@ public:
 
 private:
     TradeBookingService<T>* booking; // Reference to the TradeBookingService
-    long count; // Counter to track the number of processed execution orders
     // Helper methods
-    Trade<T> CreateTradeFromExecutionOrder(const ExecutionOrder<T>& order, const string& book, Side side);
+    Trade<T> CreateTradeFromExecutionOrder(const ExecutionOrder<T>& order, string_view book, Side side);
     Side DetermineSideFromPricingSide(PricingSide pricingSide);
-    string DetermineBookFromCount(long count);
 };
 // **********************************************************************************
 //                  Implementation of ExecutionBookingListener...
@@ -369,7 +453,6 @@ template<typename T>
 ExecutionBookingListener<T>::ExecutionBookingListener(TradeBookingService<T>* service)
 {
     booking = service;
-    count = 0;
 }
 
 template<typename T>
@@ -378,15 +461,16 @@ ExecutionBookingListener<T>::~ExecutionBookingListener() {}
 template<typename T>
 void ExecutionBookingListener<T>::ProcessAdd(ExecutionOrder<T>& data)
 {
-    count++;
     Side side = DetermineSideFromPricingSide(data.GetPricingSide());
-    string book = DetermineBookFromCount(count);
+    AllocationEngine& allocation = booking->GetAllocationEngine();
+    uint32_t handle = GetProductHandle(data.GetProduct().GetProductId());
+    string_view book = allocation.GetBookName(allocation.Allocate(handle, data.GetStrategyId()));
     Trade<T> trade = CreateTradeFromExecutionOrder(data, book, side);
     booking->BookTrade(trade);
 }
 
 template<typename T>
-Trade<T> ExecutionBookingListener<T>::CreateTradeFromExecutionOrder(const ExecutionOrder<T>& order, const string& book, Side side)
+Trade<T> ExecutionBookingListener<T>::CreateTradeFromExecutionOrder(const ExecutionOrder<T>& order, string_view book, Side side)
 {
     T product = order.GetProduct();
     string tradeId = order.GetOrderId();
@@ -401,18 +485,6 @@ Side ExecutionBookingListener<T>::DetermineSideFromPricingSide(PricingSide prici
     return (pricingSide == BID) ? SELL : BUY;
 }
 
-template<typename T>
-string ExecutionBookingListener<T>::DetermineBookFromCount(long count)
-{
-    switch (count % 3)
-    {
-        case 0: return "TRSY1";
-        case 1: return "TRSY2";
-        case 2: return "TRSY3";
-        default: return "TRSY1"; // Default case
-    }
-}
-
 template<typename T>
 void ExecutionBookingListener<T>::ProcessRemove(ExecutionOrder<T>& data) {}
 
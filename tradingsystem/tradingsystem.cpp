@@ -4,19 +4,26 @@
 #include <iostream>
 #include <fstream>
 #include <thread>
+#include <cstdlib>
 // Include all necessary headers for your services
 #include "pricingservice.hpp"
 #include "tradebookingservice.hpp"
 #include "positionservice.hpp"
 #include "riskservice.hpp"
 #include "marketdataservice.hpp"
+#include "marketanalyticsservice.hpp"
 #include "algoexecutionservice.hpp"
 #include "algostreamingservice.hpp"
+#include "curveservice.hpp"
 #include "GUIService.hpp"
 #include "executionservice.hpp"
 #include "streamingservice.hpp"
 #include "inquiryservice.hpp"
 #include "historicaldataservice.hpp"
+#include "barservice.hpp"
+#include "hedgeservice.hpp"
+#include "tcaservice.hpp"
+#include "queryserver.hpp"
 
 using namespace std;
 
@@ -28,17 +35,27 @@ private:
     PositionService<Bond> positionService;
     RiskService<Bond> riskService;
     MarketDataService<Bond> marketDataService;
+    MarketAnalyticsService<Bond> analyticsService;
     AlgoExecutionService<Bond> algoExeService;
+    CurveService<Bond> curveService;
     AlgoStreamingService<Bond> algoStreamingService;
     GUIService<Bond> guiService;
     ExecutionService<Bond> exeService;
     StreamingService<Bond> streamingService;
     InquiryService<Bond> inquiryService;
+    BarService<Bond> barService;
+    HedgeService<Bond> hedgeService;
+    TcaService<Bond> tcaService;
+    QueryServer<Bond> queryServer;
+    QuarantineLogListener quarantineListener;
     HistoricalDataService<Position<Bond>> historicalPositionService;
     HistoricalDataService<PV01<Bond>> historicalRiskService;
     HistoricalDataService<ExecutionOrder<Bond>> historicalExecutionService;
     HistoricalDataService<PriceStream<Bond>> historicalStreamingService;
     HistoricalDataService<Inquiry<Bond>> historicalInquiryService;
+    HistoricalDataService<Bar<Bond>> historicalBarService;
+    HistoricalDataService<ExecutionCost<Bond>> historicalTcaService;
+    HistoricalDataService<Trade<Bond>> historicalTradeService;
 
 public:
     TradingSystem() :
@@ -46,7 +63,10 @@ public:
             historicalRiskService(RISK),
             historicalExecutionService(EXECUTION),
             historicalStreamingService(STREAMING),
-            historicalInquiryService(INQUIRY) {}
+            historicalInquiryService(INQUIRY),
+            historicalBarService(BAR),
+            historicalTcaService(TCA),
+            historicalTradeService(TRADE) {}
 
     void Initialize() {
         PrintInLightBlue("[Initialization] Setting up services...");
@@ -55,19 +75,82 @@ public:
 
         PrintInLightBlue("[Linking] Connecting services with listeners...");
         // Set up all listeners
+        pricingService.AddQuarantineListener(&quarantineListener);
+        pricingService.AddListener(curveService.GetListener());
         pricingService.AddListener(algoStreamingService.GetListener());
+        algoStreamingService.SetCurveService(&curveService);
+        pricingService.AddListener(riskService.GetPricingListener());
+        riskService.SetCurveService(&curveService);
+        tradeBookingService.AddListener(riskService.GetTradeListener());
+
+        // fills rotate over the three books, starting with TRSY2 as the former round robin did
+        AllocationEngine& allocation = tradeBookingService.GetAllocationEngine();
+        allocation.AddProRataRule("", AllocationEngine::ANY_STRATEGY, {{"TRSY2", 1}, {"TRSY3", 1}, {"TRSY1", 1}});
+        allocation.Compile();
+
+        // risk aggregation: books -> desks -> businesses -> firm, crossed with curve sectors
+        RiskHierarchy& hierarchy = riskService.GetHierarchy();
+        hierarchy.AddDesk("UST_FLOW", "RATES");
+        hierarchy.AddDesk("UST_RV", "RATES");
+        hierarchy.AddBook("TRSY1", "UST_FLOW");
+        hierarchy.AddBook("TRSY2", "UST_FLOW");
+        hierarchy.AddBook("TRSY3", "UST_RV");
+        hierarchy.AddSector("FrontEnd", {"91282CJL6", "91282CJK8"});
+        hierarchy.AddSector("Belly", {"91282CJN2", "91282CJM4", "91282CJJ1"});
+        hierarchy.AddSector("LongEnd", {"912810TW8", "912810TV0"});
         pricingService.AddListener(guiService.GetListener());
         tradeBookingService.AddListener(positionService.GetListener());
+        // journal of every booked trade, for the end-of-day reconciliation
+        tradeBookingService.AddListener(historicalTradeService.GetListener());
         algoStreamingService.AddListener(streamingService.GetListener());
         streamingService.AddListener(historicalStreamingService.GetListener());
+        marketDataService.AddListener(analyticsService.GetListener());
+        // orders held by the rate limits go out once due, before the algo adds new ones
+        marketDataService.AddListener(exeService.GetReleaseListener());
         marketDataService.AddListener(algoExeService.GetListener());
+        algoExeService.SetMarketAnalytics(&analyticsService);
         algoExeService.AddListener(exeService.GetListener());
         exeService.AddListener(tradeBookingService.GetListener());
         exeService.AddListener(historicalExecutionService.GetListener());
         positionService.AddListener(riskService.GetListener());
         positionService.AddListener(historicalPositionService.GetListener());
         inquiryService.AddListener(historicalInquiryService.GetListener());
+        pricingService.AddListener(inquiryService.GetPricingListener());
         riskService.AddListener(historicalRiskService.GetListener());
+        riskService.AddListener(hedgeService.GetListener());
+        hedgeService.SetRiskService(&riskService);
+        pricingService.AddListener(barService.GetListener());
+        exeService.AddListener(barService.GetExecutionListener());
+        barService.AddListener(historicalBarService.GetListener());
+        exeService.AddListener(tcaService.GetListener());
+        tcaService.AddListener(historicalTcaService.GetListener());
+        positionService.AddListener(queryServer.GetPositionListener());
+        riskService.AddListener(queryServer.GetRiskListener());
+        marketDataService.AddListener(queryServer.GetMarketDataListener());
+        inquiryService.AddListener(queryServer.GetInquiryListener());
+
+        // BOND_QUERY_SOCKET=path serves the positions, risk, books and inquiries to local clients
+        if (const char* _socket = getenv("BOND_QUERY_SOCKET")) {
+            queryServer.Start(_socket);
+        }
+
+        // bound the intraday stores: recent trades stay queryable, persisted records live in the files
+        tradeBookingService.SetRetentionPolicy(RetentionPolicy::KeepLastN(100000));
+        historicalPositionService.SetRetentionPolicy(RetentionPolicy::NoneAfterPersist());
+        historicalRiskService.SetRetentionPolicy(RetentionPolicy::NoneAfterPersist());
+        historicalExecutionService.SetRetentionPolicy(RetentionPolicy::NoneAfterPersist());
+        historicalStreamingService.SetRetentionPolicy(RetentionPolicy::NoneAfterPersist());
+        historicalInquiryService.SetRetentionPolicy(RetentionPolicy::NoneAfterPersist());
+        historicalBarService.SetRetentionPolicy(RetentionPolicy::NoneAfterPersist());
+        historicalTcaService.SetRetentionPolicy(RetentionPolicy::NoneAfterPersist());
+        historicalTradeService.SetRetentionPolicy(RetentionPolicy::NoneAfterPersist());
+        // positions and risk move one book or one field at a time, persist the changes only
+        historicalPositionService.SetDeltaPersistence(32);
+        historicalRiskService.SetDeltaPersistence(32);
+        // the reconciliation reads these journals as one trading day
+        historicalTradeService.StartOfDay();
+        historicalPositionService.StartOfDay();
+        historicalRiskService.StartOfDay();
         this_thread::sleep_for(chrono::seconds(1));
         PrintInLightBlue("[Linking] Listeners connected successfully.");
     }
@@ -76,22 +159,22 @@ public:
         printInYellow("Starting Trading System...");
         this_thread::sleep_for(chrono::seconds(1));
 
-        cout << "Receiving Prices..." << endl;
+        LOG(LEVEL_INFO, "Receiving Prices...");
         std::ifstream priceData("../data/prices.txt");
         pricingService.GetConnector()->Subscribe(priceData);
         this_thread::sleep_for(chrono::milliseconds(500));
 
-        cout << "Getting Trades Data..." << endl;
+        LOG(LEVEL_INFO, "Getting Trades Data...");
         std::ifstream tradeData("../data/trades.txt");
         tradeBookingService.GetConnector()->Subscribe(tradeData);
         this_thread::sleep_for(chrono::milliseconds(500));
 
-        cout << "Loading Market Data..." << endl;
+        LOG(LEVEL_INFO, "Loading Market Data...");
         std::ifstream marketData("../data/mktdata.txt");
         marketDataService.GetConnector()->Subscribe(marketData);
         this_thread::sleep_for(chrono::milliseconds(500));
 
-        cout << "Loading inquiries..." << endl;
+        LOG(LEVEL_INFO, "Loading inquiries...");
         ifstream inquiryData("../data/inquiries.txt");
         inquiryService.GetConnector()->Subscribe(inquiryData);
         this_thread::sleep_for(chrono::milliseconds(500));
@@ -100,11 +183,73 @@ public:
 
     ~TradingSystem() {
         printInYellow("The day is over, Shutting down Trading System...");
+        // orders still held by the rate limits go out at their pace before the books close
+        exeService.FlushQueued();
+        for (size_t market = 0; market < MARKET_COUNT; ++market) {
+            ThrottleStats throttle = exeService.GetThrottleStats(static_cast<Market>(market));
+            LOG(LEVEL_INFO, "{} orders sent {} queued {} rejected {} max delay {}ns", MARKET_NAMES[market],
+                throttle.sent, throttle.queued, throttle.rejected, throttle.maxDelayNanos);
+        }
+        // persist the bars still in progress
+        barService.Flush();
+        LOG(LEVEL_INFO, "Pricing updates absorbed by an unchanged composite: {}", pricingService.GetSuppressedCount());
+        LOG(LEVEL_INFO, "Price ticks quarantined: {}", pricingService.GetValidator().GetRejectedCount());
+        LOG(LEVEL_INFO, "Portfolio PV01 {} modified duration {} convexity {}", riskService.GetPortfolioPV01(),
+            riskService.GetPortfolioDuration(), riskService.GetPortfolioConvexity());
+        const RiskHierarchy& hierarchy = riskService.GetHierarchy();
+        for (int node = 0; node < static_cast<int>(hierarchy.GetNodeCount()); ++node) {
+            if (hierarchy.GetLevel(node) == RISK_BOOK) continue;
+            LOG(LEVEL_INFO, "  {} PV01 {}", hierarchy.GetName(node), hierarchy.GetPV01(node));
+            LOG(LEVEL_INFO, "  {} key-rate PV01 2Y {} 3Y {} 5Y {} 7Y {} 10Y {} 20Y {} 30Y {}", hierarchy.GetName(node),
+                hierarchy.GetBucketPV01(node, 0), hierarchy.GetBucketPV01(node, 1), hierarchy.GetBucketPV01(node, 2),
+                hierarchy.GetBucketPV01(node, 3), hierarchy.GetBucketPV01(node, 4), hierarchy.GetBucketPV01(node, 5),
+                hierarchy.GetBucketPV01(node, 6));
+        }
+        const HedgeRecommendation& hedge = hedgeService.GetData("FIRM");
+        for (uint32_t handle = 0; handle < PRODUCT_COUNT; ++handle) {
+            LOG(LEVEL_INFO, "Hedge {} notional {}", PRODUCT_CUSIPS[handle], llround(hedge.GetNotional(handle)));
+        }
+        for (uint32_t handle = 0; handle < PRODUCT_COUNT; ++handle) {
+            const TcaAccumulator& cost = tcaService.GetByProduct(handle);
+            if (cost.orders == 0) continue;
+            LOG(LEVEL_INFO, "TCA {} orders {} slippage {} spread capture {} participation {}", PRODUCT_CUSIPS[handle],
+                cost.orders, cost.AverageSlippage(), cost.AverageSpreadCapture(), cost.Participation());
+        }
+        for (size_t market = 0; market < MARKET_COUNT; ++market) {
+            const TcaAccumulator& cost = tcaService.GetByVenue(static_cast<Market>(market));
+            if (cost.orders == 0) continue;
+            LOG(LEVEL_INFO, "TCA {} orders {} slippage {} spread capture {}", MARKET_NAMES[market], cost.orders,
+                cost.AverageSlippage(), cost.AverageSpreadCapture());
+        }
+        LogMemoryReport({pricingService.MemoryStats(), tradeBookingService.MemoryStats(),
+                         positionService.MemoryStats(), riskService.MemoryStats(),
+                         marketDataService.MemoryStats(), analyticsService.MemoryStats(),
+                         algoExeService.MemoryStats(), curveService.MemoryStats(),
+                         algoStreamingService.MemoryStats(), guiService.MemoryStats(),
+                         exeService.MemoryStats(), streamingService.MemoryStats(),
+                         inquiryService.MemoryStats(), barService.MemoryStats(),
+                         hedgeService.MemoryStats(), tcaService.MemoryStats(),
+                         historicalPositionService.MemoryStats(),
+                         historicalRiskService.MemoryStats(), historicalExecutionService.MemoryStats(),
+                         historicalStreamingService.MemoryStats(), historicalInquiryService.MemoryStats(),
+                         historicalBarService.MemoryStats(), historicalTcaService.MemoryStats(),
+                         historicalTradeService.MemoryStats()});
+        // release all intraday IDs and records in one shot
+        queryServer.Stop();
+        tradeBookingService.EndOfDay();
+        inquiryService.EndOfDay();
+        queryServer.EndOfDay();
+        GetTradingDayArena().Release();
+        GetTracer().Dump();
     }
 
 };
 
 int main() {
+    // BOND_TRACE_SAMPLE=N traces one message in N through the pipeline
+    if (const char* _sample = getenv("BOND_TRACE_SAMPLE")) {
+        GetTracer().Enable(strtoull(_sample, nullptr, 10), "../data/out/trace.json");
+    }
     TradingSystem tradingSystem;
     tradingSystem.Initialize();
     tradingSystem.Run();
@@ -0,0 +1,91 @@
+/**
+ * @file arena.hpp
+ * @brief Defines the per-trading-day arena that owns intraday string and record storage.
+ *
+ * Trade IDs, order IDs, inquiry IDs and book names only live for one trading session.
+ * Instead of allocating and freeing them one at a time, services intern them into a
+ * monotonic arena and keep string_views into it. The whole arena is released in one
+ * shot at the end of the day.
+ *
+ * @author Niccolo Fabbri
+ */
+#ifndef SWE_MTH9815_ARENA_HPP
+#define SWE_MTH9815_ARENA_HPP
+
+#include <cstring>
+#include <memory_resource>
+#include <string_view>
+
+using namespace std;
+
+/**
+ * @class TradingDayArena
+ * @brief Monotonic, std::pmr compatible arena for intraday storage.
+ *
+ * Allocation is a pointer bump, deallocation is a no-op, and Release() hands every
+ * block back to the upstream resource at once. The arena is not thread safe: it is
+ * meant to be used from the thread that drives the services.
+ */
+class TradingDayArena
+{
+public:
+    // ctor with the size of the first block requested from the upstream resource
+    TradingDayArena(size_t _initialBytes = 1 << 20);
+
+    // Copy a string into the arena and return a view that lives until Release()
+    string_view Intern(string_view _value);
+
+    // Memory resource to give to std::pmr containers holding intraday records
+    pmr::memory_resource* GetResource();
+
+    // Bytes interned since the last Release()
+    size_t GetInternedBytes() const;
+
+    // Free all intraday storage; every view and record handed out becomes invalid
+    void Release();
+
+private:
+    pmr::monotonic_buffer_resource resource;
+    size_t internedBytes;
+};
+// **********************************************************************************
+//                  Implementation of TradingDayArena...
+// **********************************************************************************
+TradingDayArena::TradingDayArena(size_t _initialBytes) :
+        resource(_initialBytes)
+{
+    internedBytes = 0;
+}
+
+string_view TradingDayArena::Intern(string_view _value)
+{
+    char* _copy = static_cast<char*>(resource.allocate(_value.size(), alignof(char)));
+    memcpy(_copy, _value.data(), _value.size());
+    internedBytes += _value.size();
+    return string_view(_copy, _value.size());
+}
+
+pmr::memory_resource* TradingDayArena::GetResource()
+{
+    return &resource;
+}
+
+size_t TradingDayArena::GetInternedBytes() const
+{
+    return internedBytes;
+}
+
+void TradingDayArena::Release()
+{
+    resource.release();
+    internedBytes = 0;
+}
+
+// Arena of the current trading session, shared by all services
+TradingDayArena& GetTradingDayArena()
+{
+    static TradingDayArena arena;
+    return arena;
+}
+
+#endif //SWE_MTH9815_ARENA_HPP
@@ -0,0 +1,227 @@
+/**
+ * @file bulkloader.hpp
+ * @brief Defines the parallel bulk loader used by the file connectors.
+ *
+ * The loader reads an input stream in large blocks, splits every block into newline
+ * aligned chunks and parses the chunks concurrently into typed record arrays. Records
+ * are then handed back to the calling thread in the original file order, so services
+ * never see concurrent calls. For aggregations the
+ * chunks can instead be folded into one accumulator each and merged (a parallel reduction).
+ *
+ * @author Niccolo Fabbri
+ */
+#ifndef SWE_MTH9815_BULKLOADER_HPP
+#define SWE_MTH9815_BULKLOADER_HPP
+
+#include <algorithm>
+#include <future>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @class BulkLoader
+ * @brief Parses a line based input stream on several threads.
+ *
+ * While the records of one block are being delivered, the next block is already being
+ * parsed in the background, so the delivering thread only waits on the slower of the two.
+ *
+ * @tparam R The record type produced by the parse function, or the accumulator of Reduce.
+ */
+template<typename R>
+class BulkLoader
+{
+public:
+    // ctor with the block size read from the stream and the number of parsing threads
+    BulkLoader(size_t _blockBytes = 16 << 20, size_t _threads = thread::hardware_concurrency());
+
+    // Parse every line with _parse(string_view) and call _deliver(R&) on each record in file order
+    template<typename Parse, typename Deliver>
+    void Load(istream& _data, Parse _parse, Deliver _deliver);
+
+    // Fold the lines of each chunk into a fresh R with _fold(R&, string_view) on the worker
+    // threads, then merge every chunk into _total with _merge(R&, const R&) in file order
+    template<typename Fold, typename Merge>
+    void Reduce(istream& _data, R& _total, Fold _fold, Merge _merge);
+
+private:
+    size_t blockBytes;
+    size_t threads;
+
+    // Read the next block of complete lines, keeping the trailing partial line in _carry
+    bool ReadBlock(istream& _data, string& _carry, string& _block);
+
+    // Cut a block into at most `threads` newline aligned chunks
+    vector<string_view> SplitBlock(const string& _block) const;
+
+    // Split a block into newline aligned chunks and parse them concurrently
+    template<typename Parse>
+    vector<vector<R>> ParseBlock(const string& _block, Parse _parse);
+
+    // Call _line(string_view) on every non-empty line of a chunk
+    template<typename Line>
+    static void ForEachLine(string_view _chunk, Line _line);
+
+    // Parse all lines of one chunk
+    template<typename Parse>
+    static vector<R> ParseChunk(string_view _chunk, Parse _parse);
+
+    template<typename Parse, typename Deliver>
+    void Run(istream& _data, Parse _parse, Deliver _deliverBlock);
+};
+// **********************************************************************************
+//                  Implementation of BulkLoader...
+// **********************************************************************************
+template<typename R>
+BulkLoader<R>::BulkLoader(size_t _blockBytes, size_t _threads)
+{
+    blockBytes = max<size_t>(_blockBytes, 1);
+    threads = max<size_t>(_threads, 1);
+}
+
+template<typename R>
+bool BulkLoader<R>::ReadBlock(istream& _data, string& _carry, string& _block)
+{
+    _block.swap(_carry);
+    _carry.clear();
+    if (!_data) return !_block.empty();
+
+    size_t _offset = _block.size();
+    _block.resize(_offset + blockBytes);
+    _data.read(&_block[_offset], blockBytes);
+    _block.resize(_offset + _data.gcount());
+
+    // keep the trailing partial line for the next block, unless the stream is exhausted
+    if (_data) {
+        size_t _lastNewline = _block.rfind('\n');
+        if (_lastNewline == string::npos) {
+            _carry.swap(_block);
+            return ReadBlock(_data, _carry, _block);
+        }
+        _carry.assign(_block, _lastNewline + 1, string::npos);
+        _block.resize(_lastNewline + 1);
+    }
+    return !_block.empty();
+}
+
+template<typename R>
+template<typename Line>
+void BulkLoader<R>::ForEachLine(string_view _chunk, Line _line)
+{
+    while (!_chunk.empty()) {
+        size_t _end = _chunk.find('\n');
+        string_view _text = _chunk.substr(0, _end);
+        if (!_text.empty() && _text.back() == '\r') _text.remove_suffix(1);
+        if (!_text.empty()) _line(_text);
+        if (_end == string_view::npos) break;
+        _chunk.remove_prefix(_end + 1);
+    }
+}
+
+template<typename R>
+template<typename Parse>
+vector<R> BulkLoader<R>::ParseChunk(string_view _chunk, Parse _parse)
+{
+    vector<R> _records;
+    _records.reserve(_chunk.size() / 32);
+    ForEachLine(_chunk, [&_records, &_parse](string_view _line) { _records.push_back(_parse(_line)); });
+    return _records;
+}
+
+template<typename R>
+vector<string_view> BulkLoader<R>::SplitBlock(const string& _block) const
+{
+    // cut the block into at most `threads` pieces, each ending right after a newline
+    vector<string_view> _chunks;
+    string_view _rest(_block);
+    size_t _target = _block.size() / threads + 1;
+    while (!_rest.empty()) {
+        size_t _cut = _rest.size() <= _target ? string_view::npos : _rest.find('\n', _target);
+        size_t _length = _cut == string_view::npos ? _rest.size() : _cut + 1;
+        _chunks.push_back(_rest.substr(0, _length));
+        _rest.remove_prefix(_length);
+    }
+    return _chunks;
+}
+
+template<typename R>
+template<typename Parse>
+vector<vector<R>> BulkLoader<R>::ParseBlock(const string& _block, Parse _parse)
+{
+    vector<string_view> _chunks = SplitBlock(_block);
+    vector<vector<R>> _parsed(_chunks.size());
+    vector<future<vector<R>>> _workers;
+    for (size_t i = 1; i < _chunks.size(); ++i) {
+        _workers.push_back(async(launch::async, [_chunk = _chunks[i], _parse]() {
+            return ParseChunk(_chunk, _parse);
+        }));
+    }
+    if (!_chunks.empty()) _parsed[0] = ParseChunk(_chunks[0], _parse);
+    for (size_t i = 1; i < _chunks.size(); ++i) {
+        _parsed[i] = _workers[i - 1].get();
+    }
+    return _parsed;
+}
+
+template<typename R>
+template<typename Parse, typename Deliver>
+void BulkLoader<R>::Run(istream& _data, Parse _parse, Deliver _deliverBlock)
+{
+    string _carry, _block;
+    if (!ReadBlock(_data, _carry, _block)) return;
+    future<vector<vector<R>>> _pending = async(launch::async, [this, _parse, _block = std::move(_block)]() {
+        return ParseBlock(_block, _parse);
+    });
+
+    while (_pending.valid()) {
+        vector<vector<R>> _parsed = _pending.get();
+        // start parsing the next block before handing this one to the services
+        string _next;
+        if (ReadBlock(_data, _carry, _next)) {
+            _pending = async(launch::async, [this, _parse, _next = std::move(_next)]() {
+                return ParseBlock(_next, _parse);
+            });
+        }
+        _deliverBlock(_parsed);
+    }
+}
+
+template<typename R>
+template<typename Parse, typename Deliver>
+void BulkLoader<R>::Load(istream& _data, Parse _parse, Deliver _deliver)
+{
+    Run(_data, _parse, [&_deliver](vector<vector<R>>& _parsed) {
+        for (auto& _chunk : _parsed) {
+            for (auto& _record : _chunk) _deliver(_record);
+        }
+    });
+}
+
+template<typename R>
+template<typename Fold, typename Merge>
+void BulkLoader<R>::Reduce(istream& _data, R& _total, Fold _fold, Merge _merge)
+{
+    string _carry, _block, _next;
+    bool _more = ReadBlock(_data, _carry, _block);
+    while (_more) {
+        vector<string_view> _chunks = SplitBlock(_block);
+        vector<future<R>> _workers;
+        for (string_view _chunk : _chunks) {
+            _workers.push_back(async(launch::async, [_chunk, &_fold]() {
+                R _partial;
+                ForEachLine(_chunk, [&_partial, &_fold](string_view _line) { _fold(_partial, _line); });
+                return _partial;
+            }));
+        }
+        // read the next block while the workers fold this one
+        _more = ReadBlock(_data, _carry, _next);
+        for (auto& _worker : _workers) _merge(_total, _worker.get());
+        _block.swap(_next);
+    }
+}
+
+#endif //SWE_MTH9815_BULKLOADER_HPP
@@ -0,0 +1,133 @@
+/**
+ * @file enumparser.hpp
+ * @brief Defines the compile-time perfect-hash parser for enum tokens in the input files.
+ *
+ * Every enum field read by the connectors (sides, states, order types, markets) has a
+ * small fixed set of tokens. The parser picks, at compile time, a multiplicative hash
+ * seed that maps each token to its own slot, so parsing a field is one hash, one
+ * length check and one compare. Trailing CR/LF is ignored and unknown tokens are
+ * reported instead of leaving the enum uninitialised.
+ *
+ * @author Niccolo Fabbri
+ */
+#ifndef SWE_MTH9815_ENUMPARSER_HPP
+#define SWE_MTH9815_ENUMPARSER_HPP
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+using namespace std;
+
+/**
+ * @class EnumParser
+ * @brief Perfect-hash lookup from token to enum value.
+ *
+ * The hash mixes the first, middle and last characters with the token length, which is
+ * enough to tell apart every token used by the trading system (e.g. RECEIVED/REJECTED).
+ * Construction fails to compile if no collision-free seed exists for the token set.
+ *
+ * @tparam E The enum type.
+ * @tparam N The number of tokens.
+ */
+template<typename E, size_t N>
+class EnumParser
+{
+public:
+    // ctor from the enum name (used in error messages) and its token table
+    constexpr EnumParser(string_view _enumName, const pair<string_view, E> (&_tokens)[N]);
+
+    // Parse a token, returns false if the token is unknown
+    constexpr bool TryParse(string_view _token, E& _value) const;
+
+    // Parse a token, throws if the token is unknown
+    E Parse(string_view _token) const;
+
+private:
+    static constexpr size_t SIZE = bit_ceil(N * 2);
+    static constexpr int BITS = countr_zero(SIZE);
+
+    string_view enumName;
+    uint32_t seed;
+    array<string_view, SIZE> tokens;
+    array<E, SIZE> values;
+
+    static constexpr string_view Trim(string_view _token);
+    static constexpr uint32_t Key(string_view _token);
+    constexpr size_t Slot(string_view _token) const;
+};
+// **********************************************************************************
+//                  Implementation of EnumParser...
+// **********************************************************************************
+template<typename E, size_t N>
+constexpr EnumParser<E, N>::EnumParser(string_view _enumName, const pair<string_view, E> (&_tokens)[N]) :
+        enumName(_enumName), seed(0), tokens(), values()
+{
+    // search odd multipliers until every token lands in its own slot
+    for (uint32_t _candidate = 0x9E3779B1u; ; _candidate += 2) {
+        seed = _candidate;
+        array<bool, SIZE> _used{};
+        bool _collision = false;
+        for (size_t i = 0; i < N && !_collision; ++i) {
+            size_t _slot = Slot(_tokens[i].first);
+            _collision = _used[_slot];
+            _used[_slot] = true;
+        }
+        if (!_collision) break;
+        if (_candidate > 0x9E3779B1u + (1u << 20)) throw logic_error("no perfect hash for token set");
+    }
+    for (size_t i = 0; i < N; ++i) {
+        size_t _slot = Slot(_tokens[i].first);
+        tokens[_slot] = _tokens[i].first;
+        values[_slot] = _tokens[i].second;
+    }
+}
+
+template<typename E, size_t N>
+constexpr string_view EnumParser<E, N>::Trim(string_view _token)
+{
+    while (!_token.empty() && (_token.back() == '\r' || _token.back() == '\n')) _token.remove_suffix(1);
+    return _token;
+}
+
+template<typename E, size_t N>
+constexpr uint32_t EnumParser<E, N>::Key(string_view _token)
+{
+    if (_token.empty()) return 0;
+    uint32_t _first = static_cast<unsigned char>(_token.front());
+    uint32_t _middle = static_cast<unsigned char>(_token[_token.size() / 2]);
+    uint32_t _last = static_cast<unsigned char>(_token.back());
+    return _first | (_middle << 8) | (_last << 16) | (static_cast<uint32_t>(_token.size()) << 24);
+}
+
+template<typename E, size_t N>
+constexpr size_t EnumParser<E, N>::Slot(string_view _token) const
+{
+    return (Key(_token) * seed) >> (32 - BITS);
+}
+
+template<typename E, size_t N>
+constexpr bool EnumParser<E, N>::TryParse(string_view _token, E& _value) const
+{
+    _token = Trim(_token);
+    size_t _slot = Slot(_token);
+    if (tokens[_slot].empty() || tokens[_slot] != _token) return false;
+    _value = values[_slot];
+    return true;
+}
+
+template<typename E, size_t N>
+E EnumParser<E, N>::Parse(string_view _token) const
+{
+    E _value;
+    if (!TryParse(_token, _value)) {
+        throw std::runtime_error("Unknown " + string(enumName) + " token: '" + string(Trim(_token)) + "'");
+    }
+    return _value;
+}
+
+#endif //SWE_MTH9815_ENUMPARSER_HPP
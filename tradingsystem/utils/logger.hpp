@@ -0,0 +1,398 @@
+/**
+ * @file logger.hpp
+ * @brief Defines the asynchronous binary logger used instead of console printing.
+ *
+ * A producer only writes a format-string ID and its raw arguments into a per-thread
+ * ring buffer. A background thread drains the rings, formats the records and writes
+ * them out, so logging on the hot path costs a clock read and a small copy.
+ *
+ * Usage: LOG(LEVEL_INFO, "Booked trade {} for {} @ {}", tradeId, quantity, price);
+ *
+ * @author Niccolo Fabbri
+ */
+#ifndef SWE_MTH9815_LOGGER_HPP
+#define SWE_MTH9815_LOGGER_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+// Severity of a log record
+enum LogLevel { LEVEL_DEBUG, LEVEL_INFO, LEVEL_WARNING, LEVEL_ERROR };
+
+// Type tag of a binary argument
+enum LogArgKind : uint8_t { LOG_ARG_INT, LOG_ARG_DOUBLE, LOG_ARG_STRING };
+
+/**
+ * A fixed-size binary log record. Arguments are packed into the payload: 8 bytes for
+ * numbers, a length byte plus the characters for strings (truncated if needed).
+ */
+struct LogRecord
+{
+    static constexpr size_t MAX_ARGS = 8;
+    static constexpr size_t PAYLOAD_SIZE = 224;
+
+    int64_t timestampNanos;
+    uint16_t formatId;
+    uint8_t level;
+    uint8_t argc;
+    uint16_t payloadSize;
+    LogArgKind kinds[MAX_ARGS];
+    char payload[PAYLOAD_SIZE];
+};
+
+/**
+ * @class LogRing
+ * @brief Single producer, single consumer ring of log records owned by one thread.
+ *
+ * The producer never blocks: when the ring is full the record is dropped and counted.
+ */
+class LogRing
+{
+public:
+    static constexpr size_t CAPACITY = 4096;
+
+    LogRing();
+
+    // Slot for the next record, or nullptr if the ring is full (producer side)
+    LogRecord* Claim();
+
+    // Make the claimed record visible to the consumer (producer side)
+    void Commit();
+
+    // Move every available record into _out (consumer side)
+    void Drain(vector<LogRecord>& _out);
+
+    // Number of records dropped because the ring was full, reset on read
+    uint64_t TakeDropped();
+
+private:
+    array<LogRecord, CAPACITY> records;
+    alignas(64) atomic<size_t> head;    ///< Next slot written by the producer
+    alignas(64) atomic<size_t> tail;    ///< Next slot read by the consumer
+    alignas(64) atomic<uint64_t> dropped;
+};
+// **********************************************************************************
+//                  Implementation of LogRing...
+// **********************************************************************************
+LogRing::LogRing() : records(), head(0), tail(0), dropped(0) {}
+
+LogRecord* LogRing::Claim()
+{
+    size_t _head = head.load(memory_order_relaxed);
+    if (_head - tail.load(memory_order_acquire) >= CAPACITY) {
+        dropped.fetch_add(1, memory_order_relaxed);
+        return nullptr;
+    }
+    return &records[_head % CAPACITY];
+}
+
+void LogRing::Commit()
+{
+    head.store(head.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+void LogRing::Drain(vector<LogRecord>& _out)
+{
+    size_t _tail = tail.load(memory_order_relaxed);
+    size_t _head = head.load(memory_order_acquire);
+    for (; _tail != _head; ++_tail) {
+        _out.push_back(records[_tail % CAPACITY]);
+    }
+    tail.store(_tail, memory_order_release);
+}
+
+uint64_t LogRing::TakeDropped()
+{
+    return dropped.exchange(0, memory_order_relaxed);
+}
+
+/**
+ * @class Logger
+ * @brief Low-latency logger with a background formatting thread.
+ *
+ * Format strings are registered once per call site and referenced by ID afterwards.
+ * "{}" placeholders are replaced by the arguments in order. Records from all threads
+ * are merged by timestamp before being written.
+ */
+class Logger
+{
+public:
+    static constexpr size_t MAX_FORMATS = 1024;
+
+    Logger();
+    ~Logger();
+
+    // Register a format string and get its ID (once per call site)
+    uint16_t RegisterFormat(const char* _format);
+
+    // Minimum level that gets recorded
+    void SetLevel(LogLevel _level);
+    bool Enabled(LogLevel _level) const;
+
+    // Record a message on the calling thread's ring
+    template<typename... Args>
+    void Write(LogLevel _level, uint16_t _formatId, const Args&... _args);
+
+    // Block until everything logged so far has been written
+    void Flush();
+
+    // Drain the rings and stop the background thread
+    void Stop();
+
+private:
+    array<atomic<const char*>, MAX_FORMATS> formats; ///< Format strings indexed by ID
+    atomic<uint16_t> formatCount;
+    atomic<int> level;
+    mutex registryMutex;                              ///< Guards format and ring registration
+    vector<unique_ptr<LogRing>> rings;                ///< One ring per producing thread
+    atomic<bool> running;
+    atomic<uint64_t> flushRequests;
+    atomic<uint64_t> flushesDone;
+    thread worker;
+
+    LogRing& ThreadRing();
+    void Run();
+    bool DrainOnce(vector<LogRecord>& _batch);
+    string Format(const LogRecord& _record) const;
+
+    static void Encode(LogRecord& _record, int64_t _value);
+    static void Encode(LogRecord& _record, double _value);
+    static void Encode(LogRecord& _record, string_view _value);
+    template<typename A>
+    static void EncodeArg(LogRecord& _record, const A& _arg);
+};
+// **********************************************************************************
+//                  Implementation of Logger...
+// **********************************************************************************
+Logger::Logger() : formats(), formatCount(0), level(LEVEL_INFO), running(true), flushRequests(0), flushesDone(0)
+{
+    worker = thread(&Logger::Run, this);
+}
+
+Logger::~Logger()
+{
+    Stop();
+}
+
+uint16_t Logger::RegisterFormat(const char* _format)
+{
+    lock_guard<mutex> _lock(registryMutex);
+    uint16_t _id = formatCount.load(memory_order_relaxed);
+    if (_id >= MAX_FORMATS) return 0;
+    formats[_id].store(_format, memory_order_release);
+    formatCount.store(_id + 1, memory_order_release);
+    return _id;
+}
+
+void Logger::SetLevel(LogLevel _level)
+{
+    level.store(_level, memory_order_relaxed);
+}
+
+bool Logger::Enabled(LogLevel _level) const
+{
+    return _level >= level.load(memory_order_relaxed);
+}
+
+LogRing& Logger::ThreadRing()
+{
+    thread_local LogRing* _ring = nullptr;
+    if (!_ring) {
+        lock_guard<mutex> _lock(registryMutex);
+        rings.push_back(make_unique<LogRing>());
+        _ring = rings.back().get();
+    }
+    return *_ring;
+}
+
+void Logger::Encode(LogRecord& _record, int64_t _value)
+{
+    if (_record.payloadSize + sizeof(_value) > LogRecord::PAYLOAD_SIZE) return;
+    memcpy(_record.payload + _record.payloadSize, &_value, sizeof(_value));
+    _record.payloadSize += sizeof(_value);
+    _record.kinds[_record.argc++] = LOG_ARG_INT;
+}
+
+void Logger::Encode(LogRecord& _record, double _value)
+{
+    if (_record.payloadSize + sizeof(_value) > LogRecord::PAYLOAD_SIZE) return;
+    memcpy(_record.payload + _record.payloadSize, &_value, sizeof(_value));
+    _record.payloadSize += sizeof(_value);
+    _record.kinds[_record.argc++] = LOG_ARG_DOUBLE;
+}
+
+void Logger::Encode(LogRecord& _record, string_view _value)
+{
+    if (static_cast<size_t>(_record.payloadSize) + 1 > LogRecord::PAYLOAD_SIZE) return;
+    size_t _length = min<size_t>({_value.size(), 255, LogRecord::PAYLOAD_SIZE - _record.payloadSize - 1});
+    _record.payload[_record.payloadSize] = static_cast<char>(_length);
+    memcpy(_record.payload + _record.payloadSize + 1, _value.data(), _length);
+    _record.payloadSize += 1 + _length;
+    _record.kinds[_record.argc++] = LOG_ARG_STRING;
+}
+
+template<typename A>
+void Logger::EncodeArg(LogRecord& _record, const A& _arg)
+{
+    if (_record.argc >= LogRecord::MAX_ARGS) return;
+    if constexpr (is_floating_point_v<A>) Encode(_record, static_cast<double>(_arg));
+    else if constexpr (is_integral_v<A> || is_enum_v<A>) Encode(_record, static_cast<int64_t>(_arg));
+    else Encode(_record, string_view(_arg));
+}
+
+template<typename... Args>
+void Logger::Write(LogLevel _level, uint16_t _formatId, const Args&... _args)
+{
+    LogRing& _ring = ThreadRing();
+    LogRecord* _record = _ring.Claim();
+    if (!_record) return;
+
+    _record->timestampNanos = chrono::duration_cast<chrono::nanoseconds>(
+            chrono::system_clock::now().time_since_epoch()).count();
+    _record->formatId = _formatId;
+    _record->level = static_cast<uint8_t>(_level);
+    _record->argc = 0;
+    _record->payloadSize = 0;
+    (EncodeArg(*_record, _args), ...);
+    _ring.Commit();
+}
+
+string Logger::Format(const LogRecord& _record) const
+{
+    // timestamp with milliseconds, same layout as CurrentDateTimeWithMillis
+    time_t _seconds = static_cast<time_t>(_record.timestampNanos / 1000000000);
+    tm _tm = *localtime(&_seconds);
+    stringstream _out;
+    _out << put_time(&_tm, "%Y-%m-%d %H:%M:%S") << '.' << setfill('0') << setw(3)
+         << (_record.timestampNanos / 1000000) % 1000 << ' ';
+    static const char* LEVEL_NAMES[] = {"DEBUG", "INFO", "WARNING", "ERROR"};
+    _out << LEVEL_NAMES[_record.level] << ' ';
+
+    string_view _format = formats[_record.formatId].load(memory_order_acquire);
+    size_t _offset = 0;
+    uint8_t _arg = 0;
+    for (size_t _placeholder = _format.find("{}"); _placeholder != string_view::npos; _placeholder = _format.find("{}")) {
+        _out << _format.substr(0, _placeholder);
+        _format.remove_prefix(_placeholder + 2);
+        if (_arg == _record.argc) {
+            _out << "{}";
+            continue;
+        }
+        switch (_record.kinds[_arg++]) {
+            case LOG_ARG_INT: {
+                int64_t _value;
+                memcpy(&_value, _record.payload + _offset, sizeof(_value));
+                _offset += sizeof(_value);
+                _out << _value;
+                break;
+            }
+            case LOG_ARG_DOUBLE: {
+                double _value;
+                memcpy(&_value, _record.payload + _offset, sizeof(_value));
+                _offset += sizeof(_value);
+                char _buffer[32];
+                auto _result = to_chars(_buffer, _buffer + sizeof(_buffer), _value);
+                _out << string_view(_buffer, _result.ptr - _buffer);
+                break;
+            }
+            case LOG_ARG_STRING: {
+                size_t _length = static_cast<unsigned char>(_record.payload[_offset]);
+                _out << string_view(_record.payload + _offset + 1, _length);
+                _offset += 1 + _length;
+                break;
+            }
+        }
+    }
+    _out << _format;
+    return _out.str();
+}
+
+bool Logger::DrainOnce(vector<LogRecord>& _batch)
+{
+    _batch.clear();
+    uint64_t _dropped = 0;
+    {
+        lock_guard<mutex> _lock(registryMutex);
+        for (auto& _ring : rings) {
+            _ring->Drain(_batch);
+            _dropped += _ring->TakeDropped();
+        }
+    }
+    if (_batch.empty() && _dropped == 0) return false;
+
+    // merge the per-thread rings into one timeline
+    stable_sort(_batch.begin(), _batch.end(), [](const LogRecord& a, const LogRecord& b) {
+        return a.timestampNanos < b.timestampNanos;
+    });
+    for (const auto& _record : _batch) {
+        ostream& _stream = _record.level >= LEVEL_WARNING ? cerr : cout;
+        _stream << Format(_record) << '\n';
+    }
+    if (_dropped > 0) cerr << "Logger dropped " << _dropped << " records\n";
+    cout.flush();
+    cerr.flush();
+    return true;
+}
+
+void Logger::Run()
+{
+    vector<LogRecord> _batch;
+    _batch.reserve(LogRing::CAPACITY);
+    while (running.load(memory_order_acquire)) {
+        uint64_t _requested = flushRequests.load(memory_order_acquire);
+        bool _worked = DrainOnce(_batch);
+        flushesDone.store(_requested, memory_order_release);
+        if (!_worked) this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    DrainOnce(_batch);
+}
+
+void Logger::Flush()
+{
+    uint64_t _ticket = flushRequests.fetch_add(1, memory_order_acq_rel) + 1;
+    while (running.load(memory_order_acquire) && flushesDone.load(memory_order_acquire) < _ticket) {
+        this_thread::sleep_for(chrono::microseconds(100));
+    }
+}
+
+void Logger::Stop()
+{
+    if (running.exchange(false, memory_order_acq_rel) && worker.joinable()) {
+        worker.join();
+    }
+}
+
+// Logger of the process, started on first use and drained at exit
+Logger& GetLogger()
+{
+    static Logger logger;
+    return logger;
+}
+
+// Log a message; the format string is registered once per call site
+#define LOG(level, format, ...)                                                         \
+    do {                                                                                \
+        if (GetLogger().Enabled(level)) {                                               \
+            static const uint16_t _logFormatId = GetLogger().RegisterFormat(format);    \
+            GetLogger().Write(level, _logFormatId __VA_OPT__(,) __VA_ARGS__);           \
+        }                                                                               \
+    } while (0)
+
+#endif //SWE_MTH9815_LOGGER_HPP
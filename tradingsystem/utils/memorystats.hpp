@@ -0,0 +1,234 @@
+/**
+ * @file memorystats.hpp
+ * @brief Defines the memory accounting used by the services' MemoryStats() reports.
+ *
+ * Every service gives its store a CountingResource, so the bytes held by the container
+ * itself (nodes and bucket arrays) are measured exactly. Heap memory owned by the stored
+ * values (order book vectors, position maps, long strings) is estimated with HeapBytes()
+ * overloads defined next to each value type. The shutdown report adds both per service
+ * and per product, next to the process RSS.
+ *
+ * @author Niccolo Fabbri
+ */
+#ifndef SWE_MTH9815_MEMORYSTATS_HPP
+#define SWE_MTH9815_MEMORYSTATS_HPP
+
+#include <cstdio>
+#include <map>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../products.hpp"
+#include "logger.hpp"
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+/**
+ * @class CountingResource
+ * @brief std::pmr memory resource that tags and counts the allocations of one store.
+ *
+ * Not thread safe, like the services that own it.
+ */
+class CountingResource : public pmr::memory_resource
+{
+public:
+    // ctor with the resource the allocations are forwarded to
+    CountingResource(pmr::memory_resource* _upstream = pmr::get_default_resource());
+
+    // Bytes currently allocated through this resource
+    size_t GetLiveBytes() const;
+
+    // Highest value of GetLiveBytes() so far
+    size_t GetPeakBytes() const;
+
+    // Number of allocations currently alive
+    size_t GetLiveAllocations() const;
+
+private:
+    pmr::memory_resource* upstream;
+    size_t liveBytes;
+    size_t peakBytes;
+    size_t liveAllocations;
+
+    void* do_allocate(size_t _bytes, size_t _alignment) override;
+    void do_deallocate(void* _pointer, size_t _bytes, size_t _alignment) override;
+    bool do_is_equal(const pmr::memory_resource& _other) const noexcept override;
+};
+// **********************************************************************************
+//                  Implementation of CountingResource...
+// **********************************************************************************
+CountingResource::CountingResource(pmr::memory_resource* _upstream)
+{
+    upstream = _upstream;
+    liveBytes = 0;
+    peakBytes = 0;
+    liveAllocations = 0;
+}
+
+size_t CountingResource::GetLiveBytes() const
+{
+    return liveBytes;
+}
+
+size_t CountingResource::GetPeakBytes() const
+{
+    return peakBytes;
+}
+
+size_t CountingResource::GetLiveAllocations() const
+{
+    return liveAllocations;
+}
+
+void* CountingResource::do_allocate(size_t _bytes, size_t _alignment)
+{
+    void* _pointer = upstream->allocate(_bytes, _alignment);
+    liveBytes += _bytes;
+    liveAllocations++;
+    if (liveBytes > peakBytes) peakBytes = liveBytes;
+    return _pointer;
+}
+
+void CountingResource::do_deallocate(void* _pointer, size_t _bytes, size_t _alignment)
+{
+    upstream->deallocate(_pointer, _bytes, _alignment);
+    liveBytes -= _bytes;
+    liveAllocations--;
+}
+
+bool CountingResource::do_is_equal(const pmr::memory_resource& _other) const noexcept
+{
+    return this == &_other;
+}
+
+/**
+ * @struct ServiceMemoryStats
+ * @brief Memory held by one service, as returned by its MemoryStats() method.
+ */
+struct ServiceMemoryStats
+{
+    string service;
+    size_t entries = 0;                  ///< Records in the store
+    size_t containerBytes = 0;           ///< Nodes and buckets, measured by the tagged allocator
+    size_t peakContainerBytes = 0;       ///< High-water mark of containerBytes
+    size_t payloadBytes = 0;             ///< Estimated heap owned by keys and values
+    map<string, size_t> bytesPerProduct; ///< Estimated node + payload bytes per product
+
+    size_t LiveBytes() const { return containerBytes + payloadBytes; }
+};
+
+// Heap bytes owned by a value outside of its own object; types without heap storage own none
+template<typename V>
+size_t HeapBytes(const V&)
+{
+    return 0;
+}
+
+size_t HeapBytes(const string& _value)
+{
+    // strings stored inline (small string optimisation) own no heap
+    const char* _begin = reinterpret_cast<const char*>(&_value);
+    bool _inline = _value.data() >= _begin && _value.data() < _begin + sizeof(_value);
+    return _inline ? 0 : _value.capacity() + 1;
+}
+
+// Store keys held as views are interned in the trading day arena; count the interned bytes
+size_t HeapBytes(string_view _value)
+{
+    return _value.size();
+}
+
+template<typename V>
+size_t HeapBytes(const vector<V>& _value)
+{
+    size_t _bytes = _value.capacity() * sizeof(V);
+    for (const auto& _element : _value) _bytes += HeapBytes(_element);
+    return _bytes;
+}
+
+template<typename A, typename B>
+size_t HeapBytes(const pair<A, B>& _value)
+{
+    return HeapBytes(_value.first) + HeapBytes(_value.second);
+}
+
+template<typename K, typename V>
+size_t HeapBytes(const map<K, V>& _value)
+{
+    // red-black tree node: colour, parent, left, right and the value
+    size_t _bytes = _value.size() * (4 * sizeof(void*) + sizeof(pair<const K, V>));
+    for (const auto& _element : _value) _bytes += HeapBytes(_element.first) + HeapBytes(_element.second);
+    return _bytes;
+}
+
+size_t HeapBytes(const Bond& _value)
+{
+    return HeapBytes(_value.GetProductId()) + HeapBytes(_value.GetTicker());
+}
+
+// Fill the stats of a store allocated from _memory; _productOf(key, value) names the product of a record
+template<typename Map, typename ProductOf>
+ServiceMemoryStats CollectMemoryStats(const string& _service, const CountingResource& _memory, const Map& _store,
+                                      ProductOf _productOf)
+{
+    // hash node: next pointer, cached hash and the key/value pair
+    constexpr size_t NODE_BYTES = 2 * sizeof(void*) + sizeof(typename Map::value_type);
+
+    ServiceMemoryStats _stats;
+    _stats.service = _service;
+    _stats.entries = _store.size();
+    _stats.containerBytes = _memory.GetLiveBytes();
+    _stats.peakContainerBytes = _memory.GetPeakBytes();
+    for (const auto& _entry : _store) {
+        size_t _payload = HeapBytes(_entry.first) + HeapBytes(_entry.second);
+        _stats.payloadBytes += _payload;
+        _stats.bytesPerProduct[string(_productOf(_entry.first, _entry.second))] += NODE_BYTES + _payload;
+    }
+    return _stats;
+}
+
+// Same for a store keyed by product identifier
+template<typename Map>
+ServiceMemoryStats CollectMemoryStats(const string& _service, const CountingResource& _memory, const Map& _store)
+{
+    return CollectMemoryStats(_service, _memory, _store,
+                              [](const auto& _key, const auto&) -> const auto& { return _key; });
+}
+
+// Resident set size of the process, 0 where it cannot be read
+size_t GetResidentBytes()
+{
+#ifdef __linux__
+    FILE* _statm = fopen("/proc/self/statm", "r");
+    if (!_statm) return 0;
+    unsigned long _size = 0, _resident = 0;
+    int _read = fscanf(_statm, "%lu %lu", &_size, &_resident);
+    fclose(_statm);
+    return _read == 2 ? _resident * static_cast<size_t>(sysconf(_SC_PAGESIZE)) : 0;
+#else
+    return 0;
+#endif
+}
+
+// Log one line per service (per product at debug level) and the total against the process RSS
+void LogMemoryReport(const vector<ServiceMemoryStats>& _report)
+{
+    size_t _total = 0;
+    LOG(LEVEL_INFO, "Memory report: service, entries, live bytes (container + payload), peak container bytes");
+    for (const auto& _stats : _report) {
+        _total += _stats.LiveBytes();
+        LOG(LEVEL_INFO, "  {} entries={} live={} ({} + {}) peak={}", _stats.service, _stats.entries,
+            _stats.LiveBytes(), _stats.containerBytes, _stats.payloadBytes, _stats.peakContainerBytes);
+        for (const auto& [_product, _bytes] : _stats.bytesPerProduct) {
+            LOG(LEVEL_DEBUG, "    {} {} bytes", _product, _bytes);
+        }
+    }
+    LOG(LEVEL_INFO, "Memory report: {} bytes held by services, process RSS {} bytes", _total, GetResidentBytes());
+}
+
+#endif //SWE_MTH9815_MEMORYSTATS_HPP
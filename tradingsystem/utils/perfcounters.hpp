@@ -0,0 +1,191 @@
+/**
+ * @file perfcounters.hpp
+ * @brief Defines a thin wrapper over Linux hardware performance counters.
+ *
+ * Each counter is opened on its own with perf_event_open, user space only, for the
+ * calling thread. Counters the kernel or the hardware refuses (containers, VMs,
+ * perf_event_paranoid, non-Linux builds) are simply reported as unavailable, so the
+ * caller can still measure wall-clock time.
+ *
+ * @author Niccolo Fabbri
+ */
+#ifndef SWE_MTH9815_PERFCOUNTERS_HPP
+#define SWE_MTH9815_PERFCOUNTERS_HPP
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Hardware events captured around a measured region
+enum PerfCounter { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_L1D_MISSES, PERF_LLC_MISSES, PERF_BRANCH_MISSES, PERF_COUNTER_COUNT };
+
+// Counter values of one measured region
+struct PerfSample
+{
+    array<uint64_t, PERF_COUNTER_COUNT> values{};
+    array<bool, PERF_COUNTER_COUNT> available{};
+};
+
+/**
+ * @class PerfCounters
+ * @brief Set of hardware counters for the calling thread, started and stopped together.
+ *
+ * Values are scaled by enabled/running time when the kernel multiplexes the counters.
+ */
+class PerfCounters
+{
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // Whether the given counter could be opened
+    bool IsAvailable(PerfCounter _counter) const;
+
+    // Whether at least one counter could be opened
+    bool AnyAvailable() const;
+
+    // Reset and start all available counters
+    void Start();
+
+    // Stop all counters and read their values
+    PerfSample Stop();
+
+    // Short display name of a counter
+    static const char* Name(PerfCounter _counter);
+
+private:
+    array<int, PERF_COUNTER_COUNT> fds;
+
+    static int Open(PerfCounter _counter);
+};
+// **********************************************************************************
+//                  Implementation of PerfCounters...
+// **********************************************************************************
+PerfCounters::PerfCounters()
+{
+    for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+        fds[i] = Open(static_cast<PerfCounter>(i));
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+    for (int _fd : fds) {
+        if (_fd >= 0) close(_fd);
+    }
+#endif
+}
+
+bool PerfCounters::IsAvailable(PerfCounter _counter) const
+{
+    return fds[_counter] >= 0;
+}
+
+bool PerfCounters::AnyAvailable() const
+{
+    for (int _fd : fds) {
+        if (_fd >= 0) return true;
+    }
+    return false;
+}
+
+int PerfCounters::Open(PerfCounter _counter)
+{
+#ifdef __linux__
+    perf_event_attr _attr;
+    memset(&_attr, 0, sizeof(_attr));
+    _attr.size = sizeof(_attr);
+    _attr.disabled = 1;
+    _attr.exclude_kernel = 1;
+    _attr.exclude_hv = 1;
+    _attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    switch (_counter) {
+        case PERF_CYCLES:
+            _attr.type = PERF_TYPE_HARDWARE;
+            _attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_INSTRUCTIONS:
+            _attr.type = PERF_TYPE_HARDWARE;
+            _attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_L1D_MISSES:
+            _attr.type = PERF_TYPE_HW_CACHE;
+            _attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case PERF_LLC_MISSES:
+            _attr.type = PERF_TYPE_HARDWARE;
+            _attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case PERF_BRANCH_MISSES:
+            _attr.type = PERF_TYPE_HARDWARE;
+            _attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        default:
+            return -1;
+    }
+    return static_cast<int>(syscall(SYS_perf_event_open, &_attr, 0, -1, -1, 0));
+#else
+    (void)_counter;
+    return -1;
+#endif
+}
+
+void PerfCounters::Start()
+{
+#ifdef __linux__
+    for (int _fd : fds) {
+        if (_fd < 0) continue;
+        ioctl(_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+PerfSample PerfCounters::Stop()
+{
+    PerfSample _sample;
+#ifdef __linux__
+    for (int _fd : fds) {
+        if (_fd >= 0) ioctl(_fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+        if (fds[i] < 0) continue;
+        // value, time enabled, time running
+        uint64_t _read[3] = {0, 0, 0};
+        if (read(fds[i], _read, sizeof(_read)) != sizeof(_read) || _read[2] == 0) continue;
+        double _scale = static_cast<double>(_read[1]) / static_cast<double>(_read[2]);
+        _sample.values[i] = static_cast<uint64_t>(static_cast<double>(_read[0]) * _scale);
+        _sample.available[i] = true;
+    }
+#endif
+    return _sample;
+}
+
+const char* PerfCounters::Name(PerfCounter _counter)
+{
+    switch (_counter) {
+        case PERF_CYCLES: return "cycles";
+        case PERF_INSTRUCTIONS: return "instructions";
+        case PERF_L1D_MISSES: return "L1d-misses";
+        case PERF_LLC_MISSES: return "LLC-misses";
+        case PERF_BRANCH_MISSES: return "branch-misses";
+        default: return "unknown";
+    }
+}
+
+#endif //SWE_MTH9815_PERFCOUNTERS_HPP
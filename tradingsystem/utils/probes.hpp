@@ -0,0 +1,109 @@
+/**
+ * @file probes.hpp
+ * @brief Defines the USDT probes placed at the service boundaries of the trading system.
+ *
+ * Provider "bond" exposes four probes, each with (message type, product handle,
+ * ingestion timestamp in steady-clock nanoseconds) as arguments:
+ *   - subscribe__record   a connector ingests one input record
+ *   - onmessage__entry    a service starts processing a message
+ *   - onmessage__exit     a service is done with the message
+ *   - hd__publish         the historical data connector persists a record
+ *
+ * The ingestion timestamp is taken when the connector reads the record and is carried on
+ * the thread to every downstream probe. Nothing is computed unless a probe is attached,
+ * e.g. bpftrace -e 'usdt:./bond:bond:onmessage__exit { @[arg0] = hist(nsecs - arg2); }'
+ * (nsecs and the timestamp share the monotonic clock on Linux).
+ *
+ * @author Niccolo Fabbri
+ */
+#ifndef SWE_MTH9815_PROBES_HPP
+#define SWE_MTH9815_PROBES_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+#include "sdt.hpp"
+#include "utils.hpp"
+
+using namespace std;
+
+// Message type argument of the probes
+enum ProbeMessageType : uint32_t
+{
+    PROBE_PRICE = 1, PROBE_TRADE, PROBE_ORDER_BOOK, PROBE_POSITION, PROBE_PV01, PROBE_ALGO_EXECUTION,
+    PROBE_EXECUTION_ORDER, PROBE_ALGO_STREAM, PROBE_PRICE_STREAM, PROBE_INQUIRY, PROBE_BAR,
+    PROBE_EXECUTION_COST
+};
+
+BOND_SDT_SEMAPHORE(bond, subscribe__record);
+BOND_SDT_SEMAPHORE(bond, onmessage__entry);
+BOND_SDT_SEMAPHORE(bond, onmessage__exit);
+BOND_SDT_SEMAPHORE(bond, hd__publish);
+
+// Ingestion timestamp of the message being processed on this thread (0 if no probe was attached)
+uint64_t& ProbeIngestNanos()
+{
+    thread_local uint64_t _ingestNanos = 0;
+    return _ingestNanos;
+}
+
+// Fire subscribe__record for a record read by a connector and stamp its ingestion time
+void ProbeRecord(ProbeMessageType _type, string_view _productId)
+{
+    if (!BOND_SDT_ENABLED(bond, subscribe__record) && !BOND_SDT_ENABLED(bond, onmessage__entry) &&
+        !BOND_SDT_ENABLED(bond, onmessage__exit) && !BOND_SDT_ENABLED(bond, hd__publish)) {
+        ProbeIngestNanos() = 0;
+        return;
+    }
+    ProbeIngestNanos() = static_cast<uint64_t>(
+            chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+    if (BOND_SDT_ENABLED(bond, subscribe__record)) {
+        BOND_SDT_PROBE3(bond, subscribe__record, _type, GetProductHandle(_productId), ProbeIngestNanos());
+    }
+}
+
+// Fire hd__publish for a record persisted by the historical data connector
+void ProbePublish(ProbeMessageType _type, string_view _productId)
+{
+    if (BOND_SDT_ENABLED(bond, hd__publish)) {
+        BOND_SDT_PROBE3(bond, hd__publish, _type, GetProductHandle(_productId), ProbeIngestNanos());
+    }
+}
+
+/**
+ * @class ServiceProbe
+ * @brief Fires onmessage__entry on construction and onmessage__exit on destruction.
+ */
+class ServiceProbe
+{
+public:
+    template<typename Product>
+    ServiceProbe(ProbeMessageType _type, const Product& _product);
+    ~ServiceProbe();
+
+private:
+    ProbeMessageType type;
+    uint32_t handle;
+};
+
+template<typename Product>
+ServiceProbe::ServiceProbe(ProbeMessageType _type, const Product& _product)
+{
+    type = _type;
+    handle = INVALID_PRODUCT_HANDLE;
+    if (BOND_SDT_ENABLED(bond, onmessage__entry) || BOND_SDT_ENABLED(bond, onmessage__exit)) {
+        handle = GetProductHandle(_product.GetProductId());
+    }
+    if (BOND_SDT_ENABLED(bond, onmessage__entry)) {
+        BOND_SDT_PROBE3(bond, onmessage__entry, type, handle, ProbeIngestNanos());
+    }
+}
+
+ServiceProbe::~ServiceProbe()
+{
+    if (BOND_SDT_ENABLED(bond, onmessage__exit)) {
+        BOND_SDT_PROBE3(bond, onmessage__exit, type, handle, ProbeIngestNanos());
+    }
+}
+
+#endif //SWE_MTH9815_PROBES_HPP
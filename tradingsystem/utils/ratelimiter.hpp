@@ -0,0 +1,118 @@
+/**
+ * @file ratelimiter.hpp
+ * @brief Defines the lock-free token bucket used to respect message-rate limits.
+ *
+ * @author Niccolo Fabbri
+ */
+#ifndef SWE_MTH9815_RATELIMITER_HPP
+#define SWE_MTH9815_RATELIMITER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+
+using namespace std;
+
+/**
+ * @class RateLimiter
+ * @brief Token bucket of a given rate and burst, safe for concurrent callers without locks.
+ *
+ * The bucket is kept as a single timestamp, the theoretical arrival time (TAT) of the next
+ * message at the sustained rate (generic cell rate algorithm): a message at time t is allowed
+ * when TAT - t does not exceed the burst allowance, and pushes TAT to max(TAT, t) + interval.
+ * The whole state is one atomic integer, so taking a token is a load and a compare-exchange.
+ * Times are in nanoseconds of any monotonic clock, e.g. Tracer::Now().
+ *
+ * A rate of 0 means no limit.
+ */
+class RateLimiter
+{
+public:
+    // ctor with the sustained rate in messages per second and the burst in messages
+    RateLimiter(double _perSecond = 0, double _burst = 1);
+
+    // Change the limit; not meant to race with Acquire
+    void SetLimit(double _perSecond, double _burst);
+    bool IsLimited() const;
+
+    // Take a token if one is available at _now: 0 if taken, else the wait in nanoseconds until one is
+    int64_t TryAcquire(int64_t _now);
+
+    // Take the next token even if it is in the future, unless it is more than _maxWait away:
+    // the delay before the message may go, or -1 if nothing was reserved
+    int64_t Reserve(int64_t _now, int64_t _maxWait);
+
+    // Give back a token taken by TryAcquire or Reserve, e.g. when a second limit refuses the message
+    void Release();
+
+private:
+    int64_t interval;   ///< Nanoseconds per token, 0 for no limit
+    int64_t tolerance;  ///< How far ahead of the clock the TAT may run: (burst - 1) * interval
+    atomic<int64_t> tat;
+
+    // Move the TAT for one more message if it is at most _allowance ahead of _now; returns the wait
+    int64_t Take(int64_t _now, int64_t _allowance, bool& _taken);
+};
+// **********************************************************************************
+//                  Implementation of RateLimiter...
+// **********************************************************************************
+RateLimiter::RateLimiter(double _perSecond, double _burst) : tat(0)
+{
+    SetLimit(_perSecond, _burst);
+}
+
+void RateLimiter::SetLimit(double _perSecond, double _burst)
+{
+    if (_perSecond < 0 || _burst < 1) {
+        throw std::runtime_error("Invalid rate limit");
+    }
+    interval = _perSecond > 0 ? static_cast<int64_t>(1e9 / _perSecond) : 0;
+    tolerance = static_cast<int64_t>((_burst - 1) * static_cast<double>(interval));
+    tat.store(0, memory_order_relaxed);
+}
+
+bool RateLimiter::IsLimited() const
+{
+    return interval > 0;
+}
+
+int64_t RateLimiter::Take(int64_t _now, int64_t _allowance, bool& _taken)
+{
+    int64_t _tat = tat.load(memory_order_relaxed);
+    while (true) {
+        int64_t _start = max(_tat, _now);
+        int64_t _ahead = _start - _now;
+        if (_ahead > _allowance) {
+            _taken = false;
+            return _ahead - tolerance;
+        }
+        if (tat.compare_exchange_weak(_tat, _start + interval, memory_order_relaxed)) {
+            _taken = true;
+            return max<int64_t>(_ahead - tolerance, 0);
+        }
+    }
+}
+
+int64_t RateLimiter::TryAcquire(int64_t _now)
+{
+    if (interval == 0) return 0;
+    bool _taken;
+    int64_t _wait = Take(_now, tolerance, _taken);
+    return _taken ? 0 : _wait;
+}
+
+int64_t RateLimiter::Reserve(int64_t _now, int64_t _maxWait)
+{
+    if (interval == 0) return 0;
+    bool _taken;
+    int64_t _wait = Take(_now, tolerance + _maxWait, _taken);
+    return _taken ? _wait : -1;
+}
+
+void RateLimiter::Release()
+{
+    if (interval > 0) tat.fetch_sub(interval, memory_order_relaxed);
+}
+
+#endif //SWE_MTH9815_RATELIMITER_HPP
@@ -0,0 +1,256 @@
+/**
+ * @file retention.hpp
+ * @brief Defines the retention policies that bound the in-memory stores of the services.
+ *
+ * A store keeps each record in a Retained wrapper, registers every insert or update with its
+ * RetentionIndex and erases the keys the index hands back. The recency list is intrusive: its
+ * links live in the records, so touching a key and evicting the oldest one are both O(1) and
+ * tracking a record allocates nothing beyond the store's own node.
+ *
+ * @author Niccolo Fabbri
+ */
+#ifndef SWE_MTH9815_RETENTION_HPP
+#define SWE_MTH9815_RETENTION_HPP
+
+#include <chrono>
+#include <cstddef>
+
+using namespace std;
+
+// How long a store keeps its records
+enum RetentionMode { KEEP_ALL, KEEP_LAST_N, KEEP_LAST_SECONDS, NONE_AFTER_PERSIST };
+
+/**
+ * @struct RetentionPolicy
+ * @brief Retention mode of a store with its limit.
+ */
+struct RetentionPolicy
+{
+    RetentionMode mode = KEEP_ALL;
+    size_t lastN = 0;      ///< Records kept in KEEP_LAST_N mode
+    double seconds = 0;    ///< Age of the oldest record kept in KEEP_LAST_SECONDS mode
+
+    static RetentionPolicy KeepAll() { return {KEEP_ALL, 0, 0}; }
+    static RetentionPolicy KeepLastN(size_t _n) { return {KEEP_LAST_N, _n, 0}; }
+    static RetentionPolicy KeepLastSeconds(double _seconds) { return {KEEP_LAST_SECONDS, 0, _seconds}; }
+    static RetentionPolicy NoneAfterPersist() { return {NONE_AFTER_PERSIST, 0, 0}; }
+};
+
+/**
+ * @struct RetentionHook
+ * @brief Links of a record in the recency list of its RetentionIndex.
+ *
+ * The hook points at the key of the store node holding it, so the store must not move its
+ * records (node based maps such as unordered_map are fine). Copies start unlinked.
+ */
+template<typename K>
+struct RetentionHook
+{
+    const K* key = nullptr;
+    RetentionHook* prev = nullptr;
+    RetentionHook* next = nullptr;
+    chrono::steady_clock::time_point written;
+    bool linked = false;
+
+    RetentionHook() = default;
+    RetentionHook(const RetentionHook&) {}
+    RetentionHook& operator=(const RetentionHook&) { return *this; }
+};
+
+/**
+ * @struct Retained
+ * @brief A record of a store with its recency links.
+ */
+template<typename K, typename V>
+struct Retained
+{
+    V value;
+    RetentionHook<K> hook;
+
+    Retained(const V& _value) : value(_value) {}
+};
+
+// Heap owned by a retained record: that of the record, the links own nothing
+template<typename K, typename V>
+size_t HeapBytes(const Retained<K, V>& _record)
+{
+    return HeapBytes(_record.value);
+}
+
+/**
+ * @class RetentionIndex
+ * @brief Recency index of the keys of a store, applying its RetentionPolicy.
+ *
+ * Keys are ordered from least to most recently written. Every method that may evict takes
+ * an _evict(key) callback, called for each key the store must erase. In KEEP_LAST_SECONDS
+ * mode old records go on every write and on every Expire, which stores call on their reads,
+ * so a store that stops receiving writes still shrinks.
+ *
+ * @tparam K The key type of the store.
+ */
+template<typename K>
+class RetentionIndex
+{
+public:
+    RetentionIndex(RetentionPolicy _policy = RetentionPolicy::KeepAll());
+
+    // Change the policy, before the store is filled: keys written under KEEP_ALL are not tracked
+    void SetPolicy(RetentionPolicy _policy);
+    const RetentionPolicy& GetPolicy() const;
+
+    // Record an insert or update of the record holding _hook, stored under _key, and evict
+    // whatever the policy no longer keeps
+    template<typename Evict>
+    void Touch(const K& _key, RetentionHook<K>& _hook, Evict _evict);
+
+    // Evict the records older than the KEEP_LAST_SECONDS limit
+    template<typename Evict>
+    void Expire(Evict _evict);
+
+    // Record that _key was persisted; evicts it in NONE_AFTER_PERSIST mode
+    template<typename Evict>
+    void Persisted(const K& _key, Evict _evict);
+
+    // Forget every key without evicting, e.g. when the store itself is cleared
+    void Clear();
+
+    // Number of keys tracked
+    size_t Size() const;
+
+    // Number of keys evicted so far
+    size_t GetEvictions() const;
+
+private:
+    using Clock = chrono::steady_clock;
+
+    RetentionPolicy policy;
+    RetentionHook<K>* oldest;   ///< Front of the recency list
+    RetentionHook<K>* newest;   ///< Back of the recency list
+    size_t size;
+    size_t evictions;
+
+    void Unlink(RetentionHook<K>& _hook);
+
+    template<typename Evict>
+    void EvictOldest(Evict& _evict);
+
+    template<typename Evict>
+    void EvictOlderThan(Clock::time_point _now, Evict& _evict);
+};
+// **********************************************************************************
+//                  Implementation of RetentionIndex...
+// **********************************************************************************
+template<typename K>
+RetentionIndex<K>::RetentionIndex(RetentionPolicy _policy)
+{
+    policy = _policy;
+    oldest = nullptr;
+    newest = nullptr;
+    size = 0;
+    evictions = 0;
+}
+
+template<typename K>
+void RetentionIndex<K>::SetPolicy(RetentionPolicy _policy)
+{
+    policy = _policy;
+}
+
+template<typename K>
+const RetentionPolicy& RetentionIndex<K>::GetPolicy() const
+{
+    return policy;
+}
+
+template<typename K>
+void RetentionIndex<K>::Unlink(RetentionHook<K>& _hook)
+{
+    (_hook.prev ? _hook.prev->next : oldest) = _hook.next;
+    (_hook.next ? _hook.next->prev : newest) = _hook.prev;
+    _hook.prev = _hook.next = nullptr;
+    _hook.linked = false;
+    size--;
+}
+
+template<typename K>
+template<typename Evict>
+void RetentionIndex<K>::EvictOldest(Evict& _evict)
+{
+    // the store erases the node holding the hook and its key, so work on a copy of the key
+    K _key = *oldest->key;
+    Unlink(*oldest);
+    _evict(_key);
+    evictions++;
+}
+
+template<typename K>
+template<typename Evict>
+void RetentionIndex<K>::EvictOlderThan(Clock::time_point _now, Evict& _evict)
+{
+    auto _cutoff = _now - chrono::duration_cast<Clock::duration>(chrono::duration<double>(policy.seconds));
+    while (oldest && oldest->written < _cutoff) EvictOldest(_evict);
+}
+
+template<typename K>
+template<typename Evict>
+void RetentionIndex<K>::Touch(const K& _key, RetentionHook<K>& _hook, Evict _evict)
+{
+    // the store keeps everything, no need to track recency
+    if (policy.mode == KEEP_ALL || policy.mode == NONE_AFTER_PERSIST) return;
+
+    // move the record to the back
+    if (_hook.linked) Unlink(_hook);
+    Clock::time_point _now = Clock::now();
+    _hook.key = &_key;
+    _hook.written = _now;
+    _hook.prev = newest;
+    _hook.next = nullptr;
+    _hook.linked = true;
+    (newest ? newest->next : oldest) = &_hook;
+    newest = &_hook;
+    size++;
+
+    if (policy.mode == KEEP_LAST_N) {
+        while (size > policy.lastN) EvictOldest(_evict);
+    } else {
+        EvictOlderThan(_now, _evict);
+    }
+}
+
+template<typename K>
+template<typename Evict>
+void RetentionIndex<K>::Expire(Evict _evict)
+{
+    if (policy.mode == KEEP_LAST_SECONDS) EvictOlderThan(Clock::now(), _evict);
+}
+
+template<typename K>
+template<typename Evict>
+void RetentionIndex<K>::Persisted(const K& _key, Evict _evict)
+{
+    if (policy.mode != NONE_AFTER_PERSIST) return;
+    _evict(_key);
+    evictions++;
+}
+
+template<typename K>
+void RetentionIndex<K>::Clear()
+{
+    oldest = nullptr;
+    newest = nullptr;
+    size = 0;
+}
+
+template<typename K>
+size_t RetentionIndex<K>::Size() const
+{
+    return size;
+}
+
+template<typename K>
+size_t RetentionIndex<K>::GetEvictions() const
+{
+    return evictions;
+}
+
+#endif //SWE_MTH9815_RETENTION_HPP
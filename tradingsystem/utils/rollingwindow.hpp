@@ -0,0 +1,98 @@
+/**
+ * @file rollingwindow.hpp
+ * @brief Defines the fixed-size ring buffer used for rolling statistics.
+ *
+ * @author Niccolo Fabbri
+ */
+#ifndef SWE_MTH9815_ROLLINGWINDOW_HPP
+#define SWE_MTH9815_ROLLINGWINDOW_HPP
+
+#include <array>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * @class RollingWeightedMean
+ * @brief Weighted mean of the last N samples, updated in O(1) per sample.
+ *
+ * Samples live in a ring buffer; the running sums add the new sample and subtract the
+ * one it overwrites. The sums are rebuilt from the buffer once per lap so rounding
+ * errors of the add/subtract updates cannot accumulate.
+ *
+ * @tparam N The number of samples in the window.
+ */
+template<size_t N>
+class RollingWeightedMean
+{
+public:
+    RollingWeightedMean();
+
+    // Add a sample with its weight (time in force, traded volume, ...)
+    void Add(double _value, double _weight);
+
+    // Weighted mean of the window, _fallback while the window holds no weight
+    double Mean(double _fallback = 0.0) const;
+
+    // Number of samples in the window
+    size_t Size() const;
+
+private:
+    array<double, N> values;
+    array<double, N> weights;
+    size_t next;
+    size_t count;
+    double sumWeightedValues;
+    double sumWeights;
+};
+// **********************************************************************************
+//                  Implementation of RollingWeightedMean...
+// **********************************************************************************
+template<size_t N>
+RollingWeightedMean<N>::RollingWeightedMean() :
+        values(), weights()
+{
+    next = 0;
+    count = 0;
+    sumWeightedValues = 0;
+    sumWeights = 0;
+}
+
+template<size_t N>
+void RollingWeightedMean<N>::Add(double _value, double _weight)
+{
+    if (count == N) {
+        sumWeightedValues -= values[next] * weights[next];
+        sumWeights -= weights[next];
+    } else {
+        count++;
+    }
+    values[next] = _value;
+    weights[next] = _weight;
+    sumWeightedValues += _value * _weight;
+    sumWeights += _weight;
+
+    if (++next == N) {
+        next = 0;
+        sumWeightedValues = 0;
+        sumWeights = 0;
+        for (size_t i = 0; i < count; ++i) {
+            sumWeightedValues += values[i] * weights[i];
+            sumWeights += weights[i];
+        }
+    }
+}
+
+template<size_t N>
+double RollingWeightedMean<N>::Mean(double _fallback) const
+{
+    return sumWeights > 0 ? sumWeightedValues / sumWeights : _fallback;
+}
+
+template<size_t N>
+size_t RollingWeightedMean<N>::Size() const
+{
+    return count;
+}
+
+#endif //SWE_MTH9815_ROLLINGWINDOW_HPP
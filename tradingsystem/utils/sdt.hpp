@@ -0,0 +1,82 @@
+/**
+ * @file sdt.hpp
+ * @brief Compact, vendored version of the SystemTap <sys/sdt.h> USDT probe macros.
+ *
+ * A probe site compiles to a single nop plus an entry in the .note.stapsdt ELF section
+ * that tells bpftrace, perf and SystemTap where the nop is and where each argument lives.
+ * Every probe has a semaphore that the tracer increments while it is attached, so the
+ * arguments can be computed only when somebody is listening.
+ *
+ * Only 64-bit ELF targets (x86-64, AArch64) are supported. Elsewhere the probes compile
+ * to nothing and BOND_SDT_ENABLED is always false.
+ *
+ * @author Niccolo Fabbri
+ */
+#ifndef SWE_MTH9815_SDT_HPP
+#define SWE_MTH9815_SDT_HPP
+
+#include <cstdint>
+
+#if defined(__linux__) && defined(__ELF__) && (defined(__x86_64__) || defined(__aarch64__))
+#define BOND_SDT_SUPPORTED 1
+#else
+#define BOND_SDT_SUPPORTED 0
+#endif
+
+#define BOND_SDT_SEMAPHORE_NAME(provider, name) provider##_##name##_semaphore
+
+#if BOND_SDT_SUPPORTED
+
+// Define the semaphore of a probe; weak so the header can be included in several translation units
+#define BOND_SDT_SEMAPHORE(provider, name)                                 \
+    extern "C" volatile unsigned short BOND_SDT_SEMAPHORE_NAME(provider, name); \
+    __attribute__((weak, used, section(".probes")))                           \
+    volatile unsigned short BOND_SDT_SEMAPHORE_NAME(provider, name) = 0
+
+// True while a tracer is attached to the probe
+#define BOND_SDT_ENABLED(provider, name) \
+    __builtin_expect(BOND_SDT_SEMAPHORE_NAME(provider, name) != 0, 0)
+
+// Probe site with three 64-bit arguments, described to the tracer as "8@<operand>"; arguments are
+// kept in registers or immediates because tracers cannot read thread-local memory operands
+#define BOND_SDT_PROBE3(provider, name, arg1, arg2, arg3)                                              \
+    __asm__ __volatile__(                                                                              \
+        "990: nop\n"                                                                                   \
+        ".pushsection .note.stapsdt,\"?\",\"note\"\n"                                                  \
+        ".balign 4\n"                                                                                  \
+        ".4byte 992f-991f, 994f-993f, 3\n"                                                             \
+        "991: .asciz \"stapsdt\"\n"                                                                    \
+        "992: .balign 4\n"                                                                             \
+        "993: .8byte 990b\n"                                                                           \
+        ".8byte _.stapsdt.base\n"                                                                      \
+        ".8byte " #provider "_" #name "_semaphore\n"                                                   \
+        ".asciz \"" #provider "\"\n"                                                                   \
+        ".asciz \"" #name "\"\n"                                                                       \
+        ".asciz \"8@%0 8@%1 8@%2\"\n"                                                                  \
+        "994: .balign 4\n"                                                                             \
+        ".popsection\n"                                                                                \
+        ".ifndef _.stapsdt.base\n"                                                                     \
+        ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"                        \
+        ".weak _.stapsdt.base\n"                                                                       \
+        ".hidden _.stapsdt.base\n"                                                                     \
+        "_.stapsdt.base: .space 1\n"                                                                   \
+        ".size _.stapsdt.base, 1\n"                                                                    \
+        ".popsection\n"                                                                                \
+        ".endif\n"                                                                                     \
+        :                                                                                              \
+        : "nr"(static_cast<uint64_t>(arg1)), "nr"(static_cast<uint64_t>(arg2)),                        \
+          "nr"(static_cast<uint64_t>(arg3)))
+
+#else
+
+#define BOND_SDT_SEMAPHORE(provider, name) \
+    constexpr unsigned short BOND_SDT_SEMAPHORE_NAME(provider, name) = 0
+
+#define BOND_SDT_ENABLED(provider, name) false
+
+#define BOND_SDT_PROBE3(provider, name, arg1, arg2, arg3) \
+    do { (void)(arg1); (void)(arg2); (void)(arg3); } while (0)
+
+#endif
+
+#endif //SWE_MTH9815_SDT_HPP
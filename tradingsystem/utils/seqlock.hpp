@@ -0,0 +1,95 @@
+/**
+ * @file seqlock.hpp
+ * @brief Defines the sequence lock publishing snapshots from one writer to any number of readers.
+ *
+ * @author Niccolo Fabbri
+ */
+#ifndef SWE_MTH9815_SEQLOCK_HPP
+#define SWE_MTH9815_SEQLOCK_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+using namespace std;
+
+/**
+ * @class SeqLock
+ * @brief Snapshot of a trivially copyable value, written by one thread and read without locks.
+ *
+ * The writer makes the sequence odd, copies the value in and makes it even again; a reader
+ * copies the value out between two reads of the sequence and retries if they differ or are
+ * odd. Neither side ever blocks the other, and the writer never waits for readers. The value
+ * is kept as relaxed atomic words, so a torn copy is only ever discarded, never a data race.
+ *
+ * @tparam V The value type, trivially copyable.
+ */
+template<typename V>
+class SeqLock
+{
+    static_assert(is_trivially_copyable_v<V>, "SeqLock values are copied word by word");
+    static constexpr size_t WORDS = (sizeof(V) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+public:
+    SeqLock();
+
+    // Publish a new value; a single writer thread
+    void Store(const V& _value);
+
+    // Consistent copy of the last published value, from any thread
+    V Load() const;
+
+    // Number of values published so far
+    uint64_t GetVersion() const;
+
+private:
+    alignas(64) atomic<uint64_t> sequence;
+    array<atomic<uint64_t>, WORDS> words;
+};
+// **********************************************************************************
+//                  Implementation of SeqLock...
+// **********************************************************************************
+template<typename V>
+SeqLock<V>::SeqLock() : sequence(0)
+{
+    for (auto& _word : words) _word.store(0, memory_order_relaxed);
+}
+
+template<typename V>
+void SeqLock<V>::Store(const V& _value)
+{
+    uint64_t _buffer[WORDS] = {};
+    memcpy(_buffer, &_value, sizeof(V));
+
+    uint64_t _sequence = sequence.load(memory_order_relaxed);
+    sequence.store(_sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (size_t i = 0; i < WORDS; ++i) words[i].store(_buffer[i], memory_order_relaxed);
+    sequence.store(_sequence + 2, memory_order_release);
+}
+
+template<typename V>
+V SeqLock<V>::Load() const
+{
+    uint64_t _buffer[WORDS];
+    while (true) {
+        uint64_t _before = sequence.load(memory_order_acquire);
+        if (_before & 1) continue;
+        for (size_t i = 0; i < WORDS; ++i) _buffer[i] = words[i].load(memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (sequence.load(memory_order_relaxed) == _before) break;
+    }
+    V _value;
+    memcpy(&_value, _buffer, sizeof(V));
+    return _value;
+}
+
+template<typename V>
+uint64_t SeqLock<V>::GetVersion() const
+{
+    return sequence.load(memory_order_acquire) / 2;
+}
+
+#endif //SWE_MTH9815_SEQLOCK_HPP
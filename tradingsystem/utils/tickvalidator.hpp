@@ -0,0 +1,201 @@
+/**
+ * @file tickvalidator.hpp
+ * @brief Defines the batch validation of price ticks before they reach the pricing service.
+ *
+ * @author Niccolo Fabbri
+ */
+#ifndef SWE_MTH9815_TICKVALIDATOR_HPP
+#define SWE_MTH9815_TICKVALIDATOR_HPP
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include "utils.hpp"
+
+using namespace std;
+
+// Reasons for rejecting a tick, as bit flags: a tick may fail several checks
+enum TickReject : uint8_t
+{
+    TICK_OK = 0,
+    TICK_CROSSED = 1,        ///< Bid above ask, or a price that is not a positive number
+    TICK_JUMP = 2,           ///< Mid outside the rolling band of the product
+    TICK_STALE = 4,          ///< Timestamp older than the last accepted tick, or than the maximum age
+    TICK_UNKNOWN_PRODUCT = 8
+};
+
+// Readable list of the reasons set in a reject mask
+string FormatTickReject(uint8_t _reasons);
+
+/**
+ * @class TickValidator
+ * @brief Checks batches of ticks for crossed markets, jumps and stale timestamps.
+ *
+ * A batch is a set of parallel arrays (product handle, bid, ask, timestamp). The checks run
+ * as straight-line comparisons over the arrays, without branches, so the compiler turns them
+ * into vector compares across the batch. The band of each product is an exponentially
+ * weighted mean of the accepted mids and of their absolute deviation; the batch is compared
+ * against the band as of its start, then the accepted ticks update the bands in order. A
+ * jump flagged against the start band is checked again against the updated band, so a trend
+ * inside a batch is not rejected. After RESEED_AFTER jumps in a row the product is taken to have
+ * moved to a new level, and its band restarts from the last tick.
+ *
+ * A timestamp of 0 means the tick carries none and skips the staleness check.
+ */
+class TickValidator
+{
+public:
+    static constexpr size_t BATCH = 64;
+    static constexpr int RESEED_AFTER = 8;
+
+    TickValidator();
+
+    // Band half-width: max(_minWidth, _deviations * mean absolute deviation); _alpha is the EWMA weight
+    void SetBand(double _minWidth, double _deviations, double _alpha);
+
+    // Reject timestamped ticks older than _maxAgeMillis at validation time, 0 to disable
+    void SetMaxAge(long _maxAgeMillis);
+
+    // Validate _count <= BATCH ticks, writing a TickReject mask per tick
+    void Validate(size_t _count, const uint32_t* _handles, const double* _bids, const double* _asks,
+                  const long* _millis, uint8_t* _reasons);
+
+    // Ticks rejected since construction
+    long GetRejectedCount() const;
+
+private:
+    double minWidth;
+    double deviations;
+    double alpha;
+    long maxAgeMillis;
+    long rejected;
+    array<double, PRODUCT_COUNT + 1> centers;     ///< EWMA of the accepted mids, last slot for unknown products
+    array<double, PRODUCT_COUNT + 1> widths;      ///< Current band half-width
+    array<double, PRODUCT_COUNT + 1> spreads;     ///< EWMA of the absolute deviations
+    array<long, PRODUCT_COUNT + 1> lastMillis;    ///< Timestamp of the last accepted tick
+    array<bool, PRODUCT_COUNT + 1> seeded;        ///< Band seeded by a first tick
+    array<int, PRODUCT_COUNT + 1> jumps;          ///< Jumps rejected in a row
+
+    // Fold an accepted mid into the band of a product
+    void Accept(uint32_t _slot, double _mid, long _millis);
+};
+// **********************************************************************************
+//                  Implementation of TickValidator...
+// **********************************************************************************
+string FormatTickReject(uint8_t _reasons)
+{
+    if (_reasons == TICK_OK) return "OK";
+    string _text;
+    auto _add = [&_text](const char* _name) { _text += _text.empty() ? _name : string("|") + _name; };
+    if (_reasons & TICK_CROSSED) _add("CROSSED");
+    if (_reasons & TICK_JUMP) _add("JUMP");
+    if (_reasons & TICK_STALE) _add("STALE");
+    if (_reasons & TICK_UNKNOWN_PRODUCT) _add("UNKNOWN_PRODUCT");
+    return _text;
+}
+
+TickValidator::TickValidator()
+{
+    // a point of price on a band that would take 30+ ticks of 1/256 to cross
+    SetBand(1.0, 8.0, 1.0 / 16);
+    maxAgeMillis = 0;
+    rejected = 0;
+    centers.fill(0);
+    spreads.fill(0);
+    lastMillis.fill(0);
+    seeded.fill(false);
+    jumps.fill(0);
+    widths.fill(INFINITY);
+}
+
+void TickValidator::SetBand(double _minWidth, double _deviations, double _alpha)
+{
+    if (!(_minWidth > 0) || _deviations < 0 || !(_alpha > 0 && _alpha <= 1)) {
+        throw std::runtime_error("Invalid tick band parameters");
+    }
+    minWidth = _minWidth;
+    deviations = _deviations;
+    alpha = _alpha;
+}
+
+void TickValidator::SetMaxAge(long _maxAgeMillis)
+{
+    maxAgeMillis = _maxAgeMillis;
+}
+
+long TickValidator::GetRejectedCount() const
+{
+    return rejected;
+}
+
+void TickValidator::Accept(uint32_t _slot, double _mid, long _millis)
+{
+    if (!seeded[_slot]) {
+        centers[_slot] = _mid;
+        seeded[_slot] = true;
+    } else {
+        spreads[_slot] += alpha * (fabs(_mid - centers[_slot]) - spreads[_slot]);
+        centers[_slot] += alpha * (_mid - centers[_slot]);
+    }
+    widths[_slot] = max(minWidth, deviations * spreads[_slot]);
+    jumps[_slot] = 0;
+    if (_millis != 0) lastMillis[_slot] = _millis;
+}
+
+void TickValidator::Validate(size_t _count, const uint32_t* _handles, const double* _bids, const double* _asks,
+                             const long* _millis, uint8_t* _reasons)
+{
+    if (_count > BATCH) {
+        throw std::runtime_error("Tick batch larger than " + to_string(BATCH));
+    }
+
+    // gather the state of each tick's product, unknown products use the spare slot
+    uint32_t _slots[BATCH];
+    double _centers[BATCH], _widths[BATCH];
+    long _last[BATCH];
+    for (size_t i = 0; i < _count; ++i) {
+        _slots[i] = _handles[i] < PRODUCT_COUNT ? _handles[i] : PRODUCT_COUNT;
+        _centers[i] = centers[_slots[i]];
+        _widths[i] = widths[_slots[i]];
+        _last[i] = lastMillis[_slots[i]];
+    }
+
+    // every check at once, as masks; NaN prices fail the ordered comparisons
+    long _oldest = maxAgeMillis > 0 ? GetCurrentTimeMillis() - maxAgeMillis : 0;
+    for (size_t i = 0; i < _count; ++i) {
+        double _mid = 0.5 * (_bids[i] + _asks[i]);
+        uint8_t _crossed = !(_bids[i] > 0 && _bids[i] <= _asks[i]);
+        uint8_t _jump = !(fabs(_mid - _centers[i]) <= _widths[i]);
+        uint8_t _stale = (_millis[i] != 0) & ((_millis[i] < _last[i]) | (_millis[i] < _oldest));
+        uint8_t _unknown = _slots[i] == PRODUCT_COUNT;
+        _reasons[i] = static_cast<uint8_t>(_crossed * TICK_CROSSED | _jump * TICK_JUMP
+                                           | _stale * TICK_STALE | _unknown * TICK_UNKNOWN_PRODUCT);
+    }
+
+    // fold the accepted ticks into the bands in order
+    for (size_t i = 0; i < _count; ++i) {
+        uint32_t _slot = _slots[i];
+        double _mid = 0.5 * (_bids[i] + _asks[i]);
+        // an earlier tick of this batch may have moved the product's last timestamp
+        if (_millis[i] != 0 && _millis[i] < lastMillis[_slot]) {
+            _reasons[i] |= TICK_STALE;
+        }
+        if (_reasons[i] == TICK_JUMP) {
+            if (fabs(_mid - centers[_slot]) <= widths[_slot]) {
+                _reasons[i] = TICK_OK;
+            } else if (++jumps[_slot] >= RESEED_AFTER) {
+                seeded[_slot] = false;
+                spreads[_slot] = 0;
+                _reasons[i] = TICK_OK;
+            }
+        }
+        if (_reasons[i] == TICK_OK) {
+            Accept(_slot, _mid, _millis[i]);
+        } else {
+            rejected++;
+        }
+    }
+}
+
+#endif //SWE_MTH9815_TICKVALIDATOR_HPP
@@ -0,0 +1,251 @@
+/**
+ * @file tracer.hpp
+ * @brief Defines the sampled pipeline tracer that exports Chrome/Perfetto trace JSON.
+ *
+ * Each message gets a correlation ID when a connector ingests it. One message in N is
+ * sampled; while a sampled message travels through the services, every TraceSpan on its
+ * path records a begin/end pair into a per-thread buffer. At shutdown the buffers are
+ * written as trace-event JSON that chrome://tracing and ui.perfetto.dev can open.
+ *
+ * @author Niccolo Fabbri
+ */
+#ifndef SWE_MTH9815_TRACER_HPP
+#define SWE_MTH9815_TRACER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "logger.hpp"
+
+using namespace std;
+
+// One completed span of a sampled message
+struct TraceEvent
+{
+    const char* name;
+    int64_t beginNanos;
+    int64_t endNanos;
+    uint64_t correlationId;
+};
+
+/**
+ * @class Tracer
+ * @brief Collects spans of sampled messages and dumps them as trace-event JSON.
+ *
+ * Each thread keeps at most MAX_EVENTS_PER_THREAD spans; later spans are dropped and
+ * counted, so a long run at a high sampling rate cannot grow the buffers without bound.
+ */
+class Tracer
+{
+public:
+    static constexpr size_t MAX_EVENTS_PER_THREAD = 1 << 20;
+
+    Tracer();
+
+    // Sample one message in _sampleEvery and write the trace to _outputPath at Dump()
+    void Enable(uint64_t _sampleEvery, const string& _outputPath);
+    bool IsEnabled() const;
+
+    // Assign the next correlation ID; returns it if the message is sampled, 0 otherwise
+    uint64_t NextCorrelationId();
+
+    // Record a completed span on the calling thread's buffer, dropped once the buffer is full
+    void Record(const char* _name, int64_t _beginNanos, int64_t _endNanos, uint64_t _correlationId);
+
+    // Write all recorded spans to the output file
+    void Dump();
+
+    // Correlation ID of the message being processed on this thread (0 if not sampled)
+    static uint64_t& CurrentCorrelationId();
+
+    // Monotonic clock used for spans
+    static int64_t Now();
+
+private:
+    struct ThreadBuffer
+    {
+        uint32_t threadId;
+        vector<TraceEvent> events;
+        uint64_t dropped = 0;    ///< Spans not recorded because the buffer was full
+    };
+
+    atomic<bool> enabled;
+    uint64_t sampleEvery;
+    atomic<uint64_t> nextId;
+    string outputPath;
+    mutex registryMutex;                          ///< Guards buffer registration and Dump
+    vector<unique_ptr<ThreadBuffer>> buffers;     ///< One buffer per recording thread
+
+    ThreadBuffer& ThreadLocalBuffer();
+};
+// **********************************************************************************
+//                  Implementation of Tracer...
+// **********************************************************************************
+Tracer::Tracer() : enabled(false), sampleEvery(1), nextId(0) {}
+
+void Tracer::Enable(uint64_t _sampleEvery, const string& _outputPath)
+{
+    sampleEvery = _sampleEvery == 0 ? 1 : _sampleEvery;
+    outputPath = _outputPath;
+    enabled.store(true, memory_order_release);
+}
+
+bool Tracer::IsEnabled() const
+{
+    return enabled.load(memory_order_relaxed);
+}
+
+uint64_t Tracer::NextCorrelationId()
+{
+    uint64_t _id = nextId.fetch_add(1, memory_order_relaxed) + 1;
+    return _id % sampleEvery == 0 ? _id : 0;
+}
+
+uint64_t& Tracer::CurrentCorrelationId()
+{
+    thread_local uint64_t _current = 0;
+    return _current;
+}
+
+int64_t Tracer::Now()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Tracer::ThreadBuffer& Tracer::ThreadLocalBuffer()
+{
+    thread_local ThreadBuffer* _buffer = nullptr;
+    if (!_buffer) {
+        lock_guard<mutex> _lock(registryMutex);
+        buffers.push_back(make_unique<ThreadBuffer>());
+        _buffer = buffers.back().get();
+        _buffer->threadId = static_cast<uint32_t>(buffers.size());
+        _buffer->events.reserve(1 << 16);
+    }
+    return *_buffer;
+}
+
+void Tracer::Record(const char* _name, int64_t _beginNanos, int64_t _endNanos, uint64_t _correlationId)
+{
+    ThreadBuffer& _buffer = ThreadLocalBuffer();
+    if (_buffer.events.size() >= MAX_EVENTS_PER_THREAD) {
+        _buffer.dropped++;
+        return;
+    }
+    _buffer.events.push_back({_name, _beginNanos, _endNanos, _correlationId});
+}
+
+void Tracer::Dump()
+{
+    if (!IsEnabled()) return;
+    lock_guard<mutex> _lock(registryMutex);
+    ofstream _file(outputPath);
+    if (!_file.is_open()) {
+        LOG(LEVEL_ERROR, "Failed to open trace file: {}", outputPath);
+        return;
+    }
+
+    size_t _count = 0;
+    uint64_t _dropped = 0;
+    _file << fixed << setprecision(3);
+    _file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    for (const auto& _buffer : buffers) {
+        _dropped += _buffer->dropped;
+        for (const auto& _event : _buffer->events) {
+            if (_count++ > 0) _file << ",\n";
+            _file << "{\"name\":\"" << _event.name << "\",\"cat\":\"bond\",\"ph\":\"X\""
+                  << ",\"ts\":" << _event.beginNanos / 1000.0
+                  << ",\"dur\":" << (_event.endNanos - _event.beginNanos) / 1000.0
+                  << ",\"pid\":1,\"tid\":" << _buffer->threadId
+                  << ",\"args\":{\"correlationId\":" << _event.correlationId << "}}";
+        }
+    }
+    _file << "]}\n";
+    LOG(LEVEL_INFO, "Wrote {} trace events to {}", _count, outputPath);
+    if (_dropped > 0) {
+        LOG(LEVEL_WARNING, "Dropped {} trace events over the per-thread limit of {}", _dropped, MAX_EVENTS_PER_THREAD);
+    }
+}
+
+// Tracer of the process
+Tracer& GetTracer()
+{
+    static Tracer tracer;
+    return tracer;
+}
+
+/**
+ * @class TraceSpan
+ * @brief Records the lifetime of a scope if the current message is sampled.
+ *
+ * When tracing is off or the message is not sampled this is a thread-local load.
+ */
+class TraceSpan
+{
+public:
+    TraceSpan(const char* _name);
+    ~TraceSpan();
+
+private:
+    const char* name;
+    uint64_t correlationId;
+    int64_t beginNanos;
+};
+
+TraceSpan::TraceSpan(const char* _name)
+{
+    name = _name;
+    correlationId = Tracer::CurrentCorrelationId();
+    beginNanos = correlationId ? Tracer::Now() : 0;
+}
+
+TraceSpan::~TraceSpan()
+{
+    if (correlationId) GetTracer().Record(name, beginNanos, Tracer::Now(), correlationId);
+}
+
+/**
+ * @class TraceMessage
+ * @brief Marks the ingestion of one message by a connector.
+ *
+ * Assigns the correlation ID that every span downstream on this thread is tagged with,
+ * and records the ingestion span itself.
+ */
+class TraceMessage
+{
+public:
+    TraceMessage(const char* _name);
+    ~TraceMessage();
+
+private:
+    uint64_t previousId;   ///< Declared first: it installs the new ID before the span starts
+    TraceSpan span;
+
+    static uint64_t BeginMessage();
+};
+
+TraceMessage::TraceMessage(const char* _name) :
+        previousId(BeginMessage()), span(_name)
+{
+}
+
+TraceMessage::~TraceMessage()
+{
+    // the span keeps its own copy of the ID, so it can be closed after the restore
+    Tracer::CurrentCorrelationId() = previousId;
+}
+
+uint64_t TraceMessage::BeginMessage()
+{
+    uint64_t _previous = Tracer::CurrentCorrelationId();
+    Tracer::CurrentCorrelationId() = GetTracer().IsEnabled() ? GetTracer().NextCorrelationId() : 0;
+    return _previous;
+}
+
+#endif //SWE_MTH9815_TRACER_HPP
@@ -9,21 +9,36 @@
 
 
 #include "../products.hpp" // needed
+#include "logger.hpp"
+#include "tracer.hpp"
+#include "memorystats.hpp"
+#include <array>
+#include <cstdint>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <chrono>
 #include <random>
 #include <boost/date_time/gregorian/gregorian.hpp>
 
 
+// Price quoted as whole-xyz: xy in 32nds, then z in 256ths, '+' for 4/256 ("99-01+", "99-013")
 double ConvertBondPrice(const std::string& price) {
-    int whole, thirtySecond = 0, twoHundredFiftySixth = 0;
-    char dash, plus;
+    int whole = 0, thirtySecond = 0, twoHundredFiftySixth = 0;
+    char dash;
 
     std::istringstream iss(price);
-    iss >> whole >> dash >> thirtySecond;
-    if (iss >> plus && plus == '+') {
-        twoHundredFiftySixth = 4;
+    iss >> whole >> dash;
+    std::string fraction;
+    iss >> fraction;
+    size_t digits = 0;
+    while (digits < 2 && digits < fraction.size() && isdigit(static_cast<unsigned char>(fraction[digits]))) {
+        thirtySecond = thirtySecond * 10 + (fraction[digits++] - '0');
+    }
+    if (digits < fraction.size()) {
+        char last = fraction[digits];
+        if (last == '+') twoHundredFiftySixth = 4;
+        else if (isdigit(static_cast<unsigned char>(last))) twoHundredFiftySixth = last - '0';
     }
 
     return whole + thirtySecond / 32.0 + twoHundredFiftySixth / 256.0;
@@ -48,6 +63,21 @@ std::string FormatPrice(double price) {
     return formattedPrice;
 }
 
+// CUSIPs traded by the system; a product handle is the index of its CUSIP in this list
+constexpr size_t PRODUCT_COUNT = 7;
+constexpr std::array<std::string_view, PRODUCT_COUNT> PRODUCT_CUSIPS = {
+        "91282CJL6", "91282CJK8", "91282CJN2", "91282CJM4", "91282CJJ1", "912810TW8", "912810TV0"};
+constexpr uint32_t INVALID_PRODUCT_HANDLE = PRODUCT_COUNT;
+
+// Dense handle of a product, INVALID_PRODUCT_HANDLE if the CUSIP is unknown
+uint32_t GetProductHandle(std::string_view cusip)
+{
+    for (uint32_t i = 0; i < PRODUCT_COUNT; ++i) {
+        if (PRODUCT_CUSIPS[i] == cusip) return i;
+    }
+    return INVALID_PRODUCT_HANDLE;
+}
+
 Bond GetBond(string cusip)
 {
 
@@ -62,30 +92,13 @@ Bond GetBond(string cusip)
 }
 
 void PrintInLightBlue(const std::string& message) {
-    // ANSI escape code for light blue (cyan) text
-    const std::string LIGHT_BLUE = "\033[96m";
-    // ANSI escape code to reset color
-    const std::string RESET = "\033[0m";
-
-    std::cout << LIGHT_BLUE << message << RESET << std::endl;
+    // ANSI escape code for light blue (cyan) text, written by the async logger
+    LOG(LEVEL_INFO, "\033[96m{}\033[0m", message);
 }
 
 void printInYellow(const std::string& message) {
-    const std::string yellowCode = "33"; // ANSI color code for yellow
-    std::cout << "\033[" << yellowCode << "m" << message << "\033[0m" << std::endl;
-}
-
-double calculatePV01(string cusip)
-{
-    double pv01 = 0;
-    if (cusip == "91282CJL6") pv01 = 0.01;
-    if (cusip == "91282CJK8") pv01 = 0.02;
-    if (cusip == "91282CJN2") pv01 = 0.04;
-    if (cusip == "91282CJM4") pv01 = 0.06;
-    if (cusip == "91282CJJ1") pv01 = 0.08;
-    if (cusip == "912810TW8") pv01 = 0.12;
-    if (cusip == "912810TV0") pv01 = 0.20;
-    return pv01;
+    // ANSI color code for yellow, written by the async logger
+    LOG(LEVEL_INFO, "\033[33m{}\033[0m", message);
 }
 
 std::string GenerateRandomID() {
@@ -122,27 +135,26 @@ long GetCurrentTimeMillis() {
     return millis.count();
 }
 
-std::string CurrentDateTimeWithMillis() {
+std::string FormatDateTimeWithMillis(long epochMillis) {
     using namespace std::chrono;
 
-    // Get the current time point
-    auto now = system_clock::now();
-
     // Convert to time_t for extracting date and time
-    auto now_as_time_t = system_clock::to_time_t(now);
+    auto time = system_clock::time_point(milliseconds(epochMillis));
+    auto time_as_time_t = system_clock::to_time_t(time);
 
     // Convert to tm struct for formatting
-    auto now_tm = *std::localtime(&now_as_time_t);
-
-    // Extract milliseconds since the last second
-    auto millis = duration_cast<milliseconds>(now.time_since_epoch()) % 1000;
+    auto time_tm = *std::localtime(&time_as_time_t);
 
     // Format date, time, and milliseconds into a string
     std::stringstream ss;
-    ss << std::put_time(&now_tm, "%Y-%m-%d %H:%M:%S") << '.'
-       << std::setfill('0') << std::setw(3) << millis.count();
+    ss << std::put_time(&time_tm, "%Y-%m-%d %H:%M:%S") << '.'
+       << std::setfill('0') << std::setw(3) << epochMillis % 1000;
 
     return ss.str();
 }
 
+std::string CurrentDateTimeWithMillis() {
+    return FormatDateTimeWithMillis(GetCurrentTimeMillis());
+}
+
 #endif //SWE_MTH9815_UTILS_HPP
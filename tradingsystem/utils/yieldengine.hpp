@@ -0,0 +1,276 @@
+/**
+ * @file yieldengine.hpp
+ * @brief Defines the price-to-yield and yield-to-price conversions of the Treasury bonds.
+ *
+ * Prices are clean, per 100 face, with semi-annual coupons and street convention yields.
+ * The coupon schedule of each bond is reduced once per settlement date to the number of
+ * remaining coupons n, the fraction of a period to the next coupon w and the accrued interest,
+ * so that with the discount factor per period v = 1 / (1 + y/2) the dirty price has the closed form
+ *
+ *     P = v^w * (c * (1 - v^n) / (1 - v) + 100 * v^(n-1))
+ *
+ * whatever the maturity of the bond.
+ *
+ * @author Niccolo Fabbri
+ */
+#ifndef SWE_MTH9815_YIELDENGINE_HPP
+#define SWE_MTH9815_YIELDENGINE_HPP
+
+#include <array>
+#include <cmath>
+#include <stdexcept>
+#include <boost/date_time/gregorian/gregorian.hpp>
+#include "utils.hpp"
+
+using namespace std;
+using namespace boost::gregorian;
+
+/**
+ * @struct BondSchedule
+ * @brief Terms of the coupon schedule of a bond at a settlement date.
+ */
+struct BondSchedule
+{
+    double periods;   ///< Remaining coupons n
+    double fraction;  ///< Fraction of a period to the next coupon w
+    double coupon;    ///< Coupon per period per 100 face c
+    double accrued;   ///< Accrued interest per 100 face
+
+    // Schedule of a bond not matured at _settlement
+    static BondSchedule Of(const Bond& _bond, const date& _settlement);
+
+    // Clean price for a yield
+    double CleanPrice(double _yield) const;
+};
+// **********************************************************************************
+//                  Implementation of BondSchedule...
+// **********************************************************************************
+BondSchedule BondSchedule::Of(const Bond& _bond, const date& _settlement)
+{
+    if (_bond.GetMaturityDate() <= _settlement) {
+        throw std::runtime_error("Bond matured before settlement: " + _bond.GetProductId());
+    }
+
+    // walk the semi-annual coupon dates back from maturity; end-of-month dates stay end of month
+    date _next = _bond.GetMaturityDate();
+    long _remaining = 1;
+    while (_next - months(6) > _settlement) {
+        _next = _next - months(6);
+        _remaining++;
+    }
+    date _previous = _next - months(6);
+
+    BondSchedule _schedule;
+    _schedule.periods = static_cast<double>(_remaining);
+    _schedule.fraction = static_cast<double>((_next - _settlement).days())
+                         / static_cast<double>((_next - _previous).days());
+    _schedule.coupon = 100.0 * _bond.GetCoupon() / 2.0;
+    _schedule.accrued = _schedule.coupon * (1.0 - _schedule.fraction);
+    return _schedule;
+}
+
+double BondSchedule::CleanPrice(double _yield) const
+{
+    double _v = 1.0 / (1.0 + 0.5 * _yield);
+    double _vn = pow(_v, periods);
+    double _annuity = fabs(1.0 - _v) < 1e-9 ? periods : (1.0 - _vn) / (1.0 - _v);
+    return pow(_v, fraction) * (coupon * _annuity + 100.0 * _vn / _v) - accrued;
+}
+
+
+/**
+ * @class YieldEngine
+ * @brief Converts between clean prices and yields for every product handle.
+ *
+ * Newton's method runs on s = log(v) and starts from the last yield solved for the bond.
+ * Each bond keeps v, v^w and v^n at that yield, and a Newton step ds rescales them by
+ * exp(ds), exp(w ds) and exp(n ds). Those factors are close to 1 on a price tick and are
+ * evaluated with a short polynomial, so a warm conversion makes no exp/log calls and usually
+ * takes two steps. The terms live in arrays indexed by product handle; the batch conversion
+ * steps all bonds together so their dependency chains overlap.
+ */
+class YieldEngine
+{
+public:
+    // ctor computing the schedules of all products for a settlement date
+    YieldEngine(const date& _settlement = date(2023, Dec, 22));
+
+    // Settlement date of the conversions; changing it recomputes the schedules
+    void SetSettlementDate(const date& _settlement);
+    const date& GetSettlementDate() const;
+
+    // Compute the schedule of a bond, e.g. a new issue
+    void Register(const Bond& _bond);
+
+    // Clean price for a yield
+    double YieldToPrice(uint32_t _handle, double _yield) const;
+
+    // Yield for a clean price, warm-started from the last yield of the bond
+    double PriceToYield(uint32_t _handle, double _cleanPrice);
+
+    // Yields of all PRODUCT_COUNT products from their clean prices, indexed by handle
+    void PriceToYield(const double* _cleanPrices, double* _yields);
+
+    // Accrued interest per 100 face at the settlement date
+    double GetAccrued(uint32_t _handle) const;
+
+private:
+    // Newton stops once a step is below this; the error left is of the order of its square
+    static constexpr double STEP_TOLERANCE = 1e-8;
+    static constexpr int MAX_ITERATIONS = 32;
+
+    date settlement;
+    array<double, PRODUCT_COUNT> periods;   ///< Remaining coupons n
+    array<double, PRODUCT_COUNT> fraction;  ///< Fraction of a period to the next coupon w
+    array<double, PRODUCT_COUNT> coupon;    ///< Coupon per period per 100 face c
+    array<double, PRODUCT_COUNT> accrued;   ///< Accrued interest per 100 face
+    array<double, PRODUCT_COUNT> v;         ///< Discount factor per period at the last yield
+    array<double, PRODUCT_COUNT> vw;        ///< v^w at the last yield
+    array<double, PRODUCT_COUNT> vn;        ///< v^n at the last yield
+    array<bool, PRODUCT_COUNT> registered;
+
+    // exp(x), by its Taylor series when |x| is small enough for full double accuracy
+    static double Grow(double _x);
+
+    // Set the cached powers of a bond at a yield
+    void SetYield(uint32_t _handle, double _yield);
+
+    // One Newton step of a bond towards a dirty price; returns the step in log(v)
+    double Step(uint32_t _handle, double _dirty);
+
+    void CheckHandle(uint32_t _handle) const;
+};
+// **********************************************************************************
+//                  Implementation of YieldEngine...
+// **********************************************************************************
+YieldEngine::YieldEngine(const date& _settlement)
+{
+    registered.fill(false);
+    SetSettlementDate(_settlement);
+}
+
+void YieldEngine::SetSettlementDate(const date& _settlement)
+{
+    settlement = _settlement;
+    for (uint32_t i = 0; i < PRODUCT_COUNT; ++i) {
+        Register(GetBond(string(PRODUCT_CUSIPS[i])));
+    }
+}
+
+const date& YieldEngine::GetSettlementDate() const
+{
+    return settlement;
+}
+
+void YieldEngine::Register(const Bond& _bond)
+{
+    uint32_t _handle = GetProductHandle(_bond.GetProductId());
+    if (_handle == INVALID_PRODUCT_HANDLE) {
+        throw std::runtime_error("Unknown product for the yield engine: " + _bond.GetProductId());
+    }
+    BondSchedule _schedule = BondSchedule::Of(_bond, settlement);
+    periods[_handle] = _schedule.periods;
+    fraction[_handle] = _schedule.fraction;
+    coupon[_handle] = _schedule.coupon;
+    accrued[_handle] = _schedule.accrued;
+    registered[_handle] = true;
+    SetYield(_handle, _bond.GetCoupon());
+}
+
+void YieldEngine::CheckHandle(uint32_t _handle) const
+{
+    if (_handle >= PRODUCT_COUNT || !registered[_handle]) {
+        throw std::runtime_error("No schedule for product handle " + to_string(_handle));
+    }
+}
+
+double YieldEngine::Grow(double _x)
+{
+    if (fabs(_x) > 1.0 / 64) return exp(_x);
+    // Taylor series up to x^7 / 7!, grouped so the products do not wait on each other
+    double _x2 = _x * _x;
+    double _x4 = _x2 * _x2;
+    return (1.0 + _x) + _x2 * (1.0 / 2 + _x * (1.0 / 6))
+           + _x4 * ((1.0 / 24 + _x * (1.0 / 120)) + _x2 * (1.0 / 720 + _x * (1.0 / 5040)));
+}
+
+void YieldEngine::SetYield(uint32_t _handle, double _yield)
+{
+    double _s = -log1p(0.5 * _yield);
+    v[_handle] = exp(_s);
+    vw[_handle] = exp(fraction[_handle] * _s);
+    vn[_handle] = exp(periods[_handle] * _s);
+}
+
+double YieldEngine::Step(uint32_t _handle, double _dirty)
+{
+    double _n = periods[_handle], _w = fraction[_handle], _c = coupon[_handle];
+    double _v = v[_handle], _vw = vw[_handle], _vn = vn[_handle];
+
+    // price and its derivative with respect to s = log(v): dv/ds = v, d(v^k)/ds = k v^k
+    double _oneMinusV = 1.0 - _v;
+    double _vn1 = _vn / _v;
+    double _annuity, _dAnnuity;
+    if (fabs(_oneMinusV) < 1e-9) {
+        // limits at a zero yield
+        _annuity = _n;
+        _dAnnuity = 0.5 * _n * (_n - 1.0);
+    } else {
+        double _inverse = 1.0 / _oneMinusV;
+        _annuity = (1.0 - _vn) * _inverse;
+        _dAnnuity = (_annuity * _v - _n * _vn) * _inverse;
+    }
+    double _a = _c * _annuity + 100.0 * _vn1;
+    double _dA = _c * _dAnnuity + 100.0 * (_n - 1.0) * _vn1;
+    double _price = _vw * _a;
+    double _dPds = _vw * (_w * _a + _dA);
+
+    double _ds = (_dirty - _price) / _dPds;
+    v[_handle] = _v * Grow(_ds);
+    vw[_handle] = _vw * Grow(_w * _ds);
+    vn[_handle] = _vn * Grow(_n * _ds);
+    return _ds;
+}
+
+double YieldEngine::YieldToPrice(uint32_t _handle, double _yield) const
+{
+    CheckHandle(_handle);
+    return BondSchedule{periods[_handle], fraction[_handle], coupon[_handle], accrued[_handle]}.CleanPrice(_yield);
+}
+
+double YieldEngine::PriceToYield(uint32_t _handle, double _cleanPrice)
+{
+    CheckHandle(_handle);
+    double _dirty = _cleanPrice + accrued[_handle];
+    for (int i = 0; i < MAX_ITERATIONS; ++i) {
+        if (fabs(Step(_handle, _dirty)) < STEP_TOLERANCE) break;
+    }
+    return 2.0 * (1.0 / v[_handle] - 1.0);
+}
+
+void YieldEngine::PriceToYield(const double* _cleanPrices, double* _yields)
+{
+    for (int k = 0; k < MAX_ITERATIONS; ++k) {
+        double _largest = 0;
+        for (uint32_t i = 0; i < PRODUCT_COUNT; ++i) {
+            _largest = max(_largest, fabs(Step(i, _cleanPrices[i] + accrued[i])));
+        }
+        if (_largest < STEP_TOLERANCE) break;
+    }
+    for (uint32_t i = 0; i < PRODUCT_COUNT; ++i) _yields[i] = 2.0 * (1.0 / v[i] - 1.0);
+}
+
+double YieldEngine::GetAccrued(uint32_t _handle) const
+{
+    CheckHandle(_handle);
+    return accrued[_handle];
+}
+
+// Yield engine shared by the services
+YieldEngine& GetYieldEngine()
+{
+    static YieldEngine engine;
+    return engine;
+}
+
+#endif //SWE_MTH9815_YIELDENGINE_HPP